@@ -0,0 +1,47 @@
+#!/usr/bin/perl
+
+use strict;
+use File::Basename;
+use Digest::MD5 qw(md5_hex);
+use IO::Compress::Gzip qw(gzip $GzipError);
+
+die "usage: $0 [file] [brotli encoded file]\n" unless ($ARGV[0]);
+
+sub slurp {
+	my ($path) = @_;
+	open(my $fh, '<:raw', $path) or die "cannot open $path: $!";
+	my $all = do { local $/; <$fh> };
+	close($fh);
+	return $all;
+}
+
+sub array {
+	my ($name, $data) = @_;
+	my @bytes = map { sprintf("0x%02x", $_) } unpack("C*", $data);
+	my $lines = "";
+	while (my @line = splice(@bytes, 0, 16)) {
+		$lines .= "\t" . join(",", @line) . ",\n";
+	}
+	return "const unsigned char $name\[\] = {\n$lines};\n"
+		. "const size_t ${name}_SIZE = " . length($data) . ";\n";
+}
+
+my $all = slurp($ARGV[0]);
+# Minimal header without name or time so that builds are reproducible.
+my $gz;
+gzip(\$all => \$gz, -Level => 9, Minimal => 1) or die "gzip failed: $GzipError\n";
+
+my $var = uc (basename($ARGV[0]));
+$var =~ s/\s+/_/g;
+$var =~ s/\./_/g;
+
+print "/* Generated from " . basename($ARGV[0]) . " */\n";
+print "const char WWW_${var}_ETAG[] = \"" . substr(md5_hex($all), 0, 16) . "\";\n";
+print array("WWW_$var", $all);
+print array("WWW_${var}_GZ", $gz);
+if ($ARGV[1]) {
+	print array("WWW_${var}_BR", slurp($ARGV[1]));
+} else {
+	print "const unsigned char* const WWW_${var}_BR = nullptr;\n";
+	print "const size_t WWW_${var}_BR_SIZE = 0;\n";
+}
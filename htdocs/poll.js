@@ -1,14 +1,13 @@
 // ES6 Harmony
 // Whole-script strict mode syntax
 "use strict";
-class KigoronPoller {
+class KigoronSubscriber {
 // TBD: Named or default parameters not yet supported.
-	constructor(url, ping_interval, reconnect_interval) {
+	constructor(url, topics, reconnect_interval) {
 		this.url = url;
-		this.ping_interval = ping_interval;
+		this.topics = topics;
 		this.reconnect_interval = reconnect_interval;
 		this.sock = undefined;
-		this.poll_id = undefined;
 		this.reconnect_id = undefined;
 	}
 
@@ -23,12 +22,11 @@ class KigoronPoller {
 
 	OnOpen() {
 		document.getElementById("status").textContent = "connected";
-		this.SchedulePoll();
+		this.Subscribe(this.topics);
 	}
 
 	Close() {
 		this.CancelReconnect();
-		this.CancelPoll();
 		if (this.sock !== undefined) {
 			this.sock.close();
 			this.sock = undefined;
@@ -37,7 +35,6 @@ class KigoronPoller {
 
 // Reconnect if close is not clean.
 	OnClose(e) {
-		this.CancelPoll();
 		if (!e.wasClean) {
 			document.getElementById("status").textContent = "disconnected";
 			this.ScheduleReconnect();
@@ -59,51 +56,39 @@ class KigoronPoller {
 		}
 	}
 
-// Target 10fps in focus, 5fps out-of-focus but still visible, and paused if hidden.
-	SchedulePoll() {
-		let timeout = this.ping_interval;
-		if (!document.hasFocus()) {
-			timeout *= 2;
-		}
-		this.poll_id = window.setTimeout(() => this.SendPoll(), timeout);
-	}
-
-	CancelPoll() {
-		if (typeof this.poll_id === "number") {
-			window.clearTimeout(this.poll_id);
-			this.poll_id = undefined;
-		}
-	}
-
-	SendPoll() {
-		if (this.sock.readyState !== WebSocket.OPEN)
+// Server pushes one frame per interval for the selected topics, an empty
+// selection pauses the stream.
+	Subscribe(topics) {
+		if (this.sock === undefined || this.sock.readyState !== WebSocket.OPEN)
 			return;
-		if (this.sock.bufferedAmount === 0)
-			this.sock.send("!");
+		this.sock.send(topics.join(","));
 	}
 
 	OnMessage(e) {
 		let msg = JSON.parse(e.data);
 		window.requestAnimationFrame(() => this.OnUpdate(msg));
-		this.SchedulePoll();
 	}
 
 	OnUpdate(msg) {
-		document.getElementById("hostname").textContent = msg.hostname;
-		document.getElementById("username").textContent = msg.username;
-		document.getElementById("pid").textContent = msg.pid;
-		document.getElementById("clients").textContent = msg.clients;
-		document.getElementById("msgs").textContent = msg.msgs;
+		if (msg.info !== undefined) {
+			document.getElementById("hostname").textContent = msg.info.hostname;
+			document.getElementById("username").textContent = msg.info.username;
+			document.getElementById("pid").textContent = msg.info.pid;
+			document.getElementById("clients").textContent = msg.info.clients;
+			document.getElementById("msgs").textContent = msg.info.msgs;
+		}
+		if (msg.counters !== undefined) {
+			document.getElementById("msgs_rate").textContent = msg.counters.rssl_msgs_received.rate.toFixed(1);
+		}
 	}
 
 	OnHidden() {
 		document.getElementById("status").textContent = "paused";
-		this.CancelPoll();
+		this.Subscribe([]);
 	}
 
 	OnVisible() {
-		if (this.poll_id === undefined &&
-			this.sock !== undefined &&
+		if (this.sock !== undefined &&
 			this.sock.readyState === WebSocket.OPEN)
 		{
 			this.OnOpen();
@@ -111,19 +96,19 @@ class KigoronPoller {
 	}
 }
 
-let poller = new KigoronPoller("ws://" + window.location.host + "/ws", 100, 1000);
-poller.Connect();
+let subscriber = new KigoronSubscriber("ws://" + window.location.host + "/ws", ["info", "counters"], 1000);
+subscriber.Connect();
 
 document.addEventListener("visibilitychange", function() {
 	switch(document.visibilityState) {
 	case "hidden":
-		poller.OnHidden();
+		subscriber.OnHidden();
 		break;
 	case "unloaded":
-		poller.Close();
+		subscriber.Close();
 		break;
 	case "visible":
-		poller.OnVisible();
+		subscriber.OnVisible();
 		break;
 	}
 });
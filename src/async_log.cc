@@ -0,0 +1,280 @@
+/* Asynchronous batched log output.
+ */
+
+#include "async_log.hh"
+
+#include <windows.h>
+
+#include <sstream>
+
+#include "chromium/strings/stringprintf.hh"
+
+namespace {
+
+/* Records written per batch before the next flush. */
+const size_t kMaxBatchRecords = 1024;
+
+/* Idle wait for further records. */
+const unsigned kIdleIntervalMs = 100;
+
+}  // namespace anon
+
+boost::atomic<kigoron::async_log_t*> kigoron::async_log_t::instance_ (nullptr);
+
+kigoron::async_log_t::async_log_t (
+	const std::string& path,
+	uint64_t max_file_size,
+	unsigned max_files,
+	bool to_stdout
+	)
+	: cells_ (new cell_t[kQueueCapacity])
+	, enqueue_pos_ (0)
+	, dequeue_pos_ (0)
+	, dropped_ (0)
+	, is_sleeping_ (false)
+	, keep_running_ (false)
+	, path_ (path)
+	, max_file_size_ (max_file_size)
+	, max_files_ (max_files)
+	, to_stdout_ (to_stdout)
+	, fp_ (nullptr)
+	, file_size_ (0)
+{
+	for (size_t i = 0; i < kQueueCapacity; ++i)
+		cells_[i].sequence.store (i, boost::memory_order_relaxed);
+}
+
+kigoron::async_log_t::~async_log_t()
+{
+	Stop();
+}
+
+bool
+kigoron::async_log_t::Start()
+{
+	if ((bool)thread_)
+		return true;
+	if (!path_.empty() && !OpenFile())
+		return false;
+	keep_running_ = true;
+	thread_.reset (new boost::thread ([this]() { Run(); }));
+	instance_.store (this, boost::memory_order_release);
+	return true;
+}
+
+void
+kigoron::async_log_t::Stop()
+{
+	if (!(bool)thread_)
+		return;
+/* Later messages take the synchronous path. */
+	async_log_t* expected = this;
+	instance_.compare_exchange_strong (expected, nullptr);
+	keep_running_ = false;
+	{
+		boost::lock_guard<boost::mutex> lock (wake_lock_);
+		wake_cond_.notify_one();
+	}
+	thread_->join();
+	thread_.reset();
+	if (nullptr != fp_) {
+		fclose (fp_);
+		fp_ = nullptr;
+	}
+}
+
+bool
+kigoron::async_log_t::Push (
+	const std::string& record
+	)
+{
+	const size_t mask = kQueueCapacity - 1;
+	size_t pos = enqueue_pos_.load (boost::memory_order_relaxed);
+	cell_t* cell;
+	for (;;) {
+		cell = &cells_[pos & mask];
+		const size_t sequence = cell->sequence.load (boost::memory_order_acquire);
+		const intptr_t difference = static_cast<intptr_t> (sequence) - static_cast<intptr_t> (pos);
+		if (0 == difference) {
+			if (enqueue_pos_.compare_exchange_weak (pos, pos + 1, boost::memory_order_relaxed))
+				break;
+		} else if (difference < 0) {
+			dropped_.fetch_add (1, boost::memory_order_relaxed);
+			return false;
+		} else {
+			pos = enqueue_pos_.load (boost::memory_order_relaxed);
+		}
+	}
+	cell->data.assign (record);
+	cell->sequence.store (pos + 1, boost::memory_order_release);
+/* Pairs with the consumer publishing is_sleeping_ before re-checking the queue. */
+	boost::atomic_thread_fence (boost::memory_order_seq_cst);
+	if (is_sleeping_.load (boost::memory_order_relaxed)) {
+		boost::lock_guard<boost::mutex> lock (wake_lock_);
+		wake_cond_.notify_one();
+	}
+	return true;
+}
+
+/* Swaps record buffers with the cell so capacity is recycled. */
+bool
+kigoron::async_log_t::Pop (
+	std::string* record
+	)
+{
+	const size_t mask = kQueueCapacity - 1;
+	size_t pos = dequeue_pos_.load (boost::memory_order_relaxed);
+	cell_t* cell;
+	for (;;) {
+		cell = &cells_[pos & mask];
+		const size_t sequence = cell->sequence.load (boost::memory_order_acquire);
+		const intptr_t difference = static_cast<intptr_t> (sequence) - static_cast<intptr_t> (pos + 1);
+		if (0 == difference) {
+			if (dequeue_pos_.compare_exchange_weak (pos, pos + 1, boost::memory_order_relaxed))
+				break;
+		} else if (difference < 0) {
+			return false;
+		} else {
+			pos = dequeue_pos_.load (boost::memory_order_relaxed);
+		}
+	}
+	record->swap (cell->data);
+	cell->data.clear();
+	cell->sequence.store (pos + mask + 1, boost::memory_order_release);
+	return true;
+}
+
+bool
+kigoron::async_log_t::IsEmpty() const
+{
+	const size_t pos = dequeue_pos_.load (boost::memory_order_relaxed);
+	const size_t sequence = cells_[pos & (kQueueCapacity - 1)].sequence.load (boost::memory_order_acquire);
+	return sequence != pos + 1;
+}
+
+void
+kigoron::async_log_t::Run()
+{
+	std::string batch, record;
+	for (;;) {
+		batch.clear();
+		for (size_t i = 0; i < kMaxBatchRecords && Pop (&record); ++i)
+			batch.append (record);
+		const uint64_t dropped = dropped_.exchange (0, boost::memory_order_relaxed);
+		if (dropped > 0)
+			chromium::StringAppendF (&batch, "Log queue full, %llu messages dropped.\n", static_cast<unsigned long long> (dropped));
+		if (!batch.empty()) {
+			WriteBatch (batch);
+			continue;
+		}
+		if (!keep_running_)
+			break;
+		boost::unique_lock<boost::mutex> lock (wake_lock_);
+		is_sleeping_.store (true, boost::memory_order_relaxed);
+		boost::atomic_thread_fence (boost::memory_order_seq_cst);
+		if (IsEmpty() && keep_running_)
+			wake_cond_.timed_wait (lock, boost::posix_time::milliseconds (kIdleIntervalMs));
+		is_sleeping_.store (false, boost::memory_order_relaxed);
+	}
+}
+
+void
+kigoron::async_log_t::WriteBatch (
+	const std::string& batch
+	)
+{
+	if (to_stdout_) {
+		fwrite (batch.data(), 1, batch.size(), stdout);
+		fflush (stdout);
+	}
+	if (nullptr == fp_)
+		return;
+	if (max_file_size_ > 0 && file_size_ > 0 && file_size_ + batch.size() > max_file_size_) {
+		if (!RotateFile())
+			return;
+	}
+	file_size_ += fwrite (batch.data(), 1, batch.size(), fp_);
+	fflush (fp_);
+}
+
+bool
+kigoron::async_log_t::OpenFile()
+{
+	fp_ = fopen (path_.c_str(), "ab");
+	if (nullptr == fp_) {
+		fprintf (stderr, "Cannot open log file \"%s\".\n", path_.c_str());
+		return false;
+	}
+	fseek (fp_, 0, SEEK_END);
+	const long size = ftell (fp_);
+	file_size_ = (size > 0) ? static_cast<uint64_t> (size) : 0;
+	return true;
+}
+
+/* Kigoron.log becomes Kigoron.log.1, and so on up to |max_files_|.  Should
+ * the current file remain in place it is appended to and rotation is next
+ * attempted after another |max_file_size_| bytes.  Errors are reported to
+ * stderr as this thread is the log sink.
+ */
+bool
+kigoron::async_log_t::RotateFile()
+{
+	bool is_rotated = true;
+	fclose (fp_);
+	fp_ = nullptr;
+	for (unsigned i = max_files_; i > 0; --i) {
+		std::ostringstream from, to;
+		from << path_;
+		if (i > 1) from << '.' << (i - 1);
+		to << path_ << '.' << i;
+		if (!MoveFileExA (from.str().c_str(), to.str().c_str(), MOVEFILE_REPLACE_EXISTING)) {
+			const DWORD error = GetLastError();
+			if (ERROR_FILE_NOT_FOUND == error)
+				continue;
+			fprintf (stderr, "Cannot rename log file \"%s\" to \"%s\", error %lu.\n",
+				 from.str().c_str(), to.str().c_str(), error);
+			if (1 == i)
+				is_rotated = false;
+		}
+	}
+	if (0 == max_files_ && !DeleteFileA (path_.c_str())) {
+		fprintf (stderr, "Cannot delete log file \"%s\", error %lu.\n", path_.c_str(), GetLastError());
+		is_rotated = false;
+	}
+	if (!OpenFile())
+		return false;
+	if (!is_rotated)
+		file_size_ = 0;
+	return true;
+}
+
+/* Fatal messages take the synchronous path. */
+bool
+kigoron::async_log_t::log_handler (
+	int severity,
+	const char* file,
+	int line,
+	size_t message_start,
+	const std::string& str
+	)
+{
+	if (severity >= logging::LOG_FATAL)
+		return false;
+	async_log_t* instance = instance_.load (boost::memory_order_acquire);
+	if (nullptr == instance)
+		return false;
+	instance->Push (str);
+	return true;
+}
+
+bool
+kigoron::log_rate_limiter_t::ShouldLog()
+{
+	const uint64_t window = GetTickCount64() / 1000;
+	uint64_t current = window_.load (boost::memory_order_relaxed);
+	if (current != window && window_.compare_exchange_strong (current, window, boost::memory_order_relaxed))
+		count_.store (0, boost::memory_order_relaxed);
+	return count_.fetch_add (1, boost::memory_order_relaxed) < limit_;
+}
+
+/* eof */
@@ -0,0 +1,126 @@
+/* Asynchronous batched log output.
+ *
+ * Formatted log records are pushed by any thread onto a bounded lock-free
+ * queue, a background thread drains the queue in batches to stdout and a
+ * size rotated log file.  Producers never block on I/O, records are dropped
+ * and counted when the queue is full.
+ */
+
+#ifndef ASYNC_LOG_HH_
+#define ASYNC_LOG_HH_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+/* Boost threading. */
+#include <boost/thread.hpp>
+
+#include "chromium/logging.hh"
+
+namespace kigoron
+{
+	class async_log_t
+	{
+	public:
+/* Records held before producers start dropping, must be a power of two. */
+		static const size_t kQueueCapacity = 1u << 14;
+
+/* Empty |path| disables file output. */
+		explicit async_log_t (const std::string& path, uint64_t max_file_size, unsigned max_files, bool to_stdout);
+		~async_log_t();
+
+		bool Start();
+/* Drains remaining records and joins the background thread. */
+		void Stop();
+
+/* Non-blocking, returns false if the queue is full. */
+		bool Push (const std::string& record);
+
+/* logging::LogMessageHandlerFunction routing to the started instance. */
+		static bool log_handler (int severity, const char* file, int line, size_t message_start, const std::string& str);
+
+	private:
+		bool Pop (std::string* record);
+		bool IsEmpty() const;
+		void Run();
+		void WriteBatch (const std::string& batch);
+		bool OpenFile();
+		bool RotateFile();
+
+/* Bounded MPMC queue after Dmitry Vyukov, each cell carries its sequence. */
+		struct cell_t {
+			boost::atomic<size_t> sequence;
+			std::string data;
+		};
+		std::unique_ptr<cell_t[]> cells_;
+		char padding0_[64];
+		boost::atomic<size_t> enqueue_pos_;
+		char padding1_[64];
+		boost::atomic<size_t> dequeue_pos_;
+		char padding2_[64];
+		boost::atomic<uint64_t> dropped_;
+
+/* Consumer wake-up, producers only signal when the consumer sleeps. */
+		boost::atomic_bool is_sleeping_;
+		boost::mutex wake_lock_;
+		boost::condition_variable wake_cond_;
+		boost::atomic_bool keep_running_;
+		std::unique_ptr<boost::thread> thread_;
+
+/* Output, background thread only. */
+		const std::string path_;
+		const uint64_t max_file_size_;
+		const unsigned max_files_;
+		const bool to_stdout_;
+		FILE* fp_;
+		uint64_t file_size_;
+
+		static boost::atomic<async_log_t*> instance_;
+	};
+
+/* Passes every |n|th call. */
+	class log_sampler_t
+	{
+	public:
+		explicit log_sampler_t (unsigned n) : n_ (n > 0 ? n : 1), count_ (0) {}
+		bool ShouldLog() {
+			return 0 == (count_.fetch_add (1, boost::memory_order_relaxed) % n_);
+		}
+	private:
+		const unsigned n_;
+		boost::atomic<unsigned> count_;
+	};
+
+/* Passes at most |limit| calls per wall-clock second. */
+	class log_rate_limiter_t
+	{
+	public:
+		explicit log_rate_limiter_t (unsigned limit) : limit_ (limit), window_ (0), count_ (0) {}
+		bool ShouldLog();
+	private:
+		const unsigned limit_;
+		boost::atomic<uint64_t> window_;
+		boost::atomic<unsigned> count_;
+	};
+
+} /* namespace kigoron */
+
+/* Per call site sampling and rate limiting, |n| must be a constant.
+ *
+ *   LOG_EVERY_N(INFO, 100) << "Logged on calls 1, 101, 201, ...";
+ *   LOG_RATE_LIMITED(INFO, 10) << "At most ten per second.";
+ */
+#define LOG_EVERY_N(severity, n) \
+	LOG_IF(severity, ([]() -> bool { static kigoron::log_sampler_t sampler (n); return sampler.ShouldLog(); })())
+
+#define LOG_RATE_LIMITED(severity, n) \
+	LOG_IF(severity, ([]() -> bool { static kigoron::log_rate_limiter_t limiter (n); return limiter.ShouldLog(); })())
+
+#endif /* ASYNC_LOG_HH_ */
+
+/* eof */
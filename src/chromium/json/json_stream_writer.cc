@@ -0,0 +1,166 @@
+// Copyright (c) 2012 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromium/json/json_stream_writer.hh"
+
+#include <float.h>
+
+#include "chromium/format_macros.hh"
+#include "chromium/json/string_escape.hh"
+#include "chromium/logging.hh"
+#include "chromium/strings/stringprintf.hh"
+#include "chromium/strings/string_number_conversions.hh"
+
+namespace chromium {
+
+JSONStreamWriter::JSONStreamWriter(std::string* json)
+    : json_(json),
+      has_element_(0),
+      is_object_(0),
+      depth_(0),
+      after_key_(false) {
+  DCHECK(json);
+}
+
+JSONStreamWriter::~JSONStreamWriter() {
+  DCHECK_EQ(0, depth_) << "Unbalanced JSON containers.";
+}
+
+void JSONStreamWriter::BeforeValue() {
+  const uint64_t bit = 1ULL << depth_;
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  DCHECK(!(is_object_ & bit)) << "Object member without a key.";
+  DCHECK(depth_ > 0 || !(has_element_ & bit)) << "Multiple top level values.";
+  if (has_element_ & bit)
+    json_->push_back(',');
+  has_element_ |= bit;
+}
+
+void JSONStreamWriter::Push(bool is_object) {
+  BeforeValue();
+  json_->push_back(is_object ? '{' : '[');
+  CHECK_LT(depth_, kMaxDepth);
+  ++depth_;
+  const uint64_t bit = 1ULL << depth_;
+  has_element_ &= ~bit;
+  if (is_object)
+    is_object_ |= bit;
+  else
+    is_object_ &= ~bit;
+}
+
+void JSONStreamWriter::Pop(bool is_object) {
+  DCHECK_GT(depth_, 0);
+  DCHECK_EQ(is_object, !!(is_object_ & (1ULL << depth_)));
+  DCHECK(!after_key_) << "Key without a value.";
+  --depth_;
+  json_->push_back(is_object ? '}' : ']');
+}
+
+void JSONStreamWriter::BeginObject() {
+  Push(true);
+}
+
+void JSONStreamWriter::EndObject() {
+  Pop(true);
+}
+
+void JSONStreamWriter::BeginArray() {
+  Push(false);
+}
+
+void JSONStreamWriter::EndArray() {
+  Pop(false);
+}
+
+void JSONStreamWriter::Key(const StringPiece& key) {
+  const uint64_t bit = 1ULL << depth_;
+  DCHECK(is_object_ & bit) << "Key outside of an object.";
+  DCHECK(!after_key_) << "Key without a value.";
+  if (has_element_ & bit)
+    json_->push_back(',');
+  has_element_ |= bit;
+  JsonDoubleQuote(key, true, json_);
+  json_->push_back(':');
+  after_key_ = true;
+}
+
+void JSONStreamWriter::Null() {
+  BeforeValue();
+  json_->append("null");
+}
+
+void JSONStreamWriter::Bool(bool value) {
+  BeforeValue();
+  json_->append(value ? "true" : "false");
+}
+
+void JSONStreamWriter::Int(int value) {
+  BeforeValue();
+  StringAppendF(json_, "%d", value);
+}
+
+void JSONStreamWriter::Int64(int64_t value) {
+  BeforeValue();
+  StringAppendF(json_, "%" PRId64, value);
+}
+
+void JSONStreamWriter::Uint64(uint64_t value) {
+  BeforeValue();
+  StringAppendF(json_, "%" PRIu64, value);
+}
+
+void JSONStreamWriter::Double(double value) {
+  if (!_finite(value)) {
+    Null();
+    return;
+  }
+  BeforeValue();
+  const std::string real = DoubleToString(value);
+  // The JSON spec requires that non-integer values in the range (-1,1)
+  // have a zero before the decimal point - ".52" is not valid, "0.52" is.
+  if (real[0] == '.') {
+    json_->push_back('0');
+    json_->append(real);
+  } else if (real.length() > 1 && real[0] == '-' && real[1] == '.') {
+    // "-.1" bad "-0.1" good
+    json_->append("-0");
+    json_->append(real, 1, std::string::npos);
+  } else {
+    json_->append(real);
+  }
+  // Ensure that the number has a .0 if there's no decimal or 'e'.  This
+  // makes sure that when we read the JSON back, it's interpreted as a
+  // real rather than an int.
+  if (real.find_first_of(".eE") == std::string::npos)
+    json_->append(".0");
+}
+
+void JSONStreamWriter::String(const StringPiece& value) {
+  BeforeValue();
+  JsonDoubleQuote(value, true, json_);
+}
+
+void JSONStreamWriter::Raw(const StringPiece& json) {
+  DCHECK(!json.empty());
+  BeforeValue();
+  json.AppendToString(json_);
+}
+
+void JSONStreamWriter::RawMembers(const StringPiece& members) {
+  const uint64_t bit = 1ULL << depth_;
+  DCHECK(is_object_ & bit) << "Members outside of an object.";
+  DCHECK(!after_key_) << "Key without a value.";
+  if (members.empty())
+    return;
+  if (has_element_ & bit)
+    json_->push_back(',');
+  has_element_ |= bit;
+  members.AppendToString(json_);
+}
+
+}  // namespace chromium
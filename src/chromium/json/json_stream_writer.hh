@@ -0,0 +1,79 @@
+// Copyright (c) 2012 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROMIUM_JSON_JSON_STREAM_WRITER_HH_
+#define CHROMIUM_JSON_JSON_STREAM_WRITER_HH_
+
+#include <cstdint>
+#include <string>
+
+#include "chromium/strings/string_piece.hh"
+
+namespace chromium {
+
+// Generates compact JSON directly into a caller owned buffer, without an
+// intermediate Value tree.  Separators are inserted automatically, nesting
+// is checked in debug builds.
+//
+//   std::string json;
+//   JSONStreamWriter writer(&json);
+//   writer.BeginObject();
+//   writer.Key("count");
+//   writer.Uint64(count);
+//   writer.EndObject();
+class JSONStreamWriter {
+ public:
+  // Output is appended to |json|, reuse a buffer to retain its capacity.
+  explicit JSONStreamWriter(std::string* json);
+  ~JSONStreamWriter();
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  // Member name, must precede every value within an object.
+  void Key(const StringPiece& key);
+
+  void Null();
+  void Bool(bool value);
+  void Int(int value);
+  void Int64(int64_t value);
+  void Uint64(uint64_t value);
+  // Written with the same representation as JSONWriter, non-finite values
+  // as null.
+  void Double(double value);
+  void String(const StringPiece& value);
+
+  // Pre-serialized JSON value.
+  void Raw(const StringPiece& json);
+  // Pre-serialized object members without braces, e.g. "a":1,"b":2.
+  void RawMembers(const StringPiece& members);
+
+  // True once a complete top level value has been written.
+  bool is_complete() const { return depth_ == 0 && has_element_ != 0; }
+
+ private:
+  // Nesting limit, one bit per level in the state masks.
+  static const int kMaxDepth = 63;
+
+  // Writes any separator due before a value or key.
+  void BeforeValue();
+  void Push(bool is_object);
+  void Pop(bool is_object);
+
+  std::string* json_;
+
+  // Bit |depth| set once the container at that depth has an element, bit
+  // zero for the top level value.
+  uint64_t has_element_;
+  // Bit |depth| set if the container at that depth is an object.
+  uint64_t is_object_;
+  int depth_;
+  bool after_key_;
+};
+
+}  // namespace chromium
+
+#endif  // CHROMIUM_JSON_JSON_STREAM_WRITER_HH_
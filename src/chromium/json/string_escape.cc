@@ -78,7 +78,7 @@ void JsonDoubleQuoteT(const STR& str,
 
 }  // namespace
 
-void JsonDoubleQuote(const std::string& str,
+void JsonDoubleQuote(const StringPiece& str,
                      bool put_in_quotes,
                      std::string* dst) {
   JsonDoubleQuoteT(str, put_in_quotes, dst);
@@ -9,6 +9,8 @@
 
 #include <string>
 
+#include "chromium/strings/string_piece.hh"
+
 namespace chromium {
 
 // Escape |str| appropriately for a JSON string literal, _appending_ the
@@ -16,7 +18,7 @@ namespace chromium {
 // If |put_in_quotes| is true, the result will be surrounded in double quotes.
 // The outputted literal, when interpreted by the browser, should result in a
 // javascript string that is identical and the same length as the input |str|.
-void JsonDoubleQuote(const std::string& str,
+void JsonDoubleQuote(const StringPiece& str,
                                  bool put_in_quotes,
                                  std::string* dst);
 
@@ -4,6 +4,7 @@
 #include "client.hh"
 
 #include <algorithm>
+#include <sstream>
 #include <utility>
 
 #include <windows.h>
@@ -11,6 +12,7 @@
 #include "chromium/logging.hh"
 #include "chromium/strings/string_piece.hh"
 #include "upaostream.hh"
+#include "dictionary.hh"
 #include "provider.hh"
 
 
@@ -35,15 +37,16 @@ kigoron::client_t::client_t (
 	, last_activity_ (now)
 	, provider_ (provider)
 	, delegate_ (delegate)
-	, address_ (address)
+	, id_ (0)
+	, address_ (std::make_shared<std::string> (address))
+	, name_ (std::make_shared<std::string>())
 	, handle_ (handle)
 	, pending_count_ (0)
+	, has_channel_info_ (false)
 	, is_logged_in_ (false)
 	, login_token_ (0)
+	, latency_ (std::make_shared<client_latency_t>())
 {
-	ZeroMemory (cumulative_stats_, sizeof (cumulative_stats_));
-	ZeroMemory (snap_stats_, sizeof (snap_stats_));
-
 /* Set logger ID */
 	std::ostringstream ss;
 	ss << handle_ << ':';
@@ -60,9 +63,13 @@ kigoron::client_t::~client_t()
 	const auto uptime = second_clock::universal_time() - creation_time_;
 	VLOG(3) << prefix_ << "Summary: {"
 		 " \"Uptime\": \"" << to_simple_string (uptime) << "\""
-		", \"MsgsReceived\": " << cumulative_stats_[CLIENT_PC_RSSL_MSGS_RECEIVED] <<
-		", \"MsgsSent\": " << cumulative_stats_[CLIENT_PC_RSSL_MSGS_SENT] <<
-		", \"MsgsRejected\": " << cumulative_stats_[CLIENT_PC_RSSL_MSGS_REJECTED] <<
+		", \"MsgsReceived\": " << cumulative_stats_.value (CLIENT_PC_RSSL_MSGS_RECEIVED) <<
+		", \"MsgsSent\": " << cumulative_stats_.value (CLIENT_PC_RSSL_MSGS_SENT) <<
+		", \"MsgsRejected\": " << cumulative_stats_.value (CLIENT_PC_RSSL_MSGS_REJECTED) <<
+		", \"BytesReceived\": " << cumulative_stats_.value (CLIENT_PC_BYTES_RECEIVED) <<
+		", \"BytesSent\": " << cumulative_stats_.value (CLIENT_PC_BYTES_SENT) <<
+		", \"ReceiveCompressionRatio\": " << receive_compression_ratio() <<
+		", \"SendCompressionRatio\": " << send_compression_ratio() <<
 		" }";
 }
 
@@ -98,30 +105,17 @@ kigoron::client_t::Initialize()
 		", \"state\": \"" << internal::channel_state_string (handle_->state) << "\""
 		" }";
 
-/* Set new temporal buffer sizing, Windows default 8192. */
-	if (!provider_->send_buffer_size().empty()) {
-		const uint32_t send_buffer_size = std::atol (provider_->send_buffer_size().c_str());
-		rc = rsslIoctl (handle_, RSSL_SYSTEM_WRITE_BUFFERS, const_cast<uint32_t*> (&send_buffer_size), &rssl_err);
+/* Minimum message size for compression, ignored when compression is not negotiated. */
+	if (0 != provider_->compression_threshold()) {
+		const uint32_t compression_threshold = provider_->compression_threshold();
+		rc = rsslIoctl (handle_, RSSL_COMPRESSION_THRESHOLD, const_cast<uint32_t*> (&compression_threshold), &rssl_err);
 		if (RSSL_RET_SUCCESS != rc) {
 			LOG(WARNING) << prefix_ << "rssIoctl: { "
 				  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
 				", \"sysError\": " << rssl_err.sysError << ""
 				", \"text\": \"" << rssl_err.text << "\""
-				", \"ioctlCode\": \"RSSL_SYSTEM_WRITE_BUFFERS\""
-				", \"value\": " << send_buffer_size << ""
-				" }";
-		}
-	}
-	if (!provider_->recv_buffer_size().empty()) {
-		const uint32_t recv_buffer_size = std::atol (provider_->recv_buffer_size().c_str());
-		rc = rsslIoctl (handle_, RSSL_SYSTEM_READ_BUFFERS, const_cast<uint32_t*> (&recv_buffer_size), &rssl_err);
-		if (RSSL_RET_SUCCESS != rc) {
-			LOG(WARNING) << prefix_ << "rssIoctl: { "
-				  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
-				", \"sysError\": " << rssl_err.sysError << ""
-				", \"text\": \"" << rssl_err.text << "\""
-				", \"ioctlCode\": \"RSSL_SYSTEM_READ_BUFFERS\""
-				", \"value\": " << recv_buffer_size << ""
+				", \"ioctlCode\": \"RSSL_COMPRESSION_THRESHOLD\""
+				", \"value\": " << compression_threshold << ""
 				" }";
 		}
 	}
@@ -136,6 +130,9 @@ kigoron::client_t::Initialize()
 			" }";
 		return false;
 	}
+	channel_info_ = info;
+	has_channel_info_ = true;
+	view_.reset();
 
 /* Log connected infrastructure. */
 	std::stringstream components;
@@ -475,7 +472,7 @@ kigoron::client_t::RejectLogin (
 	response.state.code = RSSL_SC_NOT_ENTITLED; // RSSL_SC_TOO_MANY_ITEMS would be more suitable, but does not follow RDM spec.
 	response.flags |= RSSL_STMF_HAS_STATE;
 
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
+	buf = GetBuffer (MAX_MSG_SIZE, &rssl_err);
 	if (nullptr == buf) {
 		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
 			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
@@ -555,9 +552,10 @@ cleanup:
  * NB: There can only be one login per client session.
  */
 bool
-kigoron::client_t::AcceptLogin (
+kigoron::client_t::WriteRawLogin (
 	const RsslRequestMsg* login_msg,
-	int32_t login_token
+	void* data,
+	size_t* length
 	)
 {
 #ifndef NDEBUG
@@ -578,12 +576,11 @@ kigoron::client_t::AcceptLogin (
 	rsslClearElementEntry (&element_entry);
 	rsslClearBuffer (&data_buffer);
 #endif
-	RsslBuffer* buf;
-	RsslError rssl_err;
+	RsslBuffer buf = { static_cast<uint32_t> (*length), static_cast<char*> (data) };
 	RsslRet rc;
 
 	DCHECK (nullptr != login_msg);
-	VLOG(2) << prefix_ << "Sending MMT_LOGIN accepted.";
+	VLOG(2) << prefix_ << "Encoding MMT_LOGIN accepted.";
 
 /* Set the message model type. */
 	response.msgBase.domainType = RSSL_DMT_LOGIN;
@@ -592,8 +589,8 @@ kigoron::client_t::AcceptLogin (
 	response.flags = RSSL_RFMF_SOLICITED | RSSL_RFMF_REFRESH_COMPLETE;
 /* No payload. */
 	response.msgBase.containerType = RSSL_DT_NO_DATA;
-/* Set the login token. */
-	response.msgBase.streamId = login_token;
+/* Stream id replaced on submission. */
+	response.msgBase.streamId = 0;
 
 /* In RFA lingo an attribute object */
 	response.msgBase.msgKey.nameType = login_msg->msgBase.msgKey.nameType;
@@ -613,25 +610,14 @@ kigoron::client_t::AcceptLogin (
 /* Error code. */
 	response.state.code = RSSL_SC_NONE;
 
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
-	if (nullptr == buf) {
-		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
-			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
-			", \"sysError\": " << rssl_err.sysError << ""
-			", \"text\": \"" << rssl_err.text << "\""
-			", \"size\": " << MAX_MSG_SIZE << ""
-			", \"packedBuffer\": false"
-			" }";
-		return false;
-	}	
-	rc = rsslSetEncodeIteratorBuffer (&it, buf);
+	rc = rsslSetEncodeIteratorBuffer (&it, &buf);
 	if (RSSL_RET_SUCCESS != rc) {
 		LOG(ERROR) << prefix_ << "rsslSetEncodeIteratorBuffer: { "
 			  "\"returnCode\": " << static_cast<signed> (rc) << ""
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
 	rc = rsslSetEncodeIteratorRWFVersion (&it, rwf_major_version(), rwf_minor_version());
 	if (RSSL_RET_SUCCESS != rc) {
@@ -642,7 +628,7 @@ kigoron::client_t::AcceptLogin (
 			", \"majorVersion\": " << static_cast<unsigned> (rwf_major_version()) << ""
 			", \"minorVersion\": " << static_cast<unsigned> (rwf_minor_version()) << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 	rc = rsslEncodeMsgInit (&it, reinterpret_cast<RsslMsg*> (&response), MAX_MSG_SIZE);
 	if (RSSL_RET_ENCODE_MSG_KEY_OPAQUE != rc) {
@@ -652,7 +638,7 @@ kigoron::client_t::AcceptLogin (
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			", \"dataMaxSize\": " << MAX_MSG_SIZE << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 
 /* Encode attribute object after message instead of before as per RFA. */
@@ -665,7 +651,7 @@ kigoron::client_t::AcceptLogin (
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			", \"flags\": \"RSSL_ELF_HAS_STANDARD_DATA\""
 			" }";
-		goto cleanup;
+		return false;
 	}
 
 /* Images can be stale if process is left running without symbology update. */
@@ -715,7 +701,7 @@ kigoron::client_t::AcceptLogin (
 			", \"dataType\": \"" << rsslDataTypeToString (element_entry.dataType) << "\""
 			", \"providePermissionExpressions\": " << provide_permission_expressions << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* No permission profile. */
 	static const uint64_t provide_permission_profile = 0;
@@ -731,7 +717,7 @@ kigoron::client_t::AcceptLogin (
 			", \"dataType\": \"" << rsslDataTypeToString (element_entry.dataType) << "\""
 			", \"providePermissionProfile\": " << provide_permission_profile << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* Downstream application drives stream recovery. */
 	static const uint64_t multiple_open = 0;
@@ -747,7 +733,7 @@ kigoron::client_t::AcceptLogin (
 			", \"dataType\": \"" << rsslDataTypeToString (element_entry.dataType) << "\""
 			", \"singleOpen\": " << multiple_open << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* Batch requests not supported. */
 /* OMM posts not supported. */
@@ -762,7 +748,7 @@ kigoron::client_t::AcceptLogin (
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
 	rc = rsslEncodeMsgKeyAttribComplete (&it, RSSL_TRUE /* commit */);
 	if (RSSL_RET_SUCCESS != rc) {
@@ -771,7 +757,7 @@ kigoron::client_t::AcceptLogin (
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
 	if (RSSL_RET_SUCCESS != rsslEncodeMsgComplete (&it, RSSL_TRUE /* commit */)) {
 		LOG(ERROR) << prefix_ << "rsslEncodeMsgComplete: { "
@@ -779,10 +765,10 @@ kigoron::client_t::AcceptLogin (
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
-	buf->length = rsslGetEncodedBufferLength (&it);
-	LOG_IF(WARNING, 0 == buf->length) << prefix_ << "rsslGetEncodedBufferLength returned 0.";
+	buf.length = rsslGetEncodedBufferLength (&it);
+	LOG_IF(WARNING, 0 == buf.length) << prefix_ << "rsslGetEncodedBufferLength returned 0.";
 
 /* Message validation: must use ASSERT libraries for error description :/ */
 //	if (!rsslValidateMsg (reinterpret_cast<RsslMsg*> (&response))) {
@@ -794,21 +780,32 @@ kigoron::client_t::AcceptLogin (
 //		DVLOG(4) << prefix_ << "rsslValidateMsg succeeded.";
 //	}
 
-	if (!Submit (buf)) {
-		goto cleanup;
+	*length = static_cast<size_t> (buf.length);
+	return true;
+}
+
+/* Login responses echo the user name supplied by the client, encoded once
+ * per session and not shared.
+ */
+bool
+kigoron::client_t::AcceptLogin (
+	const RsslRequestMsg* login_msg,
+	int32_t login_token
+	)
+{
+	char data[MAX_MSG_SIZE];
+	size_t length = sizeof (data);
+	if (!WriteRawLogin (login_msg, data, &length)) {
+		cumulative_stats_[CLIENT_PC_MMT_LOGIN_EXCEPTION]++;
+		return false;
+	}
+	VLOG(2) << prefix_ << "Sending MMT_LOGIN accepted.";
+	if (!SendEncodedMessage (login_token, std::string (data, length))) {
+		cumulative_stats_[CLIENT_PC_MMT_LOGIN_EXCEPTION]++;
+		return false;
 	}
 	cumulative_stats_[CLIENT_PC_MMT_LOGIN_ACCEPTED]++;
 	return true;
-cleanup:
-	cumulative_stats_[CLIENT_PC_MMT_LOGIN_EXCEPTION]++;
-	if (RSSL_RET_SUCCESS != rsslReleaseBuffer (buf, &rssl_err)) {
-		LOG(WARNING) << prefix_ << "rsslReleaseBuffer: { "
-			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
-			", \"sysError\": " << rssl_err.sysError << ""
-			", \"text\": \"" << rssl_err.text << "\""
-			" }";
-	}
-	return false;
 }
 
 /* 7.4. Provide Source Directory Information.
@@ -864,6 +861,11 @@ kigoron::client_t::OnDirectoryRequest (
 	}
 }
 
+/* 10.3.5 Providing Data Dictionaries
+ * Dictionaries are sourced from local files and pre-encoded per RWF version,
+ * the response is a multi-part refresh with one fragment per RSSL buffer.
+ * Fragments are submitted whilst output is clear and resumed on flush.
+ */
 bool
 kigoron::client_t::OnDictionaryRequest (
 	RsslDecodeIterator* it,
@@ -874,15 +876,55 @@ kigoron::client_t::OnDictionaryRequest (
 	cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_REQUEST_RECEIVED]++;
 	VLOG(10) << prefix_ << "DictionaryRequest:" << *request_msg;
 
-/* Unsupported for this provider and declared so in the directory. */
-	return SendClose (
-		request_msg->msgBase.streamId,
-		request_msg->msgBase.msgKey.serviceId,
-		request_msg->msgBase.domainType,
-		chromium::StringPiece (request_msg->msgBase.msgKey.name.data, request_msg->msgBase.msgKey.name.length),
-		RSSL_RQMF_MSG_KEY_IN_UPDATES == (request_msg->flags & RSSL_RQMF_MSG_KEY_IN_UPDATES),
-		RSSL_STREAM_CLOSED, RSSL_SC_USAGE_ERROR, kErrorUnsupportedDictionary
-		);
+	const chromium::StringPiece dictionary_name (request_msg->msgBase.msgKey.name.data, request_msg->msgBase.msgKey.name.length);
+	const bool use_attribinfo_in_updates = RSSL_RQMF_MSG_KEY_IN_UPDATES == (request_msg->flags & RSSL_RQMF_MSG_KEY_IN_UPDATES);
+	const bool is_streaming_request = (RSSL_RQMF_STREAMING == (request_msg->flags & RSSL_RQMF_STREAMING));
+/* RDM 5.2.1 MsgKey.Filter defines verbosity, default to normal. */
+	const uint32_t verbosity = (RSSL_MKF_HAS_FILTER == (request_msg->msgBase.msgKey.flags & RSSL_MKF_HAS_FILTER))
+					? request_msg->msgBase.msgKey.filter : RDM_DICTIONARY_NORMAL;
+	const int32_t request_token = request_msg->msgBase.streamId;
+
+	if (!is_logged_in_) {
+		cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_REQUEST_REJECTED]++;
+		LOG(INFO) << prefix_ << "Closing dictionary request for client without accepted login.";
+		return SendClose (
+			request_token,
+			request_msg->msgBase.msgKey.serviceId,
+			request_msg->msgBase.domainType,
+			dictionary_name,
+			use_attribinfo_in_updates,
+			RSSL_STREAM_CLOSED, RSSL_SC_USAGE_ERROR, kErrorLoginRequired
+			);
+	}
+
+	const std::vector<std::string>* fragments = nullptr;
+	auto dictionary = provider_->dictionary();
+	if (nullptr != dictionary) {
+		fragments = dictionary->GetFragments (rwf_version(), provider_->service_id(), dictionary_t::GetType (dictionary_name), verbosity);
+	}
+/* Unavailable for this provider and declared so in the directory. */
+	if (nullptr == fragments || fragments->empty()) {
+		cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_REQUEST_REJECTED]++;
+		return SendClose (
+			request_token,
+			request_msg->msgBase.msgKey.serviceId,
+			request_msg->msgBase.domainType,
+			dictionary_name,
+			use_attribinfo_in_updates,
+			RSSL_STREAM_CLOSED, RSSL_SC_USAGE_ERROR, kErrorUnsupportedDictionary
+			);
+	}
+
+/* Reissue restarts the response from the first fragment. */
+	dictionary_streams_.remove_if ([request_token](const dictionary_stream_t& stream) {
+		return stream.token == request_token;
+	});
+	dictionary_stream_t stream = { request_token, static_cast<uint8_t> (is_streaming_request ? RSSL_STREAM_OPEN : RSSL_STREAM_NON_STREAMING), fragments, 0 };
+	dictionary_streams_.emplace_back (stream);
+/* Only start sending if not already waiting on output from earlier responses. */
+	if (dictionary_streams_.size() > 1)
+		return true;
+	return SendDictionaryFragments();
 }
 
 bool
@@ -970,7 +1012,7 @@ kigoron::client_t::SendReply (
 	if (0 == tokens_.erase (request_token))
 		return true;
 /* Copy into RSSL channel buffer pool */
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
+	buf = GetBuffer (MAX_MSG_SIZE, &rssl_err);
 	if (nullptr == buf) {
 		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
 			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
@@ -999,6 +1041,89 @@ cleanup:
 	return false;
 }
 
+/* An exhausted output pool is counted with write failures and, when the
+ * listener permits, grown once before giving up on the buffer.
+ */
+RsslBuffer*
+kigoron::client_t::GetBuffer (
+	size_t size,
+	RsslError* rssl_err
+	)
+{
+	RsslBuffer* buf = rsslGetBuffer (handle_, static_cast<uint32_t> (size), RSSL_FALSE /* not packed */, rssl_err);
+	if (nullptr == buf && RSSL_RET_BUFFER_NO_BUFFERS == rssl_err->rsslErrorId) {
+		provider_->cumulative_stats_[PROVIDER_PC_RSSL_WRITE_NO_BUFFERS]++;
+		if (provider_->GrowOutputBuffers (handle_))
+			buf = rsslGetBuffer (handle_, static_cast<uint32_t> (size), RSSL_FALSE /* not packed */, rssl_err);
+	}
+	return buf;
+}
+
+bool
+kigoron::client_t::OnFlush()
+{
+	if (dictionary_streams_.empty())
+		return true;
+	return SendDictionaryFragments();
+}
+
+/* Submit dictionary fragments until complete or output becomes pending.
+ */
+bool
+kigoron::client_t::SendDictionaryFragments()
+{
+	RsslBuffer* buf;
+	RsslError rssl_err;
+	bool is_exhausted = false;
+	while (!dictionary_streams_.empty()) {
+		auto& stream = dictionary_streams_.front();
+		while (stream.next_fragment < stream.fragments->size()) {
+			const std::string& fragment = stream.fragments->at (stream.next_fragment);
+			buf = GetBuffer (fragment.size(), &rssl_err);
+			if (nullptr == buf) {
+/* Output pool exhausted, resume when flushed. */
+				if (RSSL_RET_BUFFER_NO_BUFFERS == rssl_err.rsslErrorId)
+					return true;
+				LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
+					  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+					", \"sysError\": " << rssl_err.sysError << ""
+					", \"text\": \"" << rssl_err.text << "\""
+					", \"size\": " << fragment.size() << ""
+					", \"packedBuffer\": false"
+					" }";
+				return false;
+			}
+			CopyMemory (buf->data, fragment.data(), fragment.size());
+			buf->length = static_cast<uint32_t> (fragment.size());
+			if (!provider_t::ReplaceStreamId (rwf_version(), stream.token, stream.stream_state, buf->data, buf->length)) {
+				goto cleanup;
+			}
+			const int status = Submit (buf, &is_exhausted);
+/* Output pool exhausted, release and resend this fragment when flushed. */
+			if (!status) {
+				goto cleanup;
+			}
+			cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_FRAGMENT_SENT]++;
+			stream.next_fragment++;
+/* Enqueued behind pending output, yield until flushed. */
+			if (status < 0 && stream.next_fragment < stream.fragments->size())
+				return true;
+		}
+		cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_SENT]++;
+		dictionary_streams_.pop_front();
+	}
+	return true;
+cleanup:
+	if (RSSL_RET_SUCCESS != rsslReleaseBuffer (buf, &rssl_err)) {
+		LOG(WARNING) << prefix_ << "rsslReleaseBuffer: { "
+			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+			", \"sysError\": " << rssl_err.sysError << ""
+			", \"text\": \"" << rssl_err.text << "\""
+			" }";
+	}
+	return is_exhausted;
+}
+
 bool
 kigoron::client_t::OnCloseMsg (
 	RsslDecodeIterator* it,
@@ -1029,8 +1154,19 @@ kigoron::client_t::OnCloseMsg (
 		LOG(INFO) << prefix_ << "Directory closed.";
 		break;
 	case RSSL_DMT_DICTIONARY:
-/* dictionary is unsupported so a usage error. */
+/* drop any fragments not yet sent. */
 		cumulative_stats_[CLIENT_PC_MMT_DICTIONARY_CLOSE_RECEIVED]++;
+		{
+			const int32_t request_token = close_msg->msgBase.streamId;
+			const size_t count = dictionary_streams_.size();
+			dictionary_streams_.remove_if ([request_token](const dictionary_stream_t& stream) {
+				return stream.token == request_token;
+			});
+			if (count == dictionary_streams_.size())
+				cumulative_stats_[CLIENT_PC_CLOSE_MSGS_DISCARDED]++;
+		}
+		LOG(INFO) << prefix_ << "Dictionary closed.";
+		break;
 	case RSSL_DMT_MARKET_BY_ORDER:
 	case RSSL_DMT_MARKET_BY_PRICE:
 	case RSSL_DMT_MARKET_MAKER:
@@ -1098,10 +1234,11 @@ kigoron::client_t::OnItemClose (
  * responsibility of the Provider to encode and supply the directory.
  */
 bool
-kigoron::client_t::SendDirectoryRefresh (
-	int32_t request_token,
+kigoron::client_t::WriteRawDirectoryRefresh (
 	const char* service_name,
-	uint32_t filter_mask
+	uint32_t filter_mask,
+	void* data,
+	size_t* length
 	)
 {
 /* 7.5.9.1 Create a response message (4.2.2) */
@@ -1112,11 +1249,10 @@ kigoron::client_t::SendDirectoryRefresh (
 	RsslEncodeIterator it;
 	rsslClearEncodeIterator (&it);
 #endif
-	RsslBuffer* buf;
-	RsslError rssl_err;
+	RsslBuffer buf = { static_cast<uint32_t> (*length), static_cast<char*> (data) };
 	RsslRet rc;
 
-	VLOG(2) << prefix_ << "Sending directory refresh.";
+	VLOG(2) << prefix_ << "Encoding directory refresh.";
 
 /* 7.5.9.2 Set the message model type of the response. */
 	response.msgBase.domainType = RSSL_DMT_SOURCE;
@@ -1146,8 +1282,8 @@ kigoron::client_t::SendDirectoryRefresh (
 /* Attrib:	Not used */
 	response.msgBase.msgKey.flags = RSSL_MKF_HAS_FILTER;
 	response.flags |= RSSL_RFMF_HAS_MSG_KEY;
-/* set token */
-	response.msgBase.streamId = request_token;
+/* Stream id replaced on submission. */
+	response.msgBase.streamId = 0;
 
 /* Item interaction state. */
 	response.state.streamState = RSSL_STREAM_OPEN;
@@ -1156,27 +1292,15 @@ kigoron::client_t::SendDirectoryRefresh (
 /* Error code. */
 	response.state.code = RSSL_SC_NONE;
 
-/* pop buffer from RSSL memory pool */
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
-	if (nullptr == buf) {
-		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
-			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
-			", \"sysError\": " << rssl_err.sysError << ""
-			", \"text\": \"" << rssl_err.text << "\""
-			", \"size\": " << MAX_MSG_SIZE << ""
-			", \"packedBuffer\": false"
-			" }";
-		return false;
-	}
 /* tie buffer to RSSL write iterator */
-	rc = rsslSetEncodeIteratorBuffer (&it, buf);
+	rc = rsslSetEncodeIteratorBuffer (&it, &buf);
 	if (RSSL_RET_SUCCESS != rc) {
 		LOG(ERROR) << prefix_ << "rsslSetEncodeIteratorBuffer: { "
 			  "\"returnCode\": " << static_cast<signed> (rc) << ""
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* encode with clients preferred protocol version */
 	rc = rsslSetEncodeIteratorRWFVersion (&it, rwf_major_version(), rwf_minor_version());
@@ -1188,7 +1312,7 @@ kigoron::client_t::SendDirectoryRefresh (
 			", \"majorVersion\": " << static_cast<unsigned> (rwf_major_version()) << ""
 			", \"minorVersion\": " << static_cast<unsigned> (rwf_minor_version()) << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* start multi-step encoder */
 	rc = rsslEncodeMsgInit (&it, reinterpret_cast<RsslMsg*> (&response), MAX_MSG_SIZE);
@@ -1199,12 +1323,12 @@ kigoron::client_t::SendDirectoryRefresh (
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			", \"dataMaxSize\": " << MAX_MSG_SIZE << ""
 			" }";
-		goto cleanup;
+		return false;
 	}
 /* populate directory map */
 	if (!provider_->GetDirectoryMap (&it, service_name, filter_mask, RSSL_MPEA_ADD_ENTRY)) {
 		LOG(ERROR) << prefix_ << "GetDirectoryMap failed.";
-		goto cleanup;
+		return false;
 	}
 /* finalize multi-step encoder */
 	rc = rsslEncodeMsgComplete (&it, RSSL_TRUE /* commit */);
@@ -1214,27 +1338,92 @@ kigoron::client_t::SendDirectoryRefresh (
 			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
 			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
 			" }";
-		goto cleanup;
+		return false;
 	}
-	buf->length = rsslGetEncodedBufferLength (&it);
-	LOG_IF(WARNING, 0 == buf->length) << prefix_ << "rsslGetEncodedBufferLength returned 0.";
+	buf.length = rsslGetEncodedBufferLength (&it);
+	LOG_IF(WARNING, 0 == buf.length) << prefix_ << "rsslGetEncodedBufferLength returned 0.";
 
 /* Message validation. */
 	if (!rsslValidateMsg (reinterpret_cast<RsslMsg*> (&response))) {
 		cumulative_stats_[CLIENT_PC_MMT_DIRECTORY_MALFORMED]++;
 		LOG(ERROR) << prefix_ << "rsslValidateMsg failed.";
-		goto cleanup;
+		return false;
 	} else {
 		cumulative_stats_[CLIENT_PC_MMT_DIRECTORY_VALIDATED]++;
 		DVLOG(4) << prefix_ << "rsslValidateMsg succeeded.";
 	}
 
-	if (!Submit (buf)) {
+	*length = static_cast<size_t> (buf.length);
+	return true;
+}
+
+/* Directory refreshes are cached per RWF version, supported filters, whether
+ * the request names the service, and service state.  A name other than the
+ * provided service is refused before reaching the cache.
+ */
+bool
+kigoron::client_t::SendDirectoryRefresh (
+	int32_t request_token,
+	const char* service_name,
+	uint32_t filter_mask
+	)
+{
+	if (nullptr != service_name && 0 != provider_->service_name().compare (service_name)) {
+		LOG(ERROR) << prefix_ << "Service filter \"" << service_name << "\" does not match service directory \"" << provider_->service_name() << "\".";
+		return false;
+	}
+	filter_mask &= RDM_DIRECTORY_SERVICE_INFO_FILTER | RDM_DIRECTORY_SERVICE_STATE_FILTER | RDM_DIRECTORY_SERVICE_LOAD_FILTER;
+	const uint64_t key = (static_cast<uint64_t> (rwf_version()) << 32)
+			   | (static_cast<uint64_t> (filter_mask) << 2)
+			   | (nullptr == service_name ? 0 : 2)
+			   | (provider_->is_accepting_requests() ? 1 : 0);
+	const std::string* encoded = provider_->GetEncodedMessage (key);
+	if (nullptr == encoded) {
+		char data[MAX_MSG_SIZE];
+		size_t length = sizeof (data);
+		if (!WriteRawDirectoryRefresh (service_name, filter_mask, data, &length))
+			return false;
+		encoded = provider_->SetEncodedMessage (key, data, length);
+	}
+	VLOG(2) << prefix_ << "Sending directory refresh.";
+	if (!SendEncodedMessage (request_token, *encoded)) {
 		LOG(ERROR) << prefix_ << "Submit failed.";
-		goto cleanup;
+		return false;
 	}
 	cumulative_stats_[CLIENT_PC_MMT_DIRECTORY_SENT]++;
 	return true;
+}
+
+/* Copy a pre-encoded message into the channel buffer pool and set the stream
+ * id for this session.
+ */
+bool
+kigoron::client_t::SendEncodedMessage (
+	int32_t request_token,
+	const std::string& encoded
+	)
+{
+	RsslBuffer* buf;
+	RsslError rssl_err;
+	DCHECK(encoded.size() <= MAX_MSG_SIZE);
+	buf = GetBuffer (encoded.size(), &rssl_err);
+	if (nullptr == buf) {
+		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
+			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+			", \"sysError\": " << rssl_err.sysError << ""
+			", \"text\": \"" << rssl_err.text << "\""
+			", \"size\": " << encoded.size() << ""
+			", \"packedBuffer\": false"
+			" }";
+		return false;
+	}
+	CopyMemory (buf->data, encoded.data(), encoded.size());
+	buf->length = static_cast<uint32_t> (encoded.size());
+	if (!provider_t::ReplaceStreamId (rwf_version(), request_token, RSSL_STREAM_UNSPECIFIED, buf->data, buf->length))
+		goto cleanup;
+	if (!Submit (buf))
+		goto cleanup;
+	return true;
 cleanup:
 	if (RSSL_RET_SUCCESS != rsslReleaseBuffer (buf, &rssl_err)) {
 		LOG(WARNING) << prefix_ << "rsslReleaseBuffer: { "
@@ -1274,7 +1463,7 @@ kigoron::client_t::SendDirectoryUpdate (
 	response.flags |= RSSL_UPMF_HAS_MSG_KEY;
 	response.msgBase.streamId = directory_token_;
 
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
+	buf = GetBuffer (MAX_MSG_SIZE, &rssl_err);
 	if (nullptr == buf) {
 		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
 			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
@@ -1370,7 +1559,7 @@ kigoron::client_t::SendClose (
 {
 	RsslBuffer* buf;
 	RsslError rssl_err;
-	buf = rsslGetBuffer (handle_, MAX_MSG_SIZE, RSSL_FALSE /* not packed */, &rssl_err);
+	buf = GetBuffer (MAX_MSG_SIZE, &rssl_err);
 	if (nullptr == buf) {
 		LOG(ERROR) << prefix_ << "rsslGetBuffer: { "
 			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
@@ -1416,11 +1605,12 @@ cleanup:
  */
 int
 kigoron::client_t::Submit (
-	RsslBuffer* buf
+	RsslBuffer* buf,
+	bool* is_exhausted
 	)
 {
 	DCHECK(nullptr != buf);
-	const int status = provider_->Submit (handle_, buf);
+	const int status = provider_->Submit (handle_, buf, is_exhausted);
 	if (status) cumulative_stats_[CLIENT_PC_RSSL_MSGS_SENT]++;
 	return status;
 }
@@ -5,9 +5,13 @@
 #define CLIENT_HH_
 
 #include <cstdint>
+#include <list>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 /* Boost Posix Time */
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -20,11 +24,22 @@
 #include "upa.hh"
 #include "config.hh"
 #include "deleter.hh"
+#include "counters.hh"
+#include "histogram.hh"
+
+namespace chromium
+{
+	class JSONStreamWriter;
+}
 
 namespace kigoron
 {
 /* Performance Counters */
 	enum {
+		CLIENT_PC_BYTES_RECEIVED,
+		CLIENT_PC_UNCOMPRESSED_BYTES_RECEIVED,
+		CLIENT_PC_BYTES_SENT,
+		CLIENT_PC_UNCOMPRESSED_BYTES_SENT,
 		CLIENT_PC_RSSL_MSGS_SENT,
 		CLIENT_PC_RSSL_MSGS_RECEIVED,
 		CLIENT_PC_RSSL_MSGS_REJECTED,
@@ -47,6 +62,9 @@ namespace kigoron
 		CLIENT_PC_MMT_DIRECTORY_EXCEPTION,
 		CLIENT_PC_MMT_DIRECTORY_CLOSE_RECEIVED,
 		CLIENT_PC_MMT_DICTIONARY_REQUEST_RECEIVED,
+		CLIENT_PC_MMT_DICTIONARY_REQUEST_REJECTED,
+		CLIENT_PC_MMT_DICTIONARY_FRAGMENT_SENT,
+		CLIENT_PC_MMT_DICTIONARY_SENT,
 		CLIENT_PC_MMT_DICTIONARY_CLOSE_RECEIVED,
 		CLIENT_PC_ITEM_REQUEST_RECEIVED,
 		CLIENT_PC_ITEM_REQUEST_MALFORMED,
@@ -71,6 +89,12 @@ namespace kigoron
 	};
 
 	class provider_t;
+	struct client_snapshot_t;
+
+/* Latency per stage, shared with published provider snapshots. */
+	struct client_latency_t {
+		compact_histogram_t stages[LATENCY_STAGE_MAX];
+	};
 
 	class client_t :
 		public std::enable_shared_from_this<client_t>
@@ -82,6 +106,14 @@ namespace kigoron
 		    Delegate() {}
 
 		    virtual bool OnRequest (const boost::posix_time::ptime& now, uintptr_t handle, uint16_t rwf_version, int32_t token, uint16_t service_id, const std::string& item_name, bool use_attribinfo_in_updates) = 0;
+/* Symbol map entry for |key| as one JSON value, false without writing if unknown.  Safe from any thread. */
+		    virtual bool WriteSymbol (const std::string& key, chromium::JSONStreamWriter* writer) = 0;
+/* Symbol store entries in load order from |*cursor| until |output| reaches |max_size|, advancing the cursor.
+ * Returns false once every entry is written.  JSON entries are comma separated objects, CSV records follow
+ * a header row.  Safe from any thread.
+ */
+		    virtual bool WriteSymbols (size_t* cursor, size_t max_size, std::string* json) = 0;
+		    virtual bool WriteSymbolsCsv (size_t* cursor, size_t max_size, std::string* csv) = 0;
 /* TBD */
 //		    virtual bool OnCancel (uintptr_t handle, uint16_t rwf_version, int32_t token, uint16_t service_id, const std::string& item_name, bool use_attribinfo_in_updates) = 0;
 
@@ -97,7 +129,13 @@ namespace kigoron
 
 		bool OnSourceDirectoryUpdate();
 		bool SendReply (int32_t token, const void* data, size_t length);
+/* Output flushed, resume pending multi-part responses. */
+		bool OnFlush();
 
+/* Provider unique session id, monotonic per process. */
+		uint64_t id() const {
+			return id_;
+		}
 /* RSSL client socket */
 		RsslChannel*const handle() const {
 			return handle_;
@@ -111,6 +149,16 @@ namespace kigoron
 		uint16_t rwf_version() const {
 			return (rwf_major_version() * 256) + rwf_minor_version();
 		}
+/* Uncompressed to wire bytes, 1.0 without compression or before traffic. */
+		double receive_compression_ratio() const {
+			return compression_ratio (cumulative_stats_.value (CLIENT_PC_UNCOMPRESSED_BYTES_RECEIVED), cumulative_stats_.value (CLIENT_PC_BYTES_RECEIVED));
+		}
+		double send_compression_ratio() const {
+			return compression_ratio (cumulative_stats_.value (CLIENT_PC_UNCOMPRESSED_BYTES_SENT), cumulative_stats_.value (CLIENT_PC_BYTES_SENT));
+		}
+		static double compression_ratio (uint64_t uncompressed_bytes, uint64_t bytes) {
+			return (0 == bytes || 0 == uncompressed_bytes) ? 1.0 : static_cast<double> (uncompressed_bytes) / static_cast<double> (bytes);
+		}
 		const std::unordered_set<int32_t>& tokens() const {
 			return tokens_;
 		}
@@ -129,11 +177,16 @@ namespace kigoron
 
 		bool RejectLogin (const RsslRequestMsg* msg, int32_t login_token);
 		bool AcceptLogin (const RsslRequestMsg* msg, int32_t login_token);
+		bool WriteRawLogin (const RsslRequestMsg* msg, void* data, size_t* length);
 
 		bool SendDirectoryRefresh (int32_t token, const char* service_name, uint32_t filter_mask);
+		bool WriteRawDirectoryRefresh (const char* service_name, uint32_t filter_mask, void* data, size_t* length);
+		bool SendEncodedMessage (int32_t token, const std::string& encoded);
 		bool SendDirectoryUpdate (int32_t token, const char* service_name);
+		bool SendDictionaryFragments();
 		bool SendClose (int32_t token, uint16_t service_id, uint8_t model_type, const chromium::StringPiece& item_name, bool use_attribinfo_in_updates, uint8_t stream_state, uint8_t status_code, const chromium::StringPiece& status_text);
-		int Submit (RsslBuffer* buf);
+		int Submit (RsslBuffer* buf, bool* is_exhausted = nullptr);
+		RsslBuffer* GetBuffer (size_t size, RsslError* rssl_err);
 
 		const boost::posix_time::ptime& NextPing() const {
 			return next_ping_;
@@ -161,16 +214,20 @@ namespace kigoron
 		Delegate* delegate_;
 
 /* unique id per connection. */
+		uint64_t id_;
 		std::string prefix_;
 
-/* client details. */
-		std::string address_;
-		std::string name_;
+/* client details, shared with published snapshots. */
+		std::shared_ptr<const std::string> address_;
+		std::shared_ptr<const std::string> name_;
 
 /* UPA socket. */
 		RsslChannel* handle_;
 /* Pending messages to flush. */
 		unsigned pending_count_;
+/* Channel state as of activation or the last output pool change. */
+		bool has_channel_info_;
+		RsslChannelInfo channel_info_;
 
 /* Watchlist of all items. */
 		std::unordered_set<int32_t> tokens_;
@@ -178,6 +235,14 @@ namespace kigoron
 		bool is_logged_in_;
 		int32_t directory_token_;
 		int32_t login_token_;
+/* Dictionary responses in progress, one fragment per RSSL buffer. */
+		struct dictionary_stream_t {
+			int32_t token;
+			uint8_t stream_state;
+			const std::vector<std::string>* fragments;
+			size_t next_fragment;
+		};
+		std::list<dictionary_stream_t> dictionary_streams_;
 /* RSSL keepalive state. */
 		boost::posix_time::ptime next_ping_;
 		boost::posix_time::ptime next_pong_;
@@ -187,8 +252,17 @@ namespace kigoron
 
 /** Performance Counters **/
 		boost::posix_time::ptime creation_time_, last_activity_;
-		uint32_t cumulative_stats_[CLIENT_PC_MAX];
-		uint32_t snap_stats_[CLIENT_PC_MAX];
+		local_counters_t<CLIENT_PC_MAX> cumulative_stats_;
+		counters_snapshot_t<CLIENT_PC_MAX> snap_stats_, previous_snap_stats_;
+/* Latency per stage, and receipt time and domain of each response awaiting
+ * flush, bounded by the channel output buffer pool.
+ */
+		std::shared_ptr<client_latency_t> latency_;
+		std::vector<std::pair<uint64_t, unsigned>> pending_receipts_;
+/* Last published session state, reused by the provider until the session
+ * changes.
+ */
+		std::shared_ptr<const client_snapshot_t> view_;
 
 #ifdef KIGORONMIB_H
 		friend Netsnmp_Next_Data_Point kigoronClientTable_get_next_data_point;
@@ -6,25 +6,46 @@
 static const char* kAppName = "Kigoron";
 static const char* kDefaultRsslPort = "14002";
 static const char* kVendorName = "Thomson Reuters";
+static const unsigned kDefaultHttpPort = 7580;
 
-kigoron::config_t::config_t() :
+kigoron::listener_config_t::listener_config_t() :
 /* default values */
-	service_name ("NOCACHE_VTA"),
+	name ("default"),
 	rssl_port ("24002"),
 #ifdef _WIN32
-	send_buffer_size ("65535"),
-	recv_buffer_size ("65535"),
+	send_buffer_size (65535),
+	recv_buffer_size (65535),
 #else
-	send_buffer_size (""),
-	recv_buffer_size (""),
+	send_buffer_size (0),
+	recv_buffer_size (0),
 #endif
+	guaranteed_output_buffers (0),
+	num_input_buffers (0),
+	max_output_buffers (0),
+	output_buffer_limit (0),
+	session_capacity (8),
+	http_port (0)
+{
+}
+
+kigoron::config_t::config_t() :
+/* default values */
+	service_name ("NOCACHE_VTA"),
+	listeners (1),
+	compression_type ("none"),
+	compression_level (5),
+	compression_threshold (0),
 	application_name (kAppName),
 	vendor_name (kVendorName),
-	session_capacity (8),
 	open_window (1000),
-	max_age ("720:00:00")
+	max_age ("720:00:00"),
+	field_dictionary_path ("RDMFieldDictionary"),
+	enum_type_dictionary_path ("enumtype.def"),
+	flight_recorder_path ("Kigoron.flight"),
+	metrics_per_client (false)
 {
 /* C++11 initializer lists not supported in MSVC2010 */
+	listeners.front().http_port = kDefaultHttpPort;
 }
 
 /* eof */
@@ -13,6 +13,38 @@
 namespace kigoron
 {
 
+//  One RSSL listening port served by its own reactor thread, such that bulk
+//  snapshot clients cannot queue ahead of latency sensitive clients.
+	struct listener_config_t
+	{
+		listener_config_t();
+
+//  Label for logging and the flight recorder file, e.g. bulk, realtime.
+		std::string name;
+
+//  TREP-RT RSSL port, e.g. 14002, 14003.
+		std::string rssl_port;
+
+//  TCP buffer sizes in bytes, applied on bind and accept, zero for the
+//  system default.
+		unsigned send_buffer_size;
+		unsigned recv_buffer_size;
+
+//  RSSL channel buffer pools, zero for the UPA default.
+		unsigned guaranteed_output_buffers;
+		unsigned num_input_buffers;
+		unsigned max_output_buffers;
+
+//  Ceiling for growing a channel output pool when exhausted, zero disables.
+		unsigned output_buffer_limit;
+
+//  Client session capacity.
+		size_t session_capacity;
+
+//  Embedded HTTP server port, zero for none.
+		unsigned http_port;
+	};
+
 	struct config_t
 	{
 		config_t();
@@ -20,12 +52,17 @@ namespace kigoron
 //  TREP-RT service name, e.g. IDN_RDF, hEDD, ELEKTRON_DD.
 		std::string service_name;
 
-//  TREP-RT RSSL port, e.g. 14002, 14003.
-		std::string rssl_port;
+//  RSSL listeners, at least one.
+		std::vector<listener_config_t> listeners;
+
+//  Transport compression offered to clients: none, zlib, lz4.
+		std::string compression_type;
 
-//  TCP buffer sizes.
-		std::string send_buffer_size;
-		std::string recv_buffer_size;
+//  Compression level 0-9 for zlib.
+		unsigned compression_level;
+
+//  Minimum message size in bytes before compression is applied, zero for default.
+		unsigned compression_threshold;
 
 //  Name to present for infrastructure amusement.
 		std::string application_name;
@@ -33,9 +70,6 @@ namespace kigoron
 //  RSSL vendor name presented in directory.
 		std::string vendor_name;
 
-//  Client session capacity.
-		size_t session_capacity;
-
 //  Maximum number of requests to be enqueued for service.
 		size_t open_window;
 
@@ -44,22 +78,58 @@ namespace kigoron
 
 //  Maximum age of symbols before tagging suspect.
 		std::string max_age;
+
+//  RDM field dictionary, e.g. RDMFieldDictionary.
+		std::string field_dictionary_path;
+
+//  RDM enumerated type dictionary, e.g. enumtype.def.
+		std::string enum_type_dictionary_path;
+
+//  Flight recorder dump file written on request, one per listener with the
+//  listener name appended after the first.
+		std::string flight_recorder_path;
+
+//  Export client counters per session, one series per client.
+		bool metrics_per_client;
 	};
 
+	inline
+	std::ostream& operator<< (std::ostream& o, const listener_config_t& listener) {
+		o << "{ "
+			  "\"name\": \"" << listener.name << "\""
+			", \"rssl_port\": \"" << listener.rssl_port << "\""
+			", \"send_buffer_size\": " << listener.send_buffer_size << ""
+			", \"recv_buffer_size\": " << listener.recv_buffer_size << ""
+			", \"guaranteed_output_buffers\": " << listener.guaranteed_output_buffers << ""
+			", \"num_input_buffers\": " << listener.num_input_buffers << ""
+			", \"max_output_buffers\": " << listener.max_output_buffers << ""
+			", \"output_buffer_limit\": " << listener.output_buffer_limit << ""
+			", \"session_capacity\": " << listener.session_capacity << ""
+			", \"http_port\": " << listener.http_port << ""
+			" }";
+		return o;
+	}
+
 	inline
 	std::ostream& operator<< (std::ostream& o, const config_t& config) {
 		std::ostringstream ss;
+		for (size_t i = 0; i < config.listeners.size(); ++i)
+			ss << (0 == i ? "" : ", ") << config.listeners[i];
 		o << "config_t: { "
 			  "\"service_name\": \"" << config.service_name << "\""
-			", \"rssl_port\": \"" << config.rssl_port << "\""
-			", \"send_buffer_size\": \"" << config.send_buffer_size << "\""
-			", \"recv_buffer_size\": \"" << config.recv_buffer_size << "\""
+			", \"listeners\": [ " << ss.str() << " ]"
+			", \"compression_type\": \"" << config.compression_type << "\""
+			", \"compression_level\": " << config.compression_level << ""
+			", \"compression_threshold\": " << config.compression_threshold << ""
 			", \"application_name\": \"" << config.application_name << "\""
 			", \"vendor_name\": \"" << config.vendor_name << "\""
-			", \"session_capacity\": " << config.session_capacity << ""
 			", \"open_window\": " << config.open_window << ""
 			", \"symbol_path\": \"" << config.symbol_path << "\""
 			", \"max_age\": \"" << config.max_age << "\""
+			", \"field_dictionary_path\": \"" << config.field_dictionary_path << "\""
+			", \"enum_type_dictionary_path\": \"" << config.enum_type_dictionary_path << "\""
+			", \"flight_recorder_path\": \"" << config.flight_recorder_path << "\""
+			", \"metrics_per_client\": " << (config.metrics_per_client ? "true" : "false") << ""
 			" }";
 		return o;
 	}
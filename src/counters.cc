@@ -0,0 +1,25 @@
+/* Per-thread counter shard assignment.
+ */
+
+#include "counters.hh"
+
+namespace {
+
+boost::atomic<unsigned> next_shard (0);
+
+}  // namespace anon
+
+__declspec(thread) unsigned kigoron::counters::current_shard = 0;
+
+/* Threads are assigned shards round-robin, beyond kShardCount threads share
+ * shards and rely on the atomic increment.
+ */
+unsigned
+kigoron::counters::AssignShard()
+{
+	const unsigned shard = next_shard.fetch_add (1, boost::memory_order_relaxed) % kShardCount;
+	current_shard = shard + 1;
+	return shard;
+}
+
+/* eof */
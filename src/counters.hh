@@ -0,0 +1,192 @@
+/* 64-bit performance counters sharded per thread.
+ *
+ * Each thread increments its own shard with relaxed atomics, shards are
+ * padded apart by a cache line so concurrent reactors do not false share.
+ * Readers sum the shards without blocking writers, every counter is
+ * monotonic so a snapshot never goes backwards.  Counters only written by
+ * their owning reactor thread, i.e. per client, use a single unsharded set.
+ */
+
+#ifndef COUNTERS_HH_
+#define COUNTERS_HH_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/* Boost Posix Time */
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+namespace kigoron
+{
+	namespace counters
+	{
+		const unsigned kShardCount = 8;
+		const size_t kCacheLineSize = 64;
+
+/* One-based shard of the calling thread, zero until assigned. */
+		extern __declspec(thread) unsigned current_shard;
+		unsigned AssignShard();
+
+		inline unsigned CurrentShard() {
+			const unsigned shard = current_shard;
+			return (0 != shard) ? (shard - 1) : AssignShard();
+		}
+	}
+
+	template <size_t N>
+	class counters_snapshot_t
+	{
+	public:
+		counters_snapshot_t() {
+			for (size_t i = 0; i < N; ++i)
+				values_[i] = 0;
+		}
+
+		uint64_t operator[] (size_t i) const {
+			return values_[i];
+		}
+
+/* Change since an earlier snapshot of the same counters. */
+		uint64_t Delta (size_t i, const counters_snapshot_t& earlier) const {
+			return (values_[i] >= earlier.values_[i]) ? (values_[i] - earlier.values_[i]) : 0;
+		}
+
+/* Per second rate of change since an earlier snapshot. */
+		double Rate (size_t i, const counters_snapshot_t& earlier) const {
+			if (earlier.time_.is_not_a_date_time() || time_ <= earlier.time_)
+				return 0.0;
+			const double seconds = (time_ - earlier.time_).total_microseconds() / 1000000.0;
+			return Delta (i, earlier) / seconds;
+		}
+
+		const boost::posix_time::ptime& time() const {
+			return time_;
+		}
+
+/* True when no counter has moved, ignoring snapshot time. */
+		bool Equals (const counters_snapshot_t& other) const {
+			return std::equal (values_, values_ + N, other.values_);
+		}
+
+	private:
+		template <size_t> friend class counters_t;
+		template <size_t> friend class local_counters_t;
+
+		uint64_t values_[N];
+		boost::posix_time::ptime time_;
+	};
+
+	template <size_t N>
+	class counters_t
+	{
+	public:
+/* Increment-only handle on the calling thread's shard. */
+		class reference {
+		public:
+			explicit reference (boost::atomic<uint64_t>* value) : value_ (value) {}
+			void operator++() {
+				value_->fetch_add (1, boost::memory_order_relaxed);
+			}
+			void operator++ (int) {
+				value_->fetch_add (1, boost::memory_order_relaxed);
+			}
+			void operator+= (uint64_t n) {
+				value_->fetch_add (n, boost::memory_order_relaxed);
+			}
+		private:
+			boost::atomic<uint64_t>* value_;
+		};
+
+		counters_t() {
+			for (unsigned shard = 0; shard < counters::kShardCount; ++shard) {
+				for (size_t i = 0; i < N; ++i)
+					shards_[shard].values[i].store (0, boost::memory_order_relaxed);
+			}
+		}
+
+		reference operator[] (size_t i) {
+			return reference (&shards_[counters::CurrentShard()].values[i]);
+		}
+
+/* Sum over all shards. */
+		uint64_t value (size_t i) const {
+			uint64_t sum = 0;
+			for (unsigned shard = 0; shard < counters::kShardCount; ++shard)
+				sum += shards_[shard].values[i].load (boost::memory_order_relaxed);
+			return sum;
+		}
+
+		void Snapshot (counters_snapshot_t<N>* snapshot) const {
+			snapshot->time_ = boost::posix_time::microsec_clock::universal_time();
+			for (size_t i = 0; i < N; ++i)
+				snapshot->values_[i] = value (i);
+		}
+
+	private:
+/* Trailing padding keeps neighbouring shards off a shared line regardless
+ * of the alignment of the enclosing object.
+ */
+		struct shard_t {
+			boost::atomic<uint64_t> values[N];
+			char padding[counters::kCacheLineSize];
+		};
+		char padding_[counters::kCacheLineSize];
+		shard_t shards_[counters::kShardCount];
+	};
+
+/* Single writer variant, readers on other threads still see whole values. */
+	template <size_t N>
+	class local_counters_t
+	{
+	public:
+/* Increment-only handle, a plain read-modify-write as there is no other
+ * writer.
+ */
+		class reference {
+		public:
+			explicit reference (boost::atomic<uint64_t>* value) : value_ (value) {}
+			void operator++() {
+				*this += 1;
+			}
+			void operator++ (int) {
+				*this += 1;
+			}
+			void operator+= (uint64_t n) {
+				value_->store (value_->load (boost::memory_order_relaxed) + n, boost::memory_order_relaxed);
+			}
+		private:
+			boost::atomic<uint64_t>* value_;
+		};
+
+		local_counters_t() {
+			for (size_t i = 0; i < N; ++i)
+				values_[i].store (0, boost::memory_order_relaxed);
+		}
+
+		reference operator[] (size_t i) {
+			return reference (&values_[i]);
+		}
+
+		uint64_t value (size_t i) const {
+			return values_[i].load (boost::memory_order_relaxed);
+		}
+
+		void Snapshot (counters_snapshot_t<N>* snapshot) const {
+			snapshot->time_ = boost::posix_time::microsec_clock::universal_time();
+			for (size_t i = 0; i < N; ++i)
+				snapshot->values_[i] = value (i);
+		}
+
+	private:
+		boost::atomic<uint64_t> values_[N];
+	};
+
+} /* namespace kigoron */
+
+#endif /* COUNTERS_HH_ */
+
+/* eof */
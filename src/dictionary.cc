@@ -0,0 +1,354 @@
+/* RDM data dictionary, sourced from local files and served as multi-part
+ * refresh messages on the MMT_DICTIONARY domain.
+ */
+
+#include "dictionary.hh"
+
+#include "chromium/basictypes.hh"
+#include "chromium/files/file_util.hh"
+#include "chromium/logging.hh"
+#include "upaostream.hh"
+#include "provider.hh"
+
+/* Maximum encoded size of one dictionary refresh fragment, bounded below the
+ * default RSSL maxFragmentSize so each part is one transport buffer.
+ */
+#define MAX_FRAGMENT_SIZE	6000
+
+const chromium::StringPiece kigoron::kRdmFieldDictionaryName ("RWFFld");
+const chromium::StringPiece kigoron::kEnumTypeDictionaryName ("RWFEnum");
+
+namespace {
+
+/* RDM 5.2.1 verbosity levels, each a superset of the previous. */
+const uint32_t kVerbosities[] = {
+	RDM_DICTIONARY_INFO,
+	RDM_DICTIONARY_MINIMAL,
+	RDM_DICTIONARY_NORMAL,
+	RDM_DICTIONARY_VERBOSE
+};
+
+/* Greatest defined level contained in the requested filter. */
+uint32_t
+NormalizeVerbosity (
+	uint32_t verbosity
+	)
+{
+	uint32_t normalized = RDM_DICTIONARY_INFO;
+	for (size_t i = 0; i < arraysize (kVerbosities); ++i) {
+		if (kVerbosities[i] == (verbosity & kVerbosities[i]))
+			normalized = kVerbosities[i];
+	}
+	return normalized;
+}
+
+}  // namespace anon
+
+kigoron::dictionary_t::dictionary_t (
+	const kigoron::config_t& config
+	)
+	: config_ (config)
+	, has_field_definitions_ (false)
+	, has_enum_tables_ (false)
+{
+	rsslClearDataDictionary (&rdm_dictionary_);
+}
+
+kigoron::dictionary_t::~dictionary_t()
+{
+	rsslDeleteDataDictionary (&rdm_dictionary_);
+}
+
+/* Load field definitions and enumerated type tables, an absent file disables
+ * the dictionary domain but is not fatal.
+ */
+bool
+kigoron::dictionary_t::Initialize()
+{
+	char errtxt[256];
+	RsslBuffer error_text = { sizeof (errtxt), errtxt };
+
+	if (!config_.field_dictionary_path.empty()) {
+		if (!chromium::PathExists (config_.field_dictionary_path)) {
+			LOG(WARNING) << "Field dictionary '" << config_.field_dictionary_path << "' does not exist.";
+		} else if (RSSL_RET_SUCCESS != rsslLoadFieldDictionary (config_.field_dictionary_path.c_str(), &rdm_dictionary_, &error_text)) {
+			LOG(ERROR) << "rsslLoadFieldDictionary: { "
+				  "\"text\": \"" << std::string (error_text.data, error_text.length) << "\""
+				", \"path\": \"" << config_.field_dictionary_path << "\""
+				" }";
+			return false;
+		} else {
+			has_field_definitions_ = true;
+		}
+	}
+	error_text.length = sizeof (errtxt);
+	if (!config_.enum_type_dictionary_path.empty()) {
+		if (!chromium::PathExists (config_.enum_type_dictionary_path)) {
+			LOG(WARNING) << "Enumerated type dictionary '" << config_.enum_type_dictionary_path << "' does not exist.";
+		} else if (RSSL_RET_SUCCESS != rsslLoadEnumTypeDictionary (config_.enum_type_dictionary_path.c_str(), &rdm_dictionary_, &error_text)) {
+			LOG(ERROR) << "rsslLoadEnumTypeDictionary: { "
+				  "\"text\": \"" << std::string (error_text.data, error_text.length) << "\""
+				", \"path\": \"" << config_.enum_type_dictionary_path << "\""
+				" }";
+			return false;
+		} else {
+			has_enum_tables_ = true;
+		}
+	}
+
+	LOG_IF(WARNING, has_field_definitions_ != has_enum_tables_) << "Dictionary domain disabled, both field definitions and enumerated types are required.";
+	LOG(INFO) << "RDM dictionary: { "
+		  "\"fieldDefinitions\": " << (has_field_definitions_ ? "true" : "false") << ""
+		", \"enumTables\": " << (has_enum_tables_ ? "true" : "false") << ""
+		", \"numberOfEntries\": " << rdm_dictionary_.numberOfEntries << ""
+		", \"enumTableCount\": " << rdm_dictionary_.enumTableCount << ""
+		", \"minFid\": " << rdm_dictionary_.minFid << ""
+		", \"maxFid\": " << rdm_dictionary_.maxFid << ""
+		" }";
+
+	return true;
+}
+
+kigoron::dictionary_t::type_e
+kigoron::dictionary_t::GetType (
+	const chromium::StringPiece& name
+	)
+{
+	if (name == kRdmFieldDictionaryName)
+		return DICTIONARY_FIELD_DEFINITIONS;
+	if (name == kEnumTypeDictionaryName)
+		return DICTIONARY_ENUM_TABLES;
+	return DICTIONARY_UNKNOWN;
+}
+
+bool
+kigoron::dictionary_t::GetEnumValue (
+	RsslFieldId fid,
+	const chromium::StringPiece& display,
+	RsslEnum* value
+	)
+{
+	DCHECK(nullptr != value);
+	if (!has_field_definitions_ || !has_enum_tables_)
+		return false;
+	auto it = enum_index_.find (fid);
+	if (enum_index_.end() == it) {
+		boost::unordered_map<std::string, RsslEnum> index;
+		if (fid >= rdm_dictionary_.minFid && fid <= rdm_dictionary_.maxFid) {
+			const RsslDictionaryEntry* entry = rdm_dictionary_.entriesArray[fid];
+			if (nullptr != entry && nullptr != entry->pEnumTypeTable) {
+				const RsslEnumTypeTable* table = entry->pEnumTypeTable;
+				for (unsigned i = 0; i <= table->maxValue; ++i) {
+					const RsslEnumType* enum_type = table->enumTypes[i];
+					if (nullptr == enum_type || 0 == enum_type->display.length)
+						continue;
+/* Display values are fixed width, space padded. */
+					std::string key (enum_type->display.data, enum_type->display.length);
+					key.erase (key.find_last_not_of (' ') + 1);
+					if (!key.empty())
+						index.emplace (key, enum_type->value);
+				}
+			}
+		}
+		VLOG(2) << "Enumerated type index: { "
+			  "\"fieldId\": " << fid << ""
+			", \"displayValues\": " << index.size() << ""
+			" }";
+		it = enum_index_.emplace (fid, std::move (index)).first;
+	}
+	auto jt = it->second.find (display.as_string());
+	if (it->second.end() == jt)
+		return false;
+	*value = jt->second;
+	return true;
+}
+
+uint64_t
+kigoron::dictionary_t::fragments_key (
+	uint16_t rwf_version,
+	uint16_t service_id,
+	kigoron::dictionary_t::type_e type,
+	uint32_t verbosity
+	)
+{
+	return (static_cast<uint64_t> (rwf_version) << 48)
+	     | (static_cast<uint64_t> (service_id) << 32)
+	     | (static_cast<uint64_t> (type) << 16)
+	     | (verbosity & 0xffff);
+}
+
+/* Every minor version up to the native one may be negotiated by a consumer,
+ * repeated calls for the same service are no-ops.
+ */
+bool
+kigoron::dictionary_t::EncodeAll (
+	uint16_t service_id
+	)
+{
+	if (!is_loaded())
+		return true;
+	for (unsigned minor = 0; minor <= RSSL_RWF_MINOR_VERSION; ++minor) {
+		const uint16_t rwf_version = static_cast<uint16_t> ((RSSL_RWF_MAJOR_VERSION * 256) + minor);
+		for (int type = DICTIONARY_FIELD_DEFINITIONS; type < DICTIONARY_UNKNOWN; ++type) {
+			for (size_t i = 0; i < arraysize (kVerbosities); ++i) {
+				const uint64_t key = fragments_key (rwf_version, service_id, static_cast<type_e> (type), kVerbosities[i]);
+				if (fragments_.end() != fragments_.find (key))
+					continue;
+				std::vector<std::string> fragments;
+				if (!EncodeFragments (rwf_version, service_id, static_cast<type_e> (type), kVerbosities[i], &fragments))
+					return false;
+				VLOG(2) << "Encoded dictionary: { "
+					  "\"name\": \"" << (DICTIONARY_FIELD_DEFINITIONS == type ? kRdmFieldDictionaryName : kEnumTypeDictionaryName) << "\""
+					", \"majorVersion\": " << static_cast<unsigned> (provider_t::rwf_major_version (rwf_version)) << ""
+					", \"minorVersion\": " << static_cast<unsigned> (provider_t::rwf_minor_version (rwf_version)) << ""
+					", \"verbosity\": " << kVerbosities[i] << ""
+					", \"fragments\": " << fragments.size() << ""
+					" }";
+				fragments_.emplace (key, std::move (fragments));
+			}
+		}
+	}
+	return true;
+}
+
+/* Requested filters are reduced to a defined verbosity level. */
+const std::vector<std::string>*
+kigoron::dictionary_t::GetFragments (
+	uint16_t rwf_version,
+	uint16_t service_id,
+	kigoron::dictionary_t::type_e type,
+	uint32_t verbosity
+	) const
+{
+	if (!is_loaded() || DICTIONARY_UNKNOWN == type)
+		return nullptr;
+	auto it = fragments_.find (fragments_key (rwf_version, service_id, type, NormalizeVerbosity (verbosity)));
+	if (fragments_.end() == it)
+		return nullptr;
+	return &it->second;
+}
+
+/* 10.3.5 Providing Data Dictionaries
+ * Each fragment is a complete refresh message, the first clears the consumer
+ * cache and the last carries refresh complete.
+ */
+bool
+kigoron::dictionary_t::EncodeFragments (
+	uint16_t rwf_version,
+	uint16_t service_id,
+	kigoron::dictionary_t::type_e type,
+	uint32_t verbosity,
+	std::vector<std::string>* fragments
+	)
+{
+	const chromium::StringPiece& name = (DICTIONARY_FIELD_DEFINITIONS == type) ? kRdmFieldDictionaryName : kEnumTypeDictionaryName;
+	char errtxt[256];
+	RsslBuffer error_text = { sizeof (errtxt), errtxt };
+	int current_fid = (DICTIONARY_FIELD_DEFINITIONS == type) ? rdm_dictionary_.minFid : 0;
+	bool is_complete = false;
+	RsslRet rc;
+
+	DCHECK(nullptr != fragments);
+
+	while (!is_complete) {
+		RsslRefreshMsg response = RSSL_INIT_REFRESH_MSG;
+#ifndef NDEBUG
+		RsslEncodeIterator it = RSSL_INIT_ENCODE_ITERATOR;
+#else
+		RsslEncodeIterator it;
+		rsslClearEncodeIterator (&it);
+#endif
+		std::string fragment (MAX_FRAGMENT_SIZE, '\0');
+		RsslBuffer buf = { static_cast<uint32_t> (fragment.size()), &fragment[0] };
+
+		response.msgBase.domainType = RSSL_DMT_DICTIONARY;
+		response.msgBase.msgClass = RSSL_MC_REFRESH;
+		response.msgBase.containerType = RSSL_DT_SERIES;
+/* Placeholder, replaced per request. */
+		response.msgBase.streamId = 0;
+		response.flags = RSSL_RFMF_SOLICITED | RSSL_RFMF_HAS_MSG_KEY;
+		if (fragments->empty())
+			response.flags |= RSSL_RFMF_CLEAR_CACHE;
+
+		response.msgBase.msgKey.serviceId   = service_id;
+		response.msgBase.msgKey.name.data   = const_cast<char*> (name.data());
+		response.msgBase.msgKey.name.length = static_cast<uint32_t> (name.size());
+		response.msgBase.msgKey.filter      = verbosity;
+		response.msgBase.msgKey.flags = RSSL_MKF_HAS_SERVICE_ID | RSSL_MKF_HAS_NAME | RSSL_MKF_HAS_FILTER;
+
+		response.state.streamState = RSSL_STREAM_OPEN;
+		response.state.dataState = RSSL_DATA_OK;
+		response.state.code = RSSL_SC_NONE;
+
+		rc = rsslSetEncodeIteratorBuffer (&it, &buf);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslSetEncodeIteratorBuffer: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				" }";
+			return false;
+		}
+		rc = rsslSetEncodeIteratorRWFVersion (&it, provider_t::rwf_major_version (rwf_version), provider_t::rwf_minor_version (rwf_version));
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslSetEncodeIteratorRWFVersion: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				", \"majorVersion\": " << static_cast<unsigned> (provider_t::rwf_major_version (rwf_version)) << ""
+				", \"minorVersion\": " << static_cast<unsigned> (provider_t::rwf_minor_version (rwf_version)) << ""
+				" }";
+			return false;
+		}
+		rc = rsslEncodeMsgInit (&it, reinterpret_cast<RsslMsg*> (&response), /* maximum size */ 0);
+		if (RSSL_RET_ENCODE_CONTAINER != rc) {
+			LOG(ERROR) << "rsslEncodeMsgInit: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				" }";
+			return false;
+		}
+/* Encoders fill the buffer and return the next fid to resume from. */
+		if (DICTIONARY_FIELD_DEFINITIONS == type) {
+			rc = rsslEncodeFieldDictionary (&it, &rdm_dictionary_, &current_fid, static_cast<RDMDictionaryVerbosityValues> (verbosity), &error_text);
+		} else {
+			rc = rsslEncodeEnumTypeDictionaryAsMultiPart (&it, &rdm_dictionary_, &current_fid, static_cast<RDMDictionaryVerbosityValues> (verbosity), &error_text);
+		}
+		if (RSSL_RET_SUCCESS == rc) {
+			rc = rsslSetRefreshCompleteFlag (&it);
+			if (RSSL_RET_SUCCESS != rc) {
+				LOG(ERROR) << "rsslSetRefreshCompleteFlag: { "
+					  "\"returnCode\": " << static_cast<signed> (rc) << ""
+					", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+					", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+					" }";
+				return false;
+			}
+			is_complete = true;
+		} else if (RSSL_RET_DICT_PART_ENCODED != rc) {
+			LOG(ERROR) << (DICTIONARY_FIELD_DEFINITIONS == type ? "rsslEncodeFieldDictionary" : "rsslEncodeEnumTypeDictionaryAsMultiPart") << ": { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << std::string (error_text.data, error_text.length) << "\""
+				", \"currentFid\": " << current_fid << ""
+				", \"verbosity\": " << verbosity << ""
+				" }";
+			return false;
+		}
+		rc = rsslEncodeMsgComplete (&it, RSSL_TRUE /* commit */);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslEncodeMsgComplete: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				" }";
+			return false;
+		}
+		fragment.resize (rsslGetEncodedBufferLength (&it));
+		fragments->emplace_back (std::move (fragment));
+	}
+	return true;
+}
+
+/* eof */
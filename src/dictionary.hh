@@ -0,0 +1,96 @@
+/* RDM data dictionary, sourced from local files and served as multi-part
+ * refresh messages on the MMT_DICTIONARY domain.
+ */
+
+#ifndef DICTIONARY_HH_
+#define DICTIONARY_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+/* UPA 7.6 */
+#include <upa/upa.h>
+
+#include "chromium/debug/leak_tracker.hh"
+#include "chromium/strings/string_piece.hh"
+#include "config.hh"
+
+namespace kigoron
+{
+/* Reuters Wire Format nomenclature for RDM dictionary names. */
+	extern const chromium::StringPiece kRdmFieldDictionaryName;
+	extern const chromium::StringPiece kEnumTypeDictionaryName;
+
+	class dictionary_t
+	{
+	public:
+		enum type_e {
+			DICTIONARY_FIELD_DEFINITIONS,
+			DICTIONARY_ENUM_TABLES,
+			DICTIONARY_UNKNOWN
+		};
+
+		explicit dictionary_t (const config_t& config);
+		~dictionary_t();
+
+		bool Initialize();
+
+/* Encode both dictionaries for every served RWF version and verbosity, must
+ * complete before any reactor thread starts.
+ */
+		bool EncodeAll (uint16_t service_id);
+
+/* Encoded refresh fragments, in order, for the named dictionary.  Fragments
+ * carry a zero stream id, callers must replace the stream id before
+ * submission.  Lock free, returns nullptr if the dictionary is not available.
+ */
+		const std::vector<std::string>* GetFragments (uint16_t rwf_version, uint16_t service_id, type_e type, uint32_t verbosity) const;
+
+		static type_e GetType (const chromium::StringPiece& name);
+
+/* Reverse lookup of an enumerated type display value, e.g. "USD" for
+ * CURRENCY(15).  Not thread safe, indices are built on first use per fid.
+ */
+		bool GetEnumValue (RsslFieldId fid, const chromium::StringPiece& display, RsslEnum* value);
+
+		bool has_field_definitions() const {
+			return has_field_definitions_;
+		}
+		bool has_enum_tables() const {
+			return has_enum_tables_;
+		}
+		bool is_loaded() const {
+			return has_field_definitions_ && has_enum_tables_;
+		}
+		const RsslDataDictionary* rdm_dictionary() const {
+			return &rdm_dictionary_;
+		}
+
+	private:
+		static uint64_t fragments_key (uint16_t rwf_version, uint16_t service_id, type_e type, uint32_t verbosity);
+		bool EncodeFragments (uint16_t rwf_version, uint16_t service_id, type_e type, uint32_t verbosity, std::vector<std::string>* fragments);
+
+		const config_t& config_;
+
+		RsslDataDictionary rdm_dictionary_;
+		bool has_field_definitions_;
+		bool has_enum_tables_;
+
+/* Display value to enumeration per field. */
+		boost::unordered_map<RsslFieldId, boost::unordered_map<std::string, RsslEnum>> enum_index_;
+
+/* Pre-encoded fragments keyed by RWF version, service id, type and verbosity,
+ * immutable once reactors are running.
+ */
+		boost::unordered_map<uint64_t, std::vector<std::string>> fragments_;
+
+		chromium::debug::LeakTracker<dictionary_t> leak_tracker_;
+	};
+
+} /* namespace kigoron */
+
+#endif /* DICTIONARY_HH_ */
+
+/* eof */
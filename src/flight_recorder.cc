@@ -0,0 +1,175 @@
+/* Flight recorder of request processing events.
+ */
+
+#include "flight_recorder.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <windows.h>
+
+#include "chromium/logging.hh"
+#include "chromium/json/json_stream_writer.hh"
+
+namespace {
+
+/* Dump file header, little endian as written. */
+#pragma pack(push, 1)
+struct flight_header_t {
+	char magic[8];			/* "KIGFLT01" */
+	uint32_t record_size;
+	uint32_t record_count;
+	uint64_t tsc;			/* at dump */
+	double tsc_frequency;
+	int64_t unix_time;		/* seconds at dump */
+};
+#pragma pack(pop)
+
+const char kFlightMagic[8] = { 'K', 'I', 'G', 'F', 'L', 'T', '0', '1' };
+
+uint64_t QueryCounter()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter (&counter);
+	return static_cast<uint64_t> (counter.QuadPart);
+}
+
+}  // namespace anon
+
+kigoron::flight_recorder_t::flight_recorder_t()
+	: head_ (0)
+	, origin_tsc_ (__rdtsc())
+	, origin_qpc_ (QueryCounter())
+{
+	memset (events_, 0, sizeof (events_));
+}
+
+/* Slots are valid if not overwritten whilst copying, the writer may be
+ * mid-way through the slot for the sequence at the second read of head.
+ */
+void
+kigoron::flight_recorder_t::Snapshot (
+	size_t limit,
+	std::vector<flight_event_t>* events
+	) const
+{
+	DCHECK(nullptr != events);
+	const uint64_t head = head_.load (boost::memory_order_acquire);
+	const uint64_t available = (head < kCapacity) ? head : kCapacity;
+	const uint64_t count = (limit < available) ? limit : available;
+	const uint64_t first = head - count;
+	events->resize (static_cast<size_t> (count));
+	for (uint64_t sequence = first; sequence < head; ++sequence)
+		(*events)[static_cast<size_t> (sequence - first)] = events_[sequence & (kCapacity - 1)];
+	const uint64_t tail = head_.load (boost::memory_order_acquire);
+	if (tail + 1 > first + kCapacity) {
+		const uint64_t overwritten = (tail + 1) - (first + kCapacity);
+		events->erase (events->begin(), events->begin() + static_cast<size_t> ((overwritten < count) ? overwritten : count));
+	}
+}
+
+double
+kigoron::flight_recorder_t::tsc_frequency() const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency (&frequency);
+	const uint64_t tsc = __rdtsc();
+	const uint64_t qpc = QueryCounter();
+	if (qpc <= origin_qpc_ || tsc <= origin_tsc_)
+		return 0.0;
+	const double seconds = static_cast<double> (qpc - origin_qpc_) / static_cast<double> (frequency.QuadPart);
+	return static_cast<double> (tsc - origin_tsc_) / seconds;
+}
+
+void
+kigoron::flight_recorder_t::WriteJson (
+	size_t limit,
+	chromium::JSONStreamWriter* writer
+	) const
+{
+	std::vector<flight_event_t> events;
+	Snapshot (limit, &events);
+	const uint64_t now = __rdtsc();
+	const double frequency = tsc_frequency();
+	writer->BeginObject();
+	writer->Key ("tsc");
+	writer->Uint64 (now);
+	writer->Key ("tsc_frequency");
+	writer->Double (frequency);
+	writer->Key ("events");
+	writer->BeginArray();
+	for (auto it = events.begin(); it != events.end(); ++it) {
+		writer->BeginObject();
+		writer->Key ("tsc");
+		writer->Uint64 (it->tsc);
+		if (frequency > 0.0 && now >= it->tsc) {
+			writer->Key ("age_us");
+			writer->Double (static_cast<double> (now - it->tsc) * 1000000.0 / frequency);
+		}
+		writer->Key ("type");
+		writer->String (flight_event_string (static_cast<flight_event_e> (it->type)));
+		writer->Key ("channel");
+		writer->Uint64 (it->channel);
+		writer->Key ("stream_id");
+		writer->Int (it->stream_id);
+		writer->EndObject();
+	}
+	writer->EndArray();
+	writer->EndObject();
+}
+
+bool
+kigoron::flight_recorder_t::DumpToFile (
+	const std::string& path
+	) const
+{
+	std::vector<flight_event_t> events;
+	Snapshot (kCapacity, &events);
+
+	flight_header_t header;
+	memcpy (header.magic, kFlightMagic, sizeof (header.magic));
+	header.record_size = sizeof (flight_event_t);
+	header.record_count = static_cast<uint32_t> (events.size());
+	header.tsc = __rdtsc();
+	header.tsc_frequency = tsc_frequency();
+	header.unix_time = static_cast<int64_t> (time (nullptr));
+
+	FILE* fp = fopen (path.c_str(), "wb");
+	if (nullptr == fp) {
+		LOG(ERROR) << "Cannot open flight recorder dump file \"" << path << "\".";
+		return false;
+	}
+	bool is_written = (1 == fwrite (&header, sizeof (header), 1, fp));
+	if (is_written && !events.empty())
+		is_written = (events.size() == fwrite (events.data(), sizeof (flight_event_t), events.size(), fp));
+	fclose (fp);
+	if (!is_written) {
+		LOG(ERROR) << "Failed writing flight recorder dump file \"" << path << "\".";
+		return false;
+	}
+	LOG(INFO) << "Flight recorder dumped " << events.size() << " events to \"" << path << "\".";
+	return true;
+}
+
+const char*
+kigoron::flight_event_string (
+	flight_event_e type
+	)
+{
+	switch (type) {
+	case FLIGHT_EVENT_RECEIVE:	return "receive";
+	case FLIGHT_EVENT_REQUEST:	return "request";
+	case FLIGHT_EVENT_LOOKUP_HIT:	return "lookup_hit";
+	case FLIGHT_EVENT_LOOKUP_MISS:	return "lookup_miss";
+	case FLIGHT_EVENT_ENCODE:	return "encode";
+	case FLIGHT_EVENT_WRITE:	return "write";
+	case FLIGHT_EVENT_FLUSH:	return "flush";
+	case FLIGHT_EVENT_CLOSE:	return "close";
+	case FLIGHT_EVENT_PING:		return "ping";
+	case FLIGHT_EVENT_PONG:		return "pong";
+	default:			return "unknown";
+	}
+}
+
+/* eof */
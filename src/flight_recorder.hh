@@ -0,0 +1,101 @@
+/* Flight recorder of request processing events.
+ *
+ * A fixed-size ring of compact binary events per reactor, always enabled.
+ * Recording is a handful of stores by the owning reactor thread, readers on
+ * any thread copy the ring without locks and discard slots overwritten
+ * during the copy.
+ */
+
+#ifndef FLIGHT_RECORDER_HH_
+#define FLIGHT_RECORDER_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <intrin.h>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+namespace chromium
+{
+	class JSONStreamWriter;
+}
+
+namespace kigoron
+{
+	enum flight_event_e {
+		FLIGHT_EVENT_RECEIVE,
+		FLIGHT_EVENT_REQUEST,
+		FLIGHT_EVENT_LOOKUP_HIT,
+		FLIGHT_EVENT_LOOKUP_MISS,
+		FLIGHT_EVENT_ENCODE,
+		FLIGHT_EVENT_WRITE,
+		FLIGHT_EVENT_FLUSH,
+		FLIGHT_EVENT_CLOSE,
+		FLIGHT_EVENT_PING,
+		FLIGHT_EVENT_PONG,
+/* marker */
+		FLIGHT_EVENT_MAX
+	};
+
+	const char* flight_event_string (flight_event_e type);
+
+/* 24 bytes, also the on-disk record layout. */
+#pragma pack(push, 1)
+	struct flight_event_t {
+		uint64_t tsc;
+		uint64_t channel;	/* RSSL socket id */
+		int32_t stream_id;
+		uint8_t type;
+		uint8_t reserved[3];
+	};
+#pragma pack(pop)
+
+	class flight_recorder_t
+	{
+	public:
+/* 64k events, ~1.5MB per reactor. */
+		static const size_t kCapacity = 1u << 16;
+
+		flight_recorder_t();
+
+/* Single writer: only the owning reactor thread may record. */
+		void Record (flight_event_e type, uint64_t channel, int32_t stream_id) {
+			const uint64_t sequence = head_.load (boost::memory_order_relaxed);
+			flight_event_t& event = events_[sequence & (kCapacity - 1)];
+			event.tsc = __rdtsc();
+			event.channel = channel;
+			event.stream_id = stream_id;
+			event.type = static_cast<uint8_t> (type);
+			head_.store (sequence + 1, boost::memory_order_release);
+		}
+
+/* Copies up to |limit| most recent events, oldest first. */
+		void Snapshot (size_t limit, std::vector<flight_event_t>* events) const;
+
+/* Writes an object of the most recent events with ages derived from the
+ * estimated TSC rate.
+ */
+		void WriteJson (size_t limit, chromium::JSONStreamWriter* writer) const;
+
+/* Binary dump: header followed by events oldest first. */
+		bool DumpToFile (const std::string& path) const;
+
+/* Ticks per second, estimated against the performance counter since creation. */
+		double tsc_frequency() const;
+
+	private:
+		boost::atomic<uint64_t> head_;
+		uint64_t origin_tsc_;
+		uint64_t origin_qpc_;
+		flight_event_t events_[kCapacity];
+	};
+
+} /* namespace kigoron */
+
+#endif /* FLIGHT_RECORDER_HH_ */
+
+/* eof */
@@ -0,0 +1,238 @@
+/* Log-linear latency histogram.
+ */
+
+#include "histogram.hh"
+
+#include <cmath>
+#include <limits>
+
+#include <windows.h>
+#include <intrin.h>
+
+#include "chromium/logging.hh"
+#include "chromium/json/json_stream_writer.hh"
+
+namespace {
+
+/* Counter frequency is fixed at system boot. */
+uint64_t QueryFrequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency (&frequency);
+	return static_cast<uint64_t> (frequency.QuadPart);
+}
+
+const uint64_t kQpcFrequency = QueryFrequency();
+
+unsigned FloorLog2 (uint64_t value)
+{
+	unsigned long index;
+	_BitScanReverse64 (&index, value);
+	return static_cast<unsigned> (index);
+}
+
+}  // namespace anon
+
+uint64_t
+kigoron::latency::Now()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter (&now);
+	return static_cast<uint64_t> (now.QuadPart);
+}
+
+uint64_t
+kigoron::latency::ToNanoseconds (
+	uint64_t ticks
+	)
+{
+/* Split to avoid overflow of the intermediate product. */
+	const uint64_t seconds = ticks / kQpcFrequency;
+	const uint64_t remainder = ticks % kQpcFrequency;
+	return (seconds * 1000000000) + ((remainder * 1000000000) / kQpcFrequency);
+}
+
+unsigned
+kigoron::histogram::BucketCount (
+	unsigned sub_bucket_bits
+	)
+{
+	const unsigned sub_bucket_half_count = 1u << (sub_bucket_bits - 1);
+	return (64 - sub_bucket_bits + 1) * sub_bucket_half_count + sub_bucket_half_count;
+}
+
+/* Values below the sub-bucket count map linearly, above that each power of two
+ * is split into the upper half of the sub-buckets.
+ */
+unsigned
+kigoron::histogram::IndexOf (
+	unsigned sub_bucket_bits,
+	uint64_t value
+	)
+{
+	if (value < (1u << sub_bucket_bits))
+		return static_cast<unsigned> (value);
+	const unsigned shift = FloorLog2 (value) - (sub_bucket_bits - 1);
+	return (shift << (sub_bucket_bits - 1)) + static_cast<unsigned> (value >> shift);
+}
+
+uint64_t
+kigoron::histogram::LowestValueAt (
+	unsigned sub_bucket_bits,
+	unsigned index
+	)
+{
+	if (index < (1u << sub_bucket_bits))
+		return index;
+	const unsigned shift = (index >> (sub_bucket_bits - 1)) - 1;
+	const uint64_t sub_bucket = index - (shift << (sub_bucket_bits - 1));
+	return sub_bucket << shift;
+}
+
+uint64_t
+kigoron::histogram::HighestValueAt (
+	unsigned sub_bucket_bits,
+	unsigned index
+	)
+{
+	if (index + 1 >= BucketCount (sub_bucket_bits))
+		return std::numeric_limits<uint64_t>::max();
+	return LowestValueAt (sub_bucket_bits, index + 1) - 1;
+}
+
+kigoron::histogram_snapshot_t::histogram_snapshot_t()
+	: sub_bucket_bits_ (0)
+	, total_count_ (0)
+	, total_sum_ (0)
+{
+}
+
+/* Counts are read individually, a snapshot concurrent with recording may
+ * include a value in the sum but not the counts or vice versa.
+ */
+void
+kigoron::histogram_snapshot_t::Load (
+	unsigned sub_bucket_bits,
+	const boost::atomic<uint64_t>* counts,
+	unsigned bucket_count,
+	const boost::atomic<uint64_t>& total_sum
+	)
+{
+	sub_bucket_bits_ = sub_bucket_bits;
+	counts_.resize (bucket_count);
+	total_count_ = 0;
+	for (unsigned i = 0; i < bucket_count; ++i) {
+		const uint64_t count = counts[i].load (boost::memory_order_relaxed);
+		counts_[i] = count;
+		total_count_ += count;
+	}
+	total_sum_ = total_sum.load (boost::memory_order_relaxed);
+}
+
+void
+kigoron::histogram_snapshot_t::Subtract (
+	const histogram_snapshot_t& earlier
+	)
+{
+	if (earlier.sub_bucket_bits_ != sub_bucket_bits_ || earlier.counts_.size() != counts_.size())
+		return;
+	total_count_ = 0;
+	for (size_t i = 0; i < counts_.size(); ++i) {
+		counts_[i] = (counts_[i] >= earlier.counts_[i]) ? (counts_[i] - earlier.counts_[i]) : 0;
+		total_count_ += counts_[i];
+	}
+	total_sum_ = (total_sum_ >= earlier.total_sum_) ? (total_sum_ - earlier.total_sum_) : 0;
+}
+
+uint64_t
+kigoron::histogram_snapshot_t::ValueAtPercentile (
+	double percentile
+	) const
+{
+	if (0 == total_count_)
+		return 0;
+	const double clamped = (std::min)(100.0, (std::max)(0.0, percentile));
+	uint64_t target = static_cast<uint64_t> (std::ceil ((clamped / 100.0) * total_count_));
+	if (0 == target)
+		target = 1;
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < counts_.size(); ++i) {
+		cumulative += counts_[i];
+		if (cumulative >= target)
+			return histogram::HighestValueAt (sub_bucket_bits_, static_cast<unsigned> (i));
+	}
+	return Max();
+}
+
+uint64_t
+kigoron::histogram_snapshot_t::Min() const
+{
+	for (size_t i = 0; i < counts_.size(); ++i) {
+		if (0 != counts_[i])
+			return histogram::LowestValueAt (sub_bucket_bits_, static_cast<unsigned> (i));
+	}
+	return 0;
+}
+
+uint64_t
+kigoron::histogram_snapshot_t::Max() const
+{
+	for (size_t i = counts_.size(); i > 0; --i) {
+		if (0 != counts_[i - 1])
+			return histogram::HighestValueAt (sub_bucket_bits_, static_cast<unsigned> (i - 1));
+	}
+	return 0;
+}
+
+double
+kigoron::histogram_snapshot_t::Mean() const
+{
+	if (0 == total_count_)
+		return 0.0;
+	return static_cast<double> (total_sum_) / static_cast<double> (total_count_);
+}
+
+void
+kigoron::histogram_snapshot_t::WriteJson (
+	chromium::JSONStreamWriter* writer
+	) const
+{
+	DCHECK(nullptr != writer);
+	writer->BeginObject();
+	writer->Key ("count");
+	writer->Uint64 (total_count_);
+	writer->Key ("min");
+	writer->Uint64 (Min());
+	writer->Key ("mean");
+	writer->Double (Mean());
+	writer->Key ("p50");
+	writer->Uint64 (ValueAtPercentile (50.0));
+	writer->Key ("p90");
+	writer->Uint64 (ValueAtPercentile (90.0));
+	writer->Key ("p99");
+	writer->Uint64 (ValueAtPercentile (99.0));
+	writer->Key ("p99_9");
+	writer->Uint64 (ValueAtPercentile (99.9));
+	writer->Key ("p99_99");
+	writer->Uint64 (ValueAtPercentile (99.99));
+	writer->Key ("max");
+	writer->Uint64 (Max());
+	writer->EndObject();
+}
+
+const char*
+kigoron::latency_stage_string (
+	latency_stage_e stage
+	)
+{
+	switch (stage) {
+	case LATENCY_STAGE_DECODE:	return "decode";
+	case LATENCY_STAGE_LOOKUP:	return "lookup";
+	case LATENCY_STAGE_ENCODE:	return "encode";
+	case LATENCY_STAGE_WRITE:	return "write";
+	case LATENCY_STAGE_FLUSH:	return "flush";
+	default:			return "unknown";
+	}
+}
+
+/* eof */
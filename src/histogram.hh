@@ -0,0 +1,138 @@
+/* Log-linear latency histogram after HdrHistogram.
+ *
+ * Values are bucketed with a fixed number of linear sub-buckets per power of
+ * two, 2^(bits-1) above the linear range, such that a bucket spans at most
+ * 1/2^(bits-1) of its lower bound: 6.25% with 5 bits.  Recording
+ * is wait-free from any thread via relaxed atomic increments, readers take
+ * snapshots without blocking writers.
+ */
+
+#ifndef HISTOGRAM_HH_
+#define HISTOGRAM_HH_
+
+#include <cstdint>
+#include <vector>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+namespace chromium
+{
+	class JSONStreamWriter;
+}
+
+namespace kigoron
+{
+/* Monotonic high resolution clock. */
+	namespace latency
+	{
+		uint64_t Now();
+		uint64_t ToNanoseconds (uint64_t ticks);
+	}
+
+/* Bucket layout for a given number of sub-bucket bits. */
+	namespace histogram
+	{
+		unsigned BucketCount (unsigned sub_bucket_bits);
+		unsigned IndexOf (unsigned sub_bucket_bits, uint64_t value);
+		uint64_t LowestValueAt (unsigned sub_bucket_bits, unsigned index);
+		uint64_t HighestValueAt (unsigned sub_bucket_bits, unsigned index);
+	}
+
+	template <unsigned SubBucketBits, unsigned ValueBits> class basic_histogram_t;
+
+	class histogram_snapshot_t
+	{
+	public:
+		histogram_snapshot_t();
+
+/* Returns the difference from an earlier snapshot of the same histogram. */
+		void Subtract (const histogram_snapshot_t& earlier);
+
+		uint64_t ValueAtPercentile (double percentile) const;
+		uint64_t Min() const;
+		uint64_t Max() const;
+		double Mean() const;
+
+/* Writes count, min, max, mean, and standard percentiles in nanoseconds as an object. */
+		void WriteJson (chromium::JSONStreamWriter* writer) const;
+
+		uint64_t total_count() const {
+			return total_count_;
+		}
+		uint64_t total_sum() const {
+			return total_sum_;
+		}
+
+	private:
+		template <unsigned SubBucketBits, unsigned ValueBits> friend class basic_histogram_t;
+
+		void Load (unsigned sub_bucket_bits, const boost::atomic<uint64_t>* counts, unsigned bucket_count, const boost::atomic<uint64_t>& total_sum);
+
+		unsigned sub_bucket_bits_;
+		std::vector<uint64_t> counts_;
+		uint64_t total_count_;
+		uint64_t total_sum_;
+	};
+
+/* Values above 2^ValueBits - 1 are recorded as that value, such that
+ * histograms of bounded values need not carry the full 64-bit range.
+ */
+	template <unsigned SubBucketBits, unsigned ValueBits = 64>
+	class basic_histogram_t
+	{
+	public:
+		static const unsigned kSubBucketBits = SubBucketBits;
+		static const unsigned kSubBucketCount = 1u << kSubBucketBits;
+		static const unsigned kSubBucketHalfCount = kSubBucketCount / 2;
+		static const unsigned kBucketCount = (ValueBits - kSubBucketBits + 1) * kSubBucketHalfCount + kSubBucketHalfCount;
+		static const uint64_t kMaxValue = ~UINT64_C(0) >> (64 - ValueBits);
+
+		basic_histogram_t() : total_sum_ (0) {
+			for (unsigned i = 0; i < kBucketCount; ++i)
+				counts_[i].store (0, boost::memory_order_relaxed);
+		}
+
+		void Record (uint64_t value) {
+			if (value > kMaxValue)
+				value = kMaxValue;
+			counts_[histogram::IndexOf (kSubBucketBits, value)].fetch_add (1, boost::memory_order_relaxed);
+			total_sum_.fetch_add (value, boost::memory_order_relaxed);
+		}
+
+		void Snapshot (histogram_snapshot_t* snapshot) const {
+			snapshot->Load (kSubBucketBits, counts_, kBucketCount, total_sum_);
+		}
+
+	private:
+		boost::atomic<uint64_t> counts_[kBucketCount];
+		boost::atomic<uint64_t> total_sum_;
+	};
+
+/* 16 sub-buckets per power of two, 6.25% worst case relative precision in
+ * ~8 KB.
+ */
+	typedef basic_histogram_t<5> histogram_t;
+/* 4 sub-buckets per power of two, 25% worst case, capped at 2^36 ns (~69s)
+ * in ~1.1 KB for per-client series, five stages per session.
+ */
+	typedef basic_histogram_t<3, 36> compact_histogram_t;
+
+/* Stages of request processing measured from receipt by rsslReadEx. */
+	enum latency_stage_e {
+		LATENCY_STAGE_DECODE,
+		LATENCY_STAGE_LOOKUP,
+		LATENCY_STAGE_ENCODE,
+		LATENCY_STAGE_WRITE,
+		LATENCY_STAGE_FLUSH,
+/* marker */
+		LATENCY_STAGE_MAX
+	};
+
+	const char* latency_stage_string (latency_stage_e stage);
+
+} /* namespace kigoron */
+
+#endif /* HISTOGRAM_HH_ */
+
+/* eof */
@@ -0,0 +1,333 @@
+/* Message loop for Chromium sockets on a dedicated thread.
+ */
+
+#include "io_thread.hh"
+
+#include <cstring>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#	include <Ws2tcpip.h>
+#else
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#endif
+
+#include "chromium/logging.hh"
+#include "net/base/net_util.hh"
+
+kigoron::io_thread_t::io_thread_t()
+	: wake_sock_ (net::kInvalidSocket)
+	, keep_running_ (false)
+{
+	FD_ZERO (&in_rfds_); FD_ZERO (&out_rfds_);
+	FD_ZERO (&in_wfds_); FD_ZERO (&out_wfds_);
+}
+
+/* The wake-up socket outlives the thread as other threads may still post. */
+kigoron::io_thread_t::~io_thread_t()
+{
+	Stop();
+	CloseWakeSocket();
+}
+
+bool
+kigoron::io_thread_t::Start()
+{
+	if ((bool)thread_)
+		return true;
+	if (net::kInvalidSocket == wake_sock_ && !CreateWakeSocket())
+		return false;
+	keep_running_ = true;
+	thread_.reset (new boost::thread ([this]() { Run(); }));
+	return true;
+}
+
+void
+kigoron::io_thread_t::Stop()
+{
+	if (!(bool)thread_)
+		return;
+	keep_running_ = false;
+	Wake();
+	thread_->join();
+	thread_.reset();
+/* Released outside of the lock as tasks may own arbitrary state. */
+	std::vector<std::function<void()>> discarded;
+	{
+		boost::lock_guard<boost::mutex> lock (pending_tasks_lock_);
+		discarded.swap (pending_tasks_);
+	}
+}
+
+/* Watching again with the same controller replaces the mode. */
+bool
+kigoron::io_thread_t::WatchFileDescriptor (
+	net::SocketDescriptor fd,
+	bool persistent,
+	Mode mode,
+	FileDescriptorWatcher* controller,
+	Watcher* delegate
+	)
+{
+	DCHECK_GE(fd, 0);
+	DCHECK(controller);
+	DCHECK(delegate);
+	DCHECK(mode == WATCH_READ || mode == WATCH_WRITE || mode == WATCH_READ_WRITE);
+
+	if (mode & WATCH_READ) {
+		FD_SET (fd, &in_rfds_);
+	} else {
+		FD_CLR (fd, &in_rfds_);
+	}
+	if (mode & WATCH_WRITE) {
+		FD_SET (fd, &in_wfds_);
+	} else {
+		FD_CLR (fd, &in_wfds_);
+	}
+
+	std::unique_ptr<FileDescriptorWatcher::event> evt (controller->ReleaseEvent());
+	if (!(bool)evt) {
+		evt.reset (new FileDescriptorWatcher::event (fd, mode));
+// Add this socket to the list of monitored sockets.
+		watch_list_.emplace_front (std::weak_ptr<FileDescriptorWatcher> (controller->weak_factory_));
+	} else {
+		evt->first = fd;
+		evt->second = mode;
+	}
+
+// Transfer ownership of evt to controller.
+	controller->Init(evt.release());
+
+	controller->set_watcher (delegate);
+	controller->set_pump (this);
+
+	return true;
+}
+
+/* The first task posted to an empty queue sends a wake-up datagram, so the
+ * loop leaves select() immediately.
+ */
+void
+kigoron::io_thread_t::PostTask (
+	std::function<void()> task
+	)
+{
+	bool was_empty;
+	{
+		boost::lock_guard<boost::mutex> lock (pending_tasks_lock_);
+		was_empty = pending_tasks_.empty();
+		pending_tasks_.emplace_back (std::move (task));
+	}
+	if (was_empty)
+		Wake();
+}
+
+/* Blocks in select() without a timeout, there are no timers on this loop. */
+void
+kigoron::io_thread_t::Run()
+{
+	for (;;) {
+		bool did_work = DoWork();
+
+		if (!keep_running_)
+			break;
+
+		if (did_work)
+			continue;
+
+		out_rfds_ = in_rfds_;
+		out_wfds_ = in_wfds_;
+		FD_SET (wake_sock_, &out_rfds_);
+/* First parameter is ignored by Winsock. */
+		if (select (0, &out_rfds_, &out_wfds_, nullptr, nullptr) < 0) {
+			LOG(ERROR) << "select failed: WSAGetLastError()==" << WSAGetLastError();
+			FD_ZERO (&out_rfds_);
+			FD_ZERO (&out_wfds_);
+		}
+	}
+}
+
+/* A callback may stop watching or destroy the controller, so the watch is
+ * re-checked between callbacks without holding a reference.
+ */
+bool
+kigoron::io_thread_t::DoWork()
+{
+	bool did_work = false;
+
+	if (FD_ISSET (wake_sock_, &out_rfds_)) {
+		FD_CLR (wake_sock_, &out_rfds_);
+		char buf[64];
+		while (recv (wake_sock_, buf, sizeof (buf), 0) > 0);
+	}
+	if (RunPendingTasks())
+		did_work = true;
+
+	for (auto it = watch_list_.begin();
+		it != watch_list_.end();)
+	{
+		FileDescriptorWatcher* controller = nullptr;
+		if (auto sp = it->lock())
+			controller = sp.get();
+		if (nullptr == controller || nullptr == controller->event_) {
+			auto jt = it++;
+			watch_list_.erase (jt);
+			continue;
+		}
+		auto current = it++;
+		const net::SocketDescriptor fd = controller->event_->first;
+		if (FD_ISSET (fd, &out_rfds_)) {
+			FD_CLR (fd, &out_rfds_);
+			controller->OnFileCanReadWithoutBlocking (fd, this);
+			did_work = true;
+			if (current->expired() || nullptr == controller->event_)
+				continue;
+		}
+		if (FD_ISSET (fd, &out_wfds_)) {
+			FD_CLR (fd, &out_wfds_);
+			controller->OnFileCanWriteWithoutBlocking (fd, this);
+			did_work = true;
+		}
+	}
+
+	return did_work;
+}
+
+/* Tasks posted whilst running wait for the next pass. */
+bool
+kigoron::io_thread_t::RunPendingTasks()
+{
+	std::vector<std::function<void()>> tasks;
+	{
+		boost::lock_guard<boost::mutex> lock (pending_tasks_lock_);
+		if (pending_tasks_.empty())
+			return false;
+		tasks.swap (pending_tasks_);
+	}
+	for (auto it = tasks.begin(); it != tasks.end(); ++it)
+		(*it)();
+	return true;
+}
+
+void
+kigoron::io_thread_t::Wake()
+{
+	if (net::kInvalidSocket == wake_sock_)
+		return;
+	const char wake = 0;
+	send (wake_sock_, &wake, sizeof (wake), 0);
+}
+
+/* Datagram socket connected to itself on the loopback interface. */
+bool
+kigoron::io_thread_t::CreateWakeSocket()
+{
+	wake_sock_ = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (net::kInvalidSocket == wake_sock_) {
+		LOG(ERROR) << "Cannot create wake-up socket.";
+		return false;
+	}
+	struct sockaddr_in addr;
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t addr_len = sizeof (addr);
+	if (0 != bind (wake_sock_, reinterpret_cast<struct sockaddr*> (&addr), sizeof (addr)) ||
+		0 != getsockname (wake_sock_, reinterpret_cast<struct sockaddr*> (&addr), &addr_len) ||
+		0 != connect (wake_sock_, reinterpret_cast<struct sockaddr*> (&addr), sizeof (addr)) ||
+		0 != net::SetNonBlocking (wake_sock_))
+	{
+		LOG(ERROR) << "Cannot bind wake-up socket.";
+		CloseWakeSocket();
+		return false;
+	}
+	return true;
+}
+
+void
+kigoron::io_thread_t::CloseWakeSocket()
+{
+	if (net::kInvalidSocket == wake_sock_)
+		return;
+#ifdef _WIN32
+	closesocket (wake_sock_);
+#else
+	close (wake_sock_);
+#endif
+	wake_sock_ = net::kInvalidSocket;
+}
+
+struct NullDeleter {template<typename T> void operator()(T*) {} };
+
+chromium::MessageLoopForIO::FileDescriptorWatcher::FileDescriptorWatcher()
+	: event_ (nullptr)
+	, pump_ (nullptr)
+	, watcher_ (nullptr)
+	, weak_factory_ (this, NullDeleter())
+{
+}
+
+chromium::MessageLoopForIO::FileDescriptorWatcher::~FileDescriptorWatcher()
+{
+	if (nullptr != event_) {
+		StopWatchingFileDescriptor();
+	}
+}
+
+bool
+chromium::MessageLoopForIO::FileDescriptorWatcher::StopWatchingFileDescriptor()
+{
+	event* e = ReleaseEvent();
+	if (nullptr == e) {
+		return true;
+	}
+
+	FD_CLR (e->first, &pump_->in_rfds_);
+	FD_CLR (e->first, &pump_->in_wfds_);
+	delete e;
+	pump_ = nullptr;
+	watcher_ = nullptr;
+	return true;
+}
+
+void
+chromium::MessageLoopForIO::FileDescriptorWatcher::Init (chromium::MessageLoopForIO::FileDescriptorWatcher::event *e)
+{
+	DCHECK(e);
+	DCHECK(!event_);
+
+	event_ = e;
+}
+
+chromium::MessageLoopForIO::FileDescriptorWatcher::event*
+chromium::MessageLoopForIO::FileDescriptorWatcher::ReleaseEvent()
+{
+	FileDescriptorWatcher::event *e = event_;
+	event_ = nullptr;
+	return e;
+}
+
+void
+chromium::MessageLoopForIO::FileDescriptorWatcher::OnFileCanReadWithoutBlocking (
+	net::SocketDescriptor fd,
+	kigoron::io_thread_t* pump
+	)
+{
+	if (!watcher_)
+		return;
+	watcher_->OnFileCanReadWithoutBlocking (fd);
+}
+
+void
+chromium::MessageLoopForIO::FileDescriptorWatcher::OnFileCanWriteWithoutBlocking (
+	net::SocketDescriptor fd,
+	kigoron::io_thread_t* pump
+	)
+{
+	DCHECK(watcher_);
+	watcher_->OnFileCanWriteWithoutBlocking (fd);
+}
+
+/* eof */
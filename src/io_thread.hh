@@ -0,0 +1,75 @@
+/* Message loop for Chromium sockets on a dedicated thread.
+ *
+ * Hosts the embedded HTTP server apart from the RSSL reactor, such that slow
+ * HTTP clients or large responses add no latency to item requests.
+ */
+
+#ifndef IO_THREAD_HH_
+#define IO_THREAD_HH_
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#endif
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+/* Boost threading. */
+#include <boost/thread.hpp>
+
+#include "message_loop.hh"
+#include "net/socket/socket_descriptor.hh"
+
+namespace kigoron
+{
+	class io_thread_t
+		: public chromium::MessageLoopForIO
+	{
+	public:
+		explicit io_thread_t();
+		~io_thread_t();
+
+/* Descriptors may be watched before Start, afterwards only from the loop
+ * thread.  Objects using the loop must be destroyed after Stop.
+ */
+		bool Start();
+/* Joins the thread, tasks not yet run are discarded. */
+		void Stop();
+
+		virtual bool WatchFileDescriptor (net::SocketDescriptor fd, bool persistent, Mode mode, FileDescriptorWatcher* controller, Watcher* delegate) override;
+		virtual void PostTask (std::function<void()> task) override;
+
+	private:
+		void Run();
+		bool DoWork();
+/* Loopback datagram socket readable whilst tasks are posted. */
+		bool CreateWakeSocket();
+		void CloseWakeSocket();
+		void Wake();
+		bool RunPendingTasks();
+
+		std::list<std::weak_ptr<FileDescriptorWatcher>> watch_list_;
+		fd_set in_rfds_, in_wfds_;
+		fd_set out_rfds_, out_wfds_;
+
+/* Tasks posted from any thread. */
+		std::vector<std::function<void()>> pending_tasks_;
+		boost::mutex pending_tasks_lock_;
+		net::SocketDescriptor wake_sock_;
+
+		boost::atomic_bool keep_running_;
+		std::unique_ptr<boost::thread> thread_;
+
+		friend chromium::MessageLoopForIO::FileDescriptorWatcher;
+	};
+
+} /* namespace kigoron */
+
+#endif /* IO_THREAD_HH_ */
+
+/* eof */
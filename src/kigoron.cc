@@ -5,14 +5,20 @@
 
 #define __STDC_FORMAT_MACROS
 #include <cstdint>
+#include <cstdlib>
 #include <inttypes.h>
+#include <set>
 
 #include <windows.h>
 
 #include "chromium/command_line.hh"
 #include "chromium/files/file_util.hh"
+#include "chromium/json/json_stream_writer.hh"
 #include "chromium/logging.hh"
+#include "chromium/strings/string_number_conversions.hh"
 #include "chromium/strings/string_split.hh"
+#include "async_log.hh"
+#include "dictionary.hh"
 #include "upa.hh"
 #include "unix_epoch.hh"
 
@@ -25,6 +31,38 @@ const char kSymbolPath[]		= "symbol-path";
 //   Maximum symbol age.
 const char kMaxAge[]			= "max-age";
 
+//   RDM field dictionary file.
+const char kFieldDictionaryPath[]	= "field-dictionary";
+
+//   RDM enumerated type dictionary file.
+const char kEnumTypeDictionaryPath[]	= "enumtype-dictionary";
+
+//   RSSL transport compression: none, zlib, lz4.
+const char kCompressionType[]		= "compression-type";
+
+//   RSSL transport compression level, 0 to 9.
+const char kCompressionLevel[]		= "compression-level";
+
+//   RSSL transport compression threshold in bytes.
+const char kCompressionThreshold[]	= "compression-threshold";
+
+//   Flight recorder dump file, written on POST /json/flight/dump.
+const char kFlightRecorderPath[]	= "flight-recorder-path";
+
+//   RSSL listeners, comma separated name:port[:key=value...] with keys
+//   capacity, sndbuf, rcvbuf, outbufs, inbufs, maxoutbufs, outbuflimit, and
+//   http, e.g.
+//   bulk:14002:sndbuf=262144:capacity=64:outbuflimit=2000,realtime:14003:http=7580
+const char kListeners[]			= "listeners";
+
+//   Embedded HTTP server port of the first listener, zero for none, unless
+//   set by its http listener option.
+const char kHttpPort[]			= "http-port";
+
+//   Export client counters per session in HTTP metrics, otherwise only the
+//   provider totals.
+const char kMetricsPerClient[]		= "metrics-per-client";
+
 }  // namespace switches
 
 namespace {
@@ -33,8 +71,10 @@ static const int kRdmRicId			= 4453;	// UN_RIC(8697), UNDERLYING(3814), PRIM_RIC
 
 static const int kRdmClassId			= 3308; // UN_CLASS(4195), CLASS_CODE(3308), e.g. EQU
 static const int kRdmExchangeId			= 4308;	// EXCH_SNAME(4308), RDN_EXCHID(4), e.g. NSQ
+static const int kRdmExchangeEnumId		= 4;	// RDN_EXCHID(4), enumerated
 static const int kRdmNameId			= 3;	// UN_NAME(4197), DSPLY_NAME(3)
 static const int kRdmCurrencyId			= 3591; // CCY_NAME(3591), PRIM_CCY(9018)
+static const int kRdmCurrencyEnumId		= 15;	// CURRENCY(15), enumerated, e.g. 840 for USD
 static const int kRdmSymbolId			= 3684; // UN_SYMBOL(4200), MNEMONIC(3684), UN_SYMB(8743), EXCHCODE(4058)
 static const int kRdmIsinId			= 3655;	// UN_ISIN(4196), ISIN_1(5632), ISIN_CODE(3655)
 static const int kRdmCusipId			= 4742;	// U_CUSIP(8543), CUSIP_CD(4742)
@@ -48,12 +88,114 @@ static const std::string kErrorNotFound = "Not found in Tick History.";
 static const std::string kErrorPermData = "Unable to retrieve permission data for item.";
 static const std::string kErrorInternal = "Internal error.";
 
+/* Listener options are positive integers, zero is expressed by omission. */
+bool
+ParseListenerValue (
+	const std::string& name,
+	const std::string& key,
+	const std::string& value,
+	unsigned* output
+	)
+{
+	if (!chromium::StringToUint (value, output) || 0 == *output) {
+		LOG(ERROR) << "Invalid value \"" << value << "\" for listener option \"" << key << "\" of \"" << name << "\".";
+		return false;
+	}
+	return true;
+}
+
+/* The first listener inherits defaults from |first|, including the HTTP
+ * port, subsequent listeners start without one.  Names and ports, RSSL or
+ * HTTP, must be unique.
+ */
+bool
+ParseListeners (
+	const std::string& spec,
+	const kigoron::listener_config_t& first,
+	std::vector<kigoron::listener_config_t>* listeners
+	)
+{
+	std::vector<std::string> entries, fields;
+	std::set<std::string> names, ports;
+	chromium::SplitString (spec, ',', &entries);
+	listeners->clear();
+	for (const auto& entry : entries) {
+		fields.clear();
+		chromium::SplitString (entry, ':', &fields);
+		if (fields.size() < 2 || fields[0].empty() || fields[1].empty()) {
+			LOG(ERROR) << "Listener \"" << entry << "\" requires a name and port.";
+			return false;
+		}
+		kigoron::listener_config_t listener (listeners->empty() ? first : kigoron::listener_config_t());
+		listener.name = fields[0];
+		listener.rssl_port = fields[1];
+		for (size_t i = 2; i < fields.size(); ++i) {
+			const size_t pos = fields[i].find ('=');
+			const std::string key (fields[i], 0, pos);
+			const std::string value (std::string::npos == pos ? "" : fields[i].substr (pos + 1));
+			if ("capacity" == key) {
+				unsigned session_capacity;
+				if (!ParseListenerValue (listener.name, key, value, &session_capacity))
+					return false;
+				listener.session_capacity = session_capacity;
+			} else if ("sndbuf" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.send_buffer_size))
+					return false;
+			} else if ("rcvbuf" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.recv_buffer_size))
+					return false;
+			} else if ("outbufs" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.guaranteed_output_buffers))
+					return false;
+			} else if ("inbufs" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.num_input_buffers))
+					return false;
+			} else if ("maxoutbufs" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.max_output_buffers))
+					return false;
+			} else if ("outbuflimit" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.output_buffer_limit))
+					return false;
+			} else if ("http" == key) {
+				if (!ParseListenerValue (listener.name, key, value, &listener.http_port))
+					return false;
+				if (listener.http_port > 65535) {
+					LOG(ERROR) << "Invalid HTTP port " << listener.http_port << " for \"" << listener.name << "\".";
+					return false;
+				}
+			} else {
+				LOG(ERROR) << "Unknown listener option \"" << key << "\" for \"" << listener.name << "\".";
+				return false;
+			}
+		}
+		if (!names.insert (listener.name).second) {
+			LOG(ERROR) << "Duplicate listener name \"" << listener.name << "\".";
+			return false;
+		}
+		if (!ports.insert (listener.rssl_port).second) {
+			LOG(ERROR) << "Duplicate port " << listener.rssl_port << " for \"" << listener.name << "\".";
+			return false;
+		}
+		if (0 != listener.http_port && !ports.insert (chromium::UintToString (listener.http_port)).second) {
+			LOG(ERROR) << "Duplicate port " << listener.http_port << " for \"" << listener.name << "\".";
+			return false;
+		}
+		listeners->push_back (listener);
+	}
+	if (listeners->empty()) {
+		LOG(ERROR) << "No listeners defined.";
+		return false;
+	}
+	return true;
+}
+
 }  // namespace anon
 
 static std::weak_ptr<kigoron::kigoron_t> g_application;
 
 kigoron::kigoron_t::kigoron_t()
-	: mainloop_shutdown_ (false)
+	: mainloop_count_ (0)
+	, mainloop_shutdown_ (false)
 	, shutting_down_ (false)
 {
 }
@@ -128,8 +270,8 @@ void
 kigoron::kigoron_t::Quit()
 {
 	shutting_down_ = true;
-	if ((bool)provider_) {
-		provider_->Quit();
+	for (const auto& provider : providers_) {
+		provider->Quit();
 	}
 }
 
@@ -145,11 +287,63 @@ kigoron::kigoron_t::Initialize ()
 		if (command_line->HasSwitch (switches::kMaxAge)) {
 			config_.max_age = command_line->GetSwitchValueASCII (switches::kMaxAge);
 		}
+/* RDM dictionaries */
+		if (command_line->HasSwitch (switches::kFieldDictionaryPath)) {
+			config_.field_dictionary_path = command_line->GetSwitchValueASCII (switches::kFieldDictionaryPath);
+		}
+		if (command_line->HasSwitch (switches::kEnumTypeDictionaryPath)) {
+			config_.enum_type_dictionary_path = command_line->GetSwitchValueASCII (switches::kEnumTypeDictionaryPath);
+		}
+/* Transport compression */
+		if (command_line->HasSwitch (switches::kCompressionType)) {
+			config_.compression_type = command_line->GetSwitchValueASCII (switches::kCompressionType);
+		}
+		if (command_line->HasSwitch (switches::kCompressionLevel)) {
+			const std::string value (command_line->GetSwitchValueASCII (switches::kCompressionLevel));
+			if (!chromium::StringToUint (value, &config_.compression_level) || config_.compression_level > 9) {
+				LOG(ERROR) << "Invalid compression level \"" << value << "\", expecting 0 to 9.";
+				goto cleanup;
+			}
+		}
+		if (command_line->HasSwitch (switches::kCompressionThreshold)) {
+			const std::string value (command_line->GetSwitchValueASCII (switches::kCompressionThreshold));
+			if (!chromium::StringToUint (value, &config_.compression_threshold)) {
+				LOG(ERROR) << "Invalid compression threshold \"" << value << "\".";
+				goto cleanup;
+			}
+		}
+/* Flight recorder */
+		if (command_line->HasSwitch (switches::kFlightRecorderPath)) {
+			config_.flight_recorder_path = command_line->GetSwitchValueASCII (switches::kFlightRecorderPath);
+		}
+/* HTTP metrics */
+		config_.metrics_per_client = command_line->HasSwitch (switches::kMetricsPerClient);
+/* RSSL listeners, the first inheriting the HTTP port such that it is checked
+ * for conflicts.
+ */
+		if (command_line->HasSwitch (switches::kHttpPort)) {
+			const std::string value (command_line->GetSwitchValueASCII (switches::kHttpPort));
+			if (!chromium::StringToUint (value, &config_.listeners.front().http_port) || config_.listeners.front().http_port > 65535) {
+				LOG(ERROR) << "Invalid HTTP port \"" << value << "\".";
+				goto cleanup;
+			}
+		}
+		if (command_line->HasSwitch (switches::kListeners)) {
+			std::vector<listener_config_t> listeners;
+			if (!ParseListeners (command_line->GetSwitchValueASCII (switches::kListeners), config_.listeners.front(), &listeners))
+				goto cleanup;
+			config_.listeners.swap (listeners);
+		}
 
 		LOG(INFO) << "Kigoron: { "
 			"\"config\": " << config_ <<
 			" }";
 
+/* RDM dictionary. */
+		dictionary_.reset (new dictionary_t (config_));
+		if (!(bool)dictionary_ || !dictionary_->Initialize())
+			goto cleanup;
+
 /* Symbol list */
 		if (command_line->HasSwitch (switches::kSymbolPath)) {
 			boost::posix_time::time_duration reset_tod (boost::date_time::not_a_date_time);
@@ -160,6 +354,7 @@ kigoron::kigoron_t::Initialize ()
 				LOG(INFO) << "Symbols will not expire.";
 			}
 			std::vector<std::string> files;
+			size_t enum_exchange_count = 0, enum_currency_count = 0;
 			config_.symbol_path = command_line->GetSwitchValueASCII (switches::kSymbolPath);
 /* Separate out multiple files if provided. */
 			chromium::SplitString (config_.symbol_path, ',', &files);
@@ -211,7 +406,18 @@ kigoron::kigoron_t::Initialize ()
 										columns[COLUMN_CURRENCY],
 										last_modified,
 										max_age);
-					map_.emplace (std::string ("RIC=") + columns[COLUMN_RIC], item);
+/* Enumerated fields replace the string equivalents when the display value is known. */
+					RsslEnum enum_value;
+					if (dictionary_->GetEnumValue (kRdmExchangeEnumId, item->exchange_code, &enum_value)) {
+						item->rdn_exchid = enum_value;
+						++enum_exchange_count;
+					}
+					if (dictionary_->GetEnumValue (kRdmCurrencyEnumId, item->currency_name, &enum_value)) {
+						item->currency = enum_value;
+						++enum_currency_count;
+					}
+					if (map_.emplace (std::string ("RIC=") + columns[COLUMN_RIC], item).second)
+						items_.push_back (item);
 					if (!columns.at (COLUMN_ISIN).empty()) {
 						item->isin_code.assign (columns[COLUMN_ISIN]);
 						map_.emplace (std::string ("ISIN=") + columns[COLUMN_ISIN], item);
@@ -231,16 +437,26 @@ kigoron::kigoron_t::Initialize ()
 				}
 			}
 			LOG(INFO) << "Symbol map contains " << map_.size() << " entries.";
+			LOG(INFO) << "Enumerated fields: { "
+				  "\"RDN_EXCHID\": " << enum_exchange_count << ""
+				", \"CURRENCY\": " << enum_currency_count << ""
+				" }";
 		}
 
 /* UPA context. */
 		upa_.reset (new upa_t (config_));
 		if (!(bool)upa_ || !upa_->Initialize())
 			goto cleanup;
-/* UPA provider. */
-		provider_.reset (new provider_t (config_, upa_, static_cast<client_t::Delegate*> (this)));
-		if (!(bool)provider_ || !provider_->Initialize())
-			goto cleanup;
+/* UPA providers, one per listener. */
+		for (const auto& listener : config_.listeners) {
+			std::shared_ptr<provider_t> provider (new provider_t (config_, listener, upa_, dictionary_, static_cast<client_t::Delegate*> (this)));
+			if (!(bool)provider)
+				goto cleanup;
+			provider->set_symbol_count (map_.size());
+			providers_.push_back (provider);
+			if (!provider->Initialize())
+				goto cleanup;
+		}
 
 	} catch (const std::exception& e) {
 		LOG(ERROR) << "Upa::Initialisation exception: { "
@@ -275,12 +491,18 @@ kigoron::kigoron_t::OnRequest (
 		", \"item_name\": \"" << item_name << "\""
 		", \"use_attribinfo_in_updates\": " << (use_attribinfo_in_updates ? "true" : "false") << ""
 		" }";
-/* Reset message buffer */
-	rssl_length_ = sizeof (rssl_buf_);
+/* Called on the reactor thread of the provider owning the session. */
+	provider_t* provider = provider_t::FromHandle (handle);
+	provider->RecordFlightEvent (FLIGHT_EVENT_REQUEST, handle, token);
+/* Message buffer per call as reactors run concurrently. */
+	char rssl_buf[MAX_MSG_SIZE];
+	size_t rssl_length = sizeof (rssl_buf);
 /* Validate symbol */
 	auto search = map_.find (item_name);
+	provider->RecordLatency (LATENCY_STAGE_LOOKUP);
+	provider->RecordFlightEvent ((search == map_.end()) ? FLIGHT_EVENT_LOOKUP_MISS : FLIGHT_EVENT_LOOKUP_HIT, handle, token);
 	if (search == map_.end()) {
-		LOG(INFO) << "Closing resource not found for \"" << item_name << "\"";
+		LOG_RATE_LIMITED(INFO, 10) << "Closing resource not found for \"" << item_name << "\"";
 		if (!provider_t::WriteRawClose (
 				rwf_version,
 				token,
@@ -289,8 +511,8 @@ kigoron::kigoron_t::OnRequest (
 				item_name,
 				use_attribinfo_in_updates,
 				RSSL_STREAM_CLOSED, RSSL_SC_NOT_FOUND, kErrorNotFound,
-				rssl_buf_,
-				&rssl_length_
+				rssl_buf,
+				&rssl_length
 				))
 		{
 			return false;
@@ -298,7 +520,13 @@ kigoron::kigoron_t::OnRequest (
 		goto send_reply;
 	}
 
-	if (!WriteRaw (now, rwf_version, token, service_id, item_name, nullptr, search->second, rssl_buf_, &rssl_length_)) {
+/* Only the provided service is cached as the service id is set by the client. */
+	bool is_written;
+	if (service_id == provider->service_id())
+		is_written = WriteCachedRaw (provider, now, rwf_version, token, service_id, item_name, search->second, rssl_buf, &rssl_length);
+	else
+		is_written = WriteRaw (now, rwf_version, token, service_id, item_name, nullptr, search->second, rssl_buf, &rssl_length);
+	if (!is_written) {
 /* Extremely unlikely situation that writing the response fails but writing a close will not */
 		if (!provider_t::WriteRawClose (
 				rwf_version,
@@ -308,8 +536,8 @@ kigoron::kigoron_t::OnRequest (
 				item_name,
 				use_attribinfo_in_updates,
 				RSSL_STREAM_CLOSED_RECOVER, RSSL_SC_ERROR, kErrorInternal,
-				rssl_buf_,
-				&rssl_length_
+				rssl_buf,
+				&rssl_length
 				))
 		{
 			return false;
@@ -318,7 +546,162 @@ kigoron::kigoron_t::OnRequest (
 	}
 
 send_reply:
-	return provider_->SendReply (reinterpret_cast<RsslChannel*> (handle), token, rssl_buf_, rssl_length_);
+	provider->RecordLatency (LATENCY_STAGE_ENCODE);
+	provider->RecordFlightEvent (FLIGHT_EVENT_ENCODE, handle, token);
+	return provider->SendReply (reinterpret_cast<RsslChannel*> (handle), token, rssl_buf, rssl_length);
+}
+
+/* Map entries are immutable after initialization, lookups need no lock. */
+bool
+kigoron::kigoron_t::WriteSymbol (
+	const std::string& key,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	auto search = map_.find (key);
+	if (search == map_.end())
+		return false;
+	WriteItem (*search->second, writer);
+	return true;
+}
+
+/* Entries are comma separated so that successive calls concatenate into one array. */
+bool
+kigoron::kigoron_t::WriteSymbols (
+	size_t* cursor,
+	size_t max_size,
+	std::string* json
+	)
+{
+	while (*cursor < items_.size() && json->size() < max_size) {
+		if (*cursor > 0)
+			json->push_back (',');
+		chromium::JSONStreamWriter writer (json);
+		WriteItem (*items_[(*cursor)++], &writer);
+	}
+	return *cursor < items_.size();
+}
+
+/* RFC 4180 records with CRLF line endings, columns as the JSON member names. */
+bool
+kigoron::kigoron_t::WriteSymbolsCsv (
+	size_t* cursor,
+	size_t max_size,
+	std::string* csv
+	)
+{
+	if (0 == *cursor)
+		csv->append ("ric,isin,cusip,sedol,gics,name,exchange,class,currency\r\n");
+	while (*cursor < items_.size() && csv->size() < max_size) {
+		const item_t& item = *items_[(*cursor)++];
+		AppendCsvField (item.primary_ric, csv);
+		csv->push_back (',');
+		AppendCsvField (item.isin_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.cusip_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.sedol_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.gics_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.display_name, csv);
+		csv->push_back (',');
+		AppendCsvField (item.exchange_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.class_code, csv);
+		csv->push_back (',');
+		AppendCsvField (item.currency_name, csv);
+		csv->append ("\r\n");
+	}
+	return *cursor < items_.size();
+}
+
+void
+kigoron::kigoron_t::WriteItem (
+	const item_t& item,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	writer->BeginObject();
+	writer->Key ("ric");
+	writer->String (item.primary_ric);
+	if (!item.isin_code.empty()) {
+		writer->Key ("isin");
+		writer->String (item.isin_code);
+	}
+	if (!item.cusip_code.empty()) {
+		writer->Key ("cusip");
+		writer->String (item.cusip_code);
+	}
+	if (!item.sedol_code.empty()) {
+		writer->Key ("sedol");
+		writer->String (item.sedol_code);
+	}
+	if (!item.gics_code.empty()) {
+		writer->Key ("gics");
+		writer->String (item.gics_code);
+	}
+	writer->Key ("name");
+	writer->String (item.display_name);
+	writer->Key ("exchange");
+	writer->String (item.exchange_code);
+	writer->Key ("class");
+	writer->String (item.class_code);
+	writer->Key ("currency");
+	writer->String (item.currency_name);
+	writer->EndObject();
+}
+
+/* Quoted only when containing a separator, quote, or line break. */
+void
+kigoron::kigoron_t::AppendCsvField (
+	const std::string& field,
+	std::string* csv
+	)
+{
+	if (std::string::npos == field.find_first_of (",\"\r\n")) {
+		csv->append (field);
+		return;
+	}
+	csv->push_back ('"');
+	for (auto it = field.begin(); it != field.end(); ++it) {
+		if ('"' == *it)
+			csv->push_back ('"');
+		csv->push_back (*it);
+	}
+	csv->push_back ('"');
+}
+
+/* Refresh images are encoded once per item, service id, RWF version, and
+ * data state with a zero stream id in the cache of the requesting provider,
+ * subsequent requests copy and patch the image.  Reactor thread only.
+ */
+bool
+kigoron::kigoron_t::WriteCachedRaw (
+	provider_t* provider,
+	const boost::posix_time::ptime& now,
+	uint16_t rwf_version,
+	int32_t token,
+	uint16_t service_id,
+	const chromium::StringPiece& item_name,
+	std::shared_ptr<item_t> item,
+	void* data,
+	size_t* length
+	)
+{
+	const bool is_suspect = !item->expiration_time.is_not_a_date_time() && now >= item->expiration_time;
+	const uint64_t key = (static_cast<uint64_t> (service_id) << 17) | (static_cast<uint64_t> (rwf_version) << 1) | (is_suspect ? 1 : 0);
+	const std::string* image = provider->GetRefreshImage (item.get(), key);
+	if (nullptr != image) {
+		DCHECK(image->size() <= *length);
+		CopyMemory (data, image->data(), image->size());
+		*length = image->size();
+	} else {
+		if (!WriteRaw (now, rwf_version, 0 /* token */, service_id, item_name, nullptr, item, data, length))
+			return false;
+		provider->SetRefreshImage (item.get(), key, data, *length);
+	}
+	return provider_t::ReplaceStreamId (rwf_version, token, RSSL_STREAM_UNSPECIFIED, data, *length);
 }
 
 bool
@@ -391,7 +774,7 @@ kigoron::kigoron_t::WriteRaw (
 			" }";
 		return false;
 	}
-	rc = rsslSetEncodeIteratorRWFVersion (&it, provider_t::rwf_major_version (rwf_version), provider_t::rwf_major_version (rwf_version));
+	rc = rsslSetEncodeIteratorRWFVersion (&it, provider_t::rwf_major_version (rwf_version), provider_t::rwf_minor_version (rwf_version));
 	if (RSSL_RET_SUCCESS != rc) {
 		LOG(ERROR) << "rsslSetEncodeIteratorRWFVersion: { "
 			  "\"returnCode\": " << static_cast<signed> (rc) << ""
@@ -477,40 +860,76 @@ kigoron::kigoron_t::WriteRaw (
 			return false;
 		}
 
-/* EXCH_SNAME */
-		field.fieldId  = kRdmExchangeId;
-		field.dataType = RSSL_DT_RMTES_STRING;
-		data_buffer.data   = const_cast<char*> (item->exchange_code.c_str());
-		data_buffer.length = static_cast<uint32_t> (item->exchange_code.size());
-		rc = rsslEncodeFieldEntry (&it, &field, &data_buffer);
-		if (RSSL_RET_SUCCESS != rc) {
-			LOG(ERROR) << "rsslEncodeFieldEntry: { "
-				  "\"returnCode\": " << static_cast<signed> (rc) << ""
-				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
-				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
-				", \"fieldId\": " << field.fieldId << ""
-				", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
-				", \"exchangeShortName\": \"" << item->exchange_code << "\""
-				" }";
-			return false;
+/* RDN_EXCHID, or EXCH_SNAME if not enumerated */
+		if (0 != item->rdn_exchid) {
+			RsslEnum rdn_exchid = item->rdn_exchid;
+			field.fieldId  = kRdmExchangeEnumId;
+			field.dataType = RSSL_DT_ENUM;
+			rc = rsslEncodeFieldEntry (&it, &field, &rdn_exchid);
+			if (RSSL_RET_SUCCESS != rc) {
+				LOG(ERROR) << "rsslEncodeFieldEntry: { "
+					  "\"returnCode\": " << static_cast<signed> (rc) << ""
+					", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+					", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+					", \"fieldId\": " << field.fieldId << ""
+					", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
+					", \"rdnExchid\": " << rdn_exchid << ""
+					" }";
+				return false;
+			}
+		} else {
+			field.fieldId  = kRdmExchangeId;
+			field.dataType = RSSL_DT_RMTES_STRING;
+			data_buffer.data   = const_cast<char*> (item->exchange_code.c_str());
+			data_buffer.length = static_cast<uint32_t> (item->exchange_code.size());
+			rc = rsslEncodeFieldEntry (&it, &field, &data_buffer);
+			if (RSSL_RET_SUCCESS != rc) {
+				LOG(ERROR) << "rsslEncodeFieldEntry: { "
+					  "\"returnCode\": " << static_cast<signed> (rc) << ""
+					", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+					", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+					", \"fieldId\": " << field.fieldId << ""
+					", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
+					", \"exchangeShortName\": \"" << item->exchange_code << "\""
+					" }";
+				return false;
+			}
 		}
 
-/* CCY_NAME */
-		field.fieldId  = kRdmCurrencyId;
-		field.dataType = RSSL_DT_RMTES_STRING;
-		data_buffer.data   = const_cast<char*> (item->currency_name.c_str());
-		data_buffer.length = static_cast<uint32_t> (item->currency_name.size());
-		rc = rsslEncodeFieldEntry (&it, &field, &data_buffer);
-		if (RSSL_RET_SUCCESS != rc) {
-			LOG(ERROR) << "rsslEncodeFieldEntry: { "
-				  "\"returnCode\": " << static_cast<signed> (rc) << ""
-				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
-				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
-				", \"fieldId\": " << field.fieldId << ""
-				", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
-				", \"currencyName\": \"" << item->currency_name << "\""
-				" }";
-			return false;
+/* CURRENCY, or CCY_NAME if not enumerated */
+		if (0 != item->currency) {
+			RsslEnum currency = item->currency;
+			field.fieldId  = kRdmCurrencyEnumId;
+			field.dataType = RSSL_DT_ENUM;
+			rc = rsslEncodeFieldEntry (&it, &field, &currency);
+			if (RSSL_RET_SUCCESS != rc) {
+				LOG(ERROR) << "rsslEncodeFieldEntry: { "
+					  "\"returnCode\": " << static_cast<signed> (rc) << ""
+					", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+					", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+					", \"fieldId\": " << field.fieldId << ""
+					", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
+					", \"currency\": " << currency << ""
+					" }";
+				return false;
+			}
+		} else {
+			field.fieldId  = kRdmCurrencyId;
+			field.dataType = RSSL_DT_RMTES_STRING;
+			data_buffer.data   = const_cast<char*> (item->currency_name.c_str());
+			data_buffer.length = static_cast<uint32_t> (item->currency_name.size());
+			rc = rsslEncodeFieldEntry (&it, &field, &data_buffer);
+			if (RSSL_RET_SUCCESS != rc) {
+				LOG(ERROR) << "rsslEncodeFieldEntry: { "
+					  "\"returnCode\": " << static_cast<signed> (rc) << ""
+					", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+					", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+					", \"fieldId\": " << field.fieldId << ""
+					", \"dataType\": \"" << rsslDataTypeToString (field.dataType) << "\""
+					", \"currencyName\": \"" << item->currency_name << "\""
+					" }";
+				return false;
+			}
 		}
 
 /* DSPLY_NAME */
@@ -695,14 +1114,20 @@ kigoron::kigoron_t::Start()
 	LOG(INFO) << "Starting instance: { "
 		" }";
 	if (!shutting_down_ && Initialize()) {
-/* Spawn new thread for message pump. */
-		event_thread_.reset (new boost::thread ([this]() {
-			MainLoop();
-/* Raise condition loop is complete. */
-			boost::lock_guard<boost::mutex> lock (mainloop_lock_);
-			mainloop_shutdown_ = true;
-			mainloop_cond_.notify_one();
-		}));
+/* Spawn new thread for each message pump. */
+		mainloop_count_ = providers_.size();
+		for (const auto& sp : providers_) {
+			provider_t* provider = sp.get();
+			event_threads_.emplace_back (new boost::thread ([this, provider]() {
+				MainLoop (provider);
+/* Raise condition once every loop is complete. */
+				boost::lock_guard<boost::mutex> lock (mainloop_lock_);
+				if (0 == --mainloop_count_) {
+					mainloop_shutdown_ = true;
+					mainloop_cond_.notify_one();
+				}
+			}));
+		}
 		return true;
 	}  else {
 		return false;
@@ -715,8 +1140,9 @@ kigoron::kigoron_t::Stop()
 	LOG(INFO) << "Shutting down instance: { "
 		" }";
 	shutting_down_ = true;
-	if ((bool)provider_) {
-		provider_->Quit();
+	if (!providers_.empty()) {
+		for (const auto& provider : providers_)
+			provider->Quit();
 /* Wait for mainloop to quit */
 		boost::unique_lock<boost::mutex> lock (mainloop_lock_);
 		while (!mainloop_shutdown_)
@@ -729,29 +1155,39 @@ void
 kigoron::kigoron_t::Reset()
 {
 /* Close client sockets with reference counts on provider. */
-	if ((bool)provider_)
-		provider_->Close();
+	for (const auto& provider : providers_)
+		provider->Close();
 /* Release everything with an UPA dependency. */
-	CHECK_LE (provider_.use_count(), 1);
-	provider_.reset();
+	for (const auto& provider : providers_)
+		CHECK_LE (provider.use_count(), 1);
+	providers_.clear();
 /* Final tests before releasing UPA context */
 	chromium::debug::LeakTracker<client_t>::CheckForLeaks();
 	chromium::debug::LeakTracker<provider_t>::CheckForLeaks();
+/* Dictionary shared with provider and client sessions. */
+	CHECK_LE (dictionary_.use_count(), 1);
+	dictionary_.reset();
+	chromium::debug::LeakTracker<dictionary_t>::CheckForLeaks();
 /* No more UPA sockets so close up context */
 	CHECK_LE (upa_.use_count(), 1);
 	upa_.reset();
 	chromium::debug::LeakTracker<upa_t>::CheckForLeaks();
 }
 
+/* Any loop returning takes the remaining providers down with it. */
 void
-kigoron::kigoron_t::MainLoop()
+kigoron::kigoron_t::MainLoop (
+	provider_t* provider
+	)
 {
 	try {
-		provider_->Run(); 
+		provider->Run(); 
 	} catch (const std::exception& e) {
 		LOG(ERROR) << "Runtime exception: { "
-			"\"What\": \"" << e.what() << "\" }";
+			"\"listener\": \"" << provider->listener_name() << "\""
+			", \"What\": \"" << e.what() << "\" }";
 	}
+	Quit();
 }
 
 /* eof */
@@ -15,6 +15,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <utility>
+#include <vector>
 #include <boost/unordered_map.hpp>
 
 #include "chromium/strings/string_piece.hh"
@@ -29,6 +31,7 @@ namespace kigoron
 {
 	class upa_t;
 	class provider_t;
+	class dictionary_t;
 
 	class item_t
 	{
@@ -39,6 +42,8 @@ namespace kigoron
 			, class_code (class_)
 			, display_name (name_)
 			, currency_name (currency_)
+			, rdn_exchid (0)
+			, currency (0)
 			, modification_time (last_write_)
 			, expiration_time (max_age_)
 		{
@@ -54,6 +59,10 @@ namespace kigoron
 		std::string sedol_code;
 		std::string gics_code;
 
+/* Enumerated values mapped through the enumtype dictionary, zero if unmapped. */
+		uint16_t rdn_exchid;
+		uint16_t currency;
+
 		boost::posix_time::ptime modification_time;
 		boost::posix_time::ptime expiration_time;		/* item marked stale after this timestamp */
 	};
@@ -75,13 +84,16 @@ namespace kigoron
 		void Quit();
 
 		virtual bool OnRequest (const boost::posix_time::ptime& now, uintptr_t handle, uint16_t rwf_version, int32_t token, uint16_t service_id, const std::string& item_name, bool use_attribinfo_in_updates) override;
+		virtual bool WriteSymbol (const std::string& key, chromium::JSONStreamWriter* writer) override;
+		virtual bool WriteSymbols (size_t* cursor, size_t max_size, std::string* json) override;
+		virtual bool WriteSymbolsCsv (size_t* cursor, size_t max_size, std::string* csv) override;
 
 		bool Initialize();
 		void Reset();
 
 	private:
-/* Run core event loop. */
-		void MainLoop();
+/* Run core event loop of one provider. */
+		void MainLoop (provider_t* provider);
 
 /* Start the encapsulated provider instance until Stop is called.  Stop may be
  * called to pre-emptively prevent execution.
@@ -89,14 +101,20 @@ namespace kigoron
 		bool Start();
 		void Stop();
 
+		static void WriteItem (const item_t& item, chromium::JSONStreamWriter* writer);
+		static void AppendCsvField (const std::string& field, std::string* csv);
+		bool WriteCachedRaw (provider_t* provider, const boost::posix_time::ptime& now, uint16_t rwf_version, int32_t token, uint16_t service_id, const chromium::StringPiece& item_name, std::shared_ptr<item_t> item, void* data, size_t* length);
 		bool WriteRaw (const boost::posix_time::ptime& now, uint16_t rwf_version, int32_t token, uint16_t service_id, const chromium::StringPiece& item_name, const chromium::StringPiece& dacs_lock, std::shared_ptr<item_t> item, void* data, size_t* length);
 
-/* Mainloop procesing thread. */
-		std::unique_ptr<boost::thread> event_thread_;
+/* Mainloop procesing thread per provider. */
+		std::vector<std::unique_ptr<boost::thread>> event_threads_;
 
-/* Asynchronous shutdown notification mechanism. */
+/* Asynchronous shutdown notification mechanism, raised once every mainloop
+ * has returned.
+ */
 		boost::condition_variable mainloop_cond_;
 		boost::mutex mainloop_lock_;
+		size_t mainloop_count_;
 		bool mainloop_shutdown_;
 /* Flag to indicate Stop has be called and thus prohibit start of new provider. */
 		boost::atomic_bool shutting_down_;
@@ -104,15 +122,15 @@ namespace kigoron
 		config_t config_;
 /* UPA context. */
 		std::shared_ptr<upa_t> upa_;
-/* UPA provider */
-		std::shared_ptr<provider_t> provider_;	
+/* RDM field and enumerated type dictionaries. */
+		std::shared_ptr<dictionary_t> dictionary_;
+/* UPA providers, one per listener each with its own reactor thread. */
+		std::vector<std::shared_ptr<provider_t>> providers_;
 
-/* Symbol map. */
+/* Symbol map, read-only once initialized. */
 		boost::unordered_map<std::string, std::shared_ptr<item_t>> map_;
-/* As worker state: */
-/* Rssl message buffer */
-		char rssl_buf_[MAX_MSG_SIZE];
-		size_t rssl_length_;
+/* Each entry of the above once in load order, export cursors index into it. */
+		std::vector<std::shared_ptr<item_t>> items_;
 	};
 
 } /* namespace kigoron */
@@ -3,12 +3,21 @@
 
 #include "kigoron_http_server.hh"
 
-#include "chromium/json/json_writer.hh"
+#include <algorithm>
+
+/* Boost Atomics */
+#include <boost/atomic.hpp>
+
+#include "chromium/format_macros.hh"
+#include "chromium/json/json_stream_writer.hh"
 #include "chromium/logging.hh"
+#include "chromium/strings/string_number_conversions.hh"
+#include "chromium/strings/string_split.hh"
+#include "chromium/strings/string_util.hh"
 #include "chromium/strings/stringprintf.hh"
-#include "chromium/values.hh"
 #include "net/base/ip_endpoint.hh"
 #include "net/base/net_errors.hh"
+#include "net/http/http_util.hh"
 #include "net/server/http_server_response_info.hh"
 #include "net/socket/tcp_listen_socket.hh"
 #include "url/gurl.hh"
@@ -18,14 +27,230 @@ namespace {
 #include "index.html.h"
 #include "poll.js.h"
 
+// Initial capacity of the metrics output, sized for a few dozen clients.
+const size_t kMetricsBufferSize = 64 * 1024;
+
+const char* kTelemetryTopicNames[kigoron::TELEMETRY_TOPIC_MAX] = {
+  "info",
+  "counters",
+  "latency"
+};
+
+// Client sessions per /json/clients page.
+const unsigned kDefaultClientPageSize = 100;
+const unsigned kMaxClientPageSize = 1000;
+
+// Flight recorder events per /json/flight request.
+const unsigned kDefaultFlightEventCount = 1000;
+
+// Topics for a new subscriber until it selects its own.
+const unsigned kDefaultTelemetryTopics =
+    (1u << kigoron::TELEMETRY_TOPIC_INFO) | (1u << kigoron::TELEMETRY_TOPIC_COUNTERS);
+
+// Bulk lookup input per lookup thread task, and tasks outstanding before
+// reading of the request body pauses.
+const size_t kLookupBatchSize = 64 * 1024;
+const unsigned kMaxLookupBatchesInFlight = 4;
+// Results queued for a slow reader before reading of the request body pauses.
+const size_t kMaxLookupSendQueueSize = 1024 * 1024;
+// Longer keys are truncated and cannot match.
+const size_t kMaxLookupKeyLength = 256;
+
+// Export output per symbol thread task, and output queued before the next
+// task waits for the connection to drain.
+const size_t kExportPageSize = 64 * 1024;
+const size_t kMaxExportSendQueueSize = 256 * 1024;
+
+// Content codings of the built-in files, indexed by StaticAsset::Coding.
+const char* kContentCodings[] = {
+  "identity",
+  "gzip",
+  "br"
+};
+
+// Quality value of |coding| in an Accept-Encoding header, zero if refused or
+// not listed.
+double GetEncodingQuality(const std::string& accept_encoding, const char* coding) {
+  double wildcard_quality = 0.0;
+  net::HttpUtil::ValuesIterator values(accept_encoding.begin(), accept_encoding.end(), ',');
+  while (values.GetNext()) {
+    const std::string value = values.value();
+    const size_t params_pos = value.find(';');
+    std::string name;
+    chromium::TrimWhitespaceASCII(value.substr(0, params_pos), chromium::TRIM_ALL, &name);
+    double quality = 1.0;
+    if (params_pos != std::string::npos) {
+      std::string params;
+      chromium::TrimWhitespaceASCII(value.substr(params_pos + 1), chromium::TRIM_ALL, &params);
+      if (0 == params.find("q=") && !chromium::StringToDouble(params.substr(2), &quality))
+        quality = 0.0;
+    }
+    name = chromium::StringToLowerASCII(name);
+    if (name == coding)
+      return quality;
+    if (name == "*")
+      wildcard_quality = quality;
+  }
+  return wildcard_quality;
+}
+
+// If-None-Match uses the weak comparison, "*" matches any entity.
+bool MatchesEntityTag(const std::string& if_none_match, const std::string& etag) {
+  net::HttpUtil::ValuesIterator values(if_none_match.begin(), if_none_match.end(), ',');
+  while (values.GetNext()) {
+    std::string value = values.value();
+    if (value == "*")
+      return true;
+    if (0 == value.find("W/"))
+      value.erase(0, 2);
+    if (value == etag)
+      return true;
+  }
+  return false;
+}
+
+// Strips surrounding whitespace including the CR of CRLF line endings.
+chromium::StringPiece TrimLookupKey(chromium::StringPiece key) {
+  while (!key.empty() && IsAsciiWhitespace(key[0]))
+    key.remove_prefix(1);
+  while (!key.empty() && IsAsciiWhitespace(key[key.length() - 1]))
+    key.remove_suffix(1);
+  return key;
+}
+
 }  // namespace
 
-kigoron::ProviderInfo::ProviderInfo() : pid(0) {
+kigoron::ProviderIdentity::ProviderIdentity() : pid(0) {
+}
+
+kigoron::ProviderIdentity::~ProviderIdentity() {
+}
+
+kigoron::ProviderInfo::ProviderInfo() : client_count(0), msgs_received(0), msgs_received_rate(0.0) {
 }
 
 kigoron::ProviderInfo::~ProviderInfo() {
 }
 
+// Clients revalidate on every load, answered with a prepared 304 whilst
+// unchanged.
+struct kigoron::KigoronHttpServer::StaticAsset {
+	enum Coding {
+		CODING_IDENTITY,
+		CODING_GZIP,
+		CODING_BROTLI,
+		CODING_MAX
+	};
+
+	struct Representation {
+		chromium::StringPiece body;	/* empty if not built */
+		std::string etag;
+		std::string headers;		/* 200 */
+		std::string not_modified_headers;
+	};
+
+	StaticAsset (const char* content_type, const char* etag,
+		const unsigned char* identity, size_t identity_size,
+		const unsigned char* gzip, size_t gzip_size,
+		const unsigned char* brotli, size_t brotli_size);
+
+	Representation representations[CODING_MAX];
+};
+
+// The entity tag of each coding differs, as required of strong validators.
+kigoron::KigoronHttpServer::StaticAsset::StaticAsset (
+	const char* content_type,
+	const char* etag,
+	const unsigned char* identity,
+	size_t identity_size,
+	const unsigned char* gzip,
+	size_t gzip_size,
+	const unsigned char* brotli,
+	size_t brotli_size
+	)
+{
+	using chromium::StringAppendF;
+
+	representations[CODING_IDENTITY].body.set (reinterpret_cast<const char*> (identity), identity_size);
+	representations[CODING_GZIP].body.set (reinterpret_cast<const char*> (gzip), gzip_size);
+	representations[CODING_BROTLI].body.set (reinterpret_cast<const char*> (brotli), brotli_size);
+	for (unsigned coding = 0; coding < CODING_MAX; ++coding) {
+		Representation& representation = representations[coding];
+		if (representation.body.empty())
+			continue;
+		if (CODING_IDENTITY == coding)
+			StringAppendF (&representation.etag, "\"%s\"", etag);
+		else
+			StringAppendF (&representation.etag, "\"%s-%s\"", etag, kContentCodings[coding]);
+		StringAppendF (&representation.not_modified_headers,
+			"HTTP/1.1 304 Not Modified\r\n"
+			"ETag:%s\r\n"
+			"Cache-Control:no-cache\r\n"
+			"Vary:Accept-Encoding\r\n",
+			representation.etag.c_str());
+		StringAppendF (&representation.headers,
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type:%s\r\n"
+			"Content-Length:%" PRIuS "\r\n"
+			"ETag:%s\r\n"
+			"Cache-Control:no-cache\r\n"
+			"Vary:Accept-Encoding\r\n",
+			content_type, representation.body.length(), representation.etag.c_str());
+		if (CODING_IDENTITY != coding)
+			StringAppendF (&representation.headers, "Content-Encoding:%s\r\n", kContentCodings[coding]);
+	}
+}
+
+// Reactor thread state other than where noted.
+struct kigoron::KigoronHttpServer::LookupSession {
+	explicit LookupSession (int connection_id_)
+		: connection_id (connection_id_)
+		, is_discarding (false)
+		, batches_in_flight (0)
+		, is_paused (false)
+		, is_started (false)
+		, has_results (false)
+		, is_cancelled (false)
+	{
+	}
+
+	const int connection_id;
+// Complete lines awaiting dispatch, and the line in progress.
+	std::string batch;
+	std::string partial_line;
+// Remainder of an overlong line is skipped.
+	bool is_discarding;
+	unsigned batches_in_flight;
+	bool is_paused;
+// Symbol thread only, the array is open and a separator is due before the
+// next result.
+	bool is_started;
+	bool has_results;
+	boost::atomic_bool is_cancelled;
+};
+
+// Reactor thread state other than where noted.
+struct kigoron::KigoronHttpServer::ExportSession {
+	explicit ExportSession (int connection_id_, symbol_format_e format_)
+		: connection_id (connection_id_)
+		, format (format_)
+		, is_pending (false)
+		, cursor (0)
+		, is_started (false)
+		, is_cancelled (false)
+	{
+	}
+
+	const int connection_id;
+	const symbol_format_e format;
+// A page is being written, at most one at a time to keep output ordered.
+	bool is_pending;
+// Symbol thread only.
+	size_t cursor;
+	bool is_started;
+	boost::atomic_bool is_cancelled;
+};
+
 kigoron::KigoronHttpServer::KigoronHttpServer (
 	chromium::MessageLoopForIO* message_loop_for_io,
 	kigoron::KigoronHttpServer::Delegate* delegate
@@ -33,7 +258,17 @@ kigoron::KigoronHttpServer::KigoronHttpServer (
 	: port_ (0)
 	, message_loop_for_io_ (message_loop_for_io)
 	, delegate_ (delegate)
+	, telemetry_sequence_ (0)
 {
+	metrics_buffer_.reserve (kMetricsBufferSize);
+	discovery_page_.reset (new StaticAsset ("text/html; charset=UTF-8", WWW_INDEX_HTML_ETAG,
+		WWW_INDEX_HTML, WWW_INDEX_HTML_SIZE,
+		WWW_INDEX_HTML_GZ, WWW_INDEX_HTML_GZ_SIZE,
+		WWW_INDEX_HTML_BR, WWW_INDEX_HTML_BR_SIZE));
+	poll_script_.reset (new StaticAsset ("application/javascript; charset=UTF-8", WWW_POLL_JS_ETAG,
+		WWW_POLL_JS, WWW_POLL_JS_SIZE,
+		WWW_POLL_JS_GZ, WWW_POLL_JS_GZ_SIZE,
+		WWW_POLL_JS_BR, WWW_POLL_JS_BR_SIZE));
 }
 
 kigoron::KigoronHttpServer::~KigoronHttpServer()
@@ -70,9 +305,82 @@ kigoron::KigoronHttpServer::Shutdown()
 	if (!(bool)server_)
 		return;
 
+	subscribers_.clear();
+	broadcasts_.clear();
+// Queued batches and pages hold their session.
+	if ((bool)symbol_thread_)
+		symbol_thread_->Stop();
+	symbol_thread_.reset();
+	lookups_.clear();
+	exports_.clear();
 	server_.reset();
 }
 
+void
+kigoron::KigoronHttpServer::CloseIdleConnections()
+{
+	if ((bool)server_)
+		server_->CloseIdleConnections();
+}
+
+void
+kigoron::KigoronHttpServer::PublishTelemetry()
+{
+	if (!(bool)server_ || subscribers_.empty())
+		return;
+
+	unsigned all_topics = 0;
+	for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it)
+		all_topics |= it->second;
+	if (0 == all_topics)
+		return;
+
+// Each topic is created and serialized once regardless of subscriber count.
+	std::string* fragments = telemetry_fragments_;
+	for (unsigned topic = 0; topic < TELEMETRY_TOPIC_MAX; ++topic) {
+		fragments[topic].clear();
+		if (0 == (all_topics & (1u << topic)))
+			continue;
+		chromium::JSONStreamWriter writer (&fragments[topic]);
+		if (TELEMETRY_TOPIC_INFO == topic)
+			WriteInfo (&writer);
+		else
+			delegate_->CreateTelemetry (static_cast<telemetry_topic_e> (topic), &writer);
+	}
+
+// Frames are assembled and compressed once per distinct topic selection.
+	++telemetry_sequence_;
+	std::map<unsigned, std::vector<int>> recipients;
+	for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+		if (0 != it->second)
+			recipients[it->second].push_back (it->first);
+	}
+	std::string frame;
+	for (auto it = recipients.begin(); it != recipients.end(); ++it) {
+		const unsigned topics = it->first;
+		frame.clear();
+		chromium::StringAppendF (&frame, "{\"seq\":%llu", static_cast<unsigned long long> (telemetry_sequence_));
+		for (unsigned topic = 0; topic < TELEMETRY_TOPIC_MAX; ++topic) {
+			if (0 == (topics & (1u << topic)))
+				continue;
+			chromium::StringAppendF (&frame, ",\"%s\":", kTelemetryTopicNames[topic]);
+			frame.append (fragments[topic]);
+		}
+		frame.push_back ('}');
+		std::unique_ptr<net::WebSocketBroadcast>& broadcast = broadcasts_[topics];
+		if (!(bool)broadcast)
+			broadcast.reset (new net::WebSocketBroadcast());
+		server_->BroadcastOverWebSocket (broadcast.get(), it->second, frame);
+	}
+// Contexts of abandoned selections are released.
+	for (auto it = broadcasts_.begin(); it != broadcasts_.end();) {
+		if (0 == recipients.count (it->first))
+			it = broadcasts_.erase (it);
+		else
+			++it;
+	}
+}
+
 void
 kigoron::KigoronHttpServer::OnHttpRequest (
 	int connection_id,
@@ -80,17 +388,29 @@ kigoron::KigoronHttpServer::OnHttpRequest (
 	)
 {
 	VLOG(1) << "Processing HTTP request: " << info.path;
+	if (IsStreamingRequest (info)) {
+		OnLookupRequestUI (connection_id);
+		return;
+	}
+	if (info.path == "/csv/export") {
+		OnExportRequestUI (connection_id, SYMBOL_FORMAT_CSV);
+		return;
+	}
 	if (0 == info.path.find ("/json")) {
 		OnJsonRequestUI (connection_id, info);
 		return;
 	}
 
 	if (info.path == "" || info.path == "/") {
-		OnDiscoveryPageRequestUI (connection_id);
+		OnStaticAssetRequestUI (connection_id, info, *discovery_page_);
 		return;
 	}
 	if (info.path == "/poll.js") {
-		OnPollScriptRequestUI (connection_id);
+		OnStaticAssetRequestUI (connection_id, info, *poll_script_);
+		return;
+	}
+	if (info.path == "/metrics") {
+		OnMetricsRequestUI (connection_id);
 		return;
 	}
 
@@ -109,6 +429,7 @@ kigoron::KigoronHttpServer::OnWebSocketRequest (
 	)
 {
 	server_->AcceptWebSocket(connection_id, info);
+	subscribers_[connection_id] = kDefaultTelemetryTopics;
 }
 
 void
@@ -117,26 +438,311 @@ kigoron::KigoronHttpServer::OnWebSocketMessage (
 	const std::string& data
 	)
 {
-	std::string response;
+// Messages select topics, telemetry is pushed on the publishing interval.
+	auto it = subscribers_.find (connection_id);
+	if (subscribers_.end() == it)
+		return;
+	it->second = ParseTelemetryTopics (data);
+}
 
-	std::shared_ptr<chromium::DictionaryValue> dict(new chromium::DictionaryValue);
-	ProviderInfo info;
-	delegate_->CreateInfo (&info);
-	dict->SetString("hostname", info.hostname);
-	dict->SetString("username", info.username);
-	dict->SetInteger("pid", info.pid);
-	dict->SetInteger("clients", info.client_count);
-	dict->SetInteger("msgs", info.msgs_received);
-	chromium::JSONWriter::Write(dict.get(), &response);
+void
+kigoron::KigoronHttpServer::OnClose (
+	int connection_id
+	)
+{
+	subscribers_.erase (connection_id);
+	auto it = lookups_.find (connection_id);
+	if (lookups_.end() != it) {
+		it->second->is_cancelled = true;
+		lookups_.erase (it);
+	}
+	auto export_it = exports_.find (connection_id);
+	if (exports_.end() != export_it) {
+		export_it->second->is_cancelled = true;
+		exports_.erase (export_it);
+	}
+}
+
+kigoron::worker_thread_t*
+kigoron::KigoronHttpServer::symbol_thread()
+{
+	if (!(bool)symbol_thread_) {
+		symbol_thread_.reset (new worker_thread_t());
+		symbol_thread_->Start();
+	}
+	return symbol_thread_.get();
+}
 
-	server_->SendOverWebSocket(connection_id, response);
+bool
+kigoron::KigoronHttpServer::IsStreamingRequest (
+	const net::HttpServerRequestInfo& info
+	)
+{
+	return info.method == "POST" && info.path == "/json/lookup";
 }
 
+// Results stream as a chunked JSON array in input order, e.g.
+// [{"key":"ISIN=GB00BH4HKS39","item":{"ric":"VOD.L",...}},{"key":"RIC=X","item":null}]
 void
-kigoron::KigoronHttpServer::OnClose (
+kigoron::KigoronHttpServer::OnLookupRequestUI (
 	int connection_id
 	)
 {
+	lookups_[connection_id] = std::make_shared<LookupSession> (connection_id);
+	net::HttpServerResponseInfo response (net::HTTP_OK);
+	response.AddHeader ("Content-Type", "application/json; charset=UTF-8");
+	server_->SendChunkedHeaders (connection_id, response);
+}
+
+// Lines are batched as received, a key split between reads is carried over.
+void
+kigoron::KigoronHttpServer::OnHttpRequestData (
+	int connection_id,
+	const chromium::StringPiece& data,
+	bool is_complete
+	)
+{
+	auto it = lookups_.find (connection_id);
+	if (lookups_.end() == it)
+		return;
+	std::shared_ptr<LookupSession> session = it->second;
+	chromium::StringPiece remaining (data);
+	while (!remaining.empty()) {
+		const size_t eol = remaining.find ('\n');
+		const chromium::StringPiece line = remaining.substr (0, eol);
+		if (!session->is_discarding) {
+			const size_t length = std::min (line.length(), kMaxLookupKeyLength + 1 - session->partial_line.length());
+			session->partial_line.append (line.data(), length);
+			session->is_discarding = session->partial_line.length() > kMaxLookupKeyLength;
+		}
+		if (chromium::StringPiece::npos == eol)
+			break;
+		session->partial_line.push_back ('\n');
+		session->batch.append (session->partial_line);
+		session->partial_line.clear();
+		session->is_discarding = false;
+		remaining.remove_prefix (eol + 1);
+		if (session->batch.length() >= kLookupBatchSize)
+			DispatchLookupBatch (session, false);
+	}
+	if (is_complete) {
+		if (!session->partial_line.empty()) {
+			session->batch.append (session->partial_line);
+			session->partial_line.clear();
+		}
+		DispatchLookupBatch (session, true);
+		return;
+	}
+	if (!session->is_paused &&
+		(session->batches_in_flight >= kMaxLookupBatchesInFlight ||
+		 server_->GetSendQueueSize (connection_id) >= kMaxLookupSendQueueSize))
+	{
+		session->is_paused = true;
+		server_->PauseRequestData (connection_id);
+	}
+}
+
+void
+kigoron::KigoronHttpServer::DispatchLookupBatch (
+	const std::shared_ptr<LookupSession>& session,
+	bool is_last
+	)
+{
+	auto input = std::make_shared<std::string> ();
+	input->swap (session->batch);
+	++session->batches_in_flight;
+	Delegate* delegate = delegate_;
+	chromium::MessageLoopForIO* message_loop = message_loop_for_io_;
+	std::weak_ptr<LookupSession> weak_session (session);
+	symbol_thread()->PostTask ([this, delegate, message_loop, session, weak_session, input, is_last]() {
+		auto results = std::make_shared<std::string> ();
+		if (!session->is_cancelled) {
+			std::string key;
+			results->reserve (input->length() * 4);
+			if (!session->is_started) {
+				results->push_back ('[');
+				session->is_started = true;
+			}
+			chromium::StringPiece remaining (*input);
+			while (!remaining.empty()) {
+				const size_t eol = remaining.find ('\n');
+				const chromium::StringPiece line = TrimLookupKey (remaining.substr (0, eol));
+				remaining.remove_prefix ((chromium::StringPiece::npos == eol) ? remaining.length() : eol + 1);
+				if (line.empty())
+					continue;
+				line.CopyToString (&key);
+				if (session->has_results)
+					results->push_back (',');
+				session->has_results = true;
+				chromium::JSONStreamWriter writer (results.get());
+				writer.BeginObject();
+				writer.Key ("key");
+				writer.String (key);
+				writer.Key ("item");
+				if (!delegate->CreateSymbol (key, &writer))
+					writer.Null();
+				writer.EndObject();
+			}
+			if (is_last)
+				results->push_back (']');
+		}
+// Completion on the reactor thread, the session is gone if the connection closed.
+		const int connection_id = session->connection_id;
+		message_loop->PostTask ([this, weak_session, connection_id, results, is_last]() {
+			auto session = weak_session.lock();
+			if (!(bool)session || session->is_cancelled)
+				return;
+			OnLookupBatchResolved (connection_id, *results, is_last);
+		});
+	});
+}
+
+void
+kigoron::KigoronHttpServer::OnLookupBatchResolved (
+	int connection_id,
+	const std::string& results,
+	bool is_last
+	)
+{
+	auto it = lookups_.find (connection_id);
+	if (lookups_.end() == it)
+		return;
+	std::shared_ptr<LookupSession> session = it->second;
+	--session->batches_in_flight;
+	if (is_last) {
+		lookups_.erase (it);
+		server_->SendLastChunk (connection_id, results);
+		return;
+	}
+	server_->SendChunk (connection_id, results);
+	ResumeLookupIfReady (session.get());
+}
+
+void
+kigoron::KigoronHttpServer::OnSendQueueDrained (
+	int connection_id
+	)
+{
+	auto it = lookups_.find (connection_id);
+	if (lookups_.end() != it) {
+		ResumeLookupIfReady (it->second.get());
+		return;
+	}
+	auto export_it = exports_.find (connection_id);
+	if (exports_.end() != export_it && !export_it->second->is_pending)
+		DispatchExportPage (export_it->second);
+}
+
+void
+kigoron::KigoronHttpServer::ResumeLookupIfReady (
+	LookupSession* session
+	)
+{
+	if (!session->is_paused ||
+		session->batches_in_flight >= kMaxLookupBatchesInFlight ||
+		server_->GetSendQueueSize (session->connection_id) >= kMaxLookupSendQueueSize)
+	{
+		return;
+	}
+	session->is_paused = false;
+// May deliver buffered data immediately.
+	server_->ResumeRequestData (session->connection_id);
+}
+
+// Every entry once in load order as a chunked JSON array of the objects
+// returned by /json/lookup, or as CSV with a header row.  Only one page is
+// held in memory beyond the connection send queue.
+void
+kigoron::KigoronHttpServer::OnExportRequestUI (
+	int connection_id,
+	symbol_format_e format
+	)
+{
+	auto session = std::make_shared<ExportSession> (connection_id, format);
+	exports_[connection_id] = session;
+	net::HttpServerResponseInfo response (net::HTTP_OK);
+	if (SYMBOL_FORMAT_CSV == format)
+		response.AddHeader ("Content-Type", "text/csv; charset=UTF-8; header=present");
+	else
+		response.AddHeader ("Content-Type", "application/json; charset=UTF-8");
+	server_->SendChunkedHeaders (connection_id, response);
+	DispatchExportPage (session);
+}
+
+void
+kigoron::KigoronHttpServer::DispatchExportPage (
+	const std::shared_ptr<ExportSession>& session
+	)
+{
+	DCHECK(!session->is_pending);
+	session->is_pending = true;
+	Delegate* delegate = delegate_;
+	chromium::MessageLoopForIO* message_loop = message_loop_for_io_;
+	std::weak_ptr<ExportSession> weak_session (session);
+	symbol_thread()->PostTask ([this, delegate, message_loop, session, weak_session]() {
+		if (session->is_cancelled)
+			return;
+		auto output = std::make_shared<std::string> ();
+		output->reserve (kExportPageSize + 1024);
+		const bool is_json = (SYMBOL_FORMAT_JSON == session->format);
+		if (is_json && !session->is_started)
+			output->push_back ('[');
+		session->is_started = true;
+		const bool is_last = !delegate->CreateSymbols (session->format, &session->cursor, kExportPageSize, output.get());
+		if (is_json && is_last)
+			output->push_back (']');
+// Completion on the reactor thread, the session is gone if the connection closed.
+		const int connection_id = session->connection_id;
+		message_loop->PostTask ([this, weak_session, connection_id, output, is_last]() {
+			auto session = weak_session.lock();
+			if (!(bool)session || session->is_cancelled)
+				return;
+			OnExportPageWritten (connection_id, *output, is_last);
+		});
+	});
+}
+
+// The next page is written whilst this one is sent unless the reader is
+// slow, then it waits for the send queue to drain.
+void
+kigoron::KigoronHttpServer::OnExportPageWritten (
+	int connection_id,
+	const std::string& output,
+	bool is_last
+	)
+{
+	auto it = exports_.find (connection_id);
+	if (exports_.end() == it)
+		return;
+	std::shared_ptr<ExportSession> session = it->second;
+	session->is_pending = false;
+	if (is_last) {
+		exports_.erase (it);
+		server_->SendLastChunk (connection_id, output);
+		return;
+	}
+	server_->SendChunk (connection_id, output);
+	if (server_->GetSendQueueSize (connection_id) < kMaxExportSendQueueSize)
+		DispatchExportPage (session);
+}
+
+// Comma separated topic names, e.g. "info,latency".  An empty selection
+// pauses the subscription, unknown names are ignored.
+unsigned
+kigoron::KigoronHttpServer::ParseTelemetryTopics (
+	const std::string& data
+	)
+{
+	std::vector<std::string> names;
+	chromium::SplitString (data, ',', &names);
+	unsigned topics = 0;
+	for (auto it = names.begin(); it != names.end(); ++it) {
+		for (unsigned topic = 0; topic < TELEMETRY_TOPIC_MAX; ++topic) {
+			if (*it == kTelemetryTopicNames[topic])
+				topics |= 1u << topic;
+		}
+	}
+	return topics;
 }
 
 static bool ParseJsonPath(
@@ -161,6 +767,23 @@ static bool ParseJsonPath(
   return true;
 }
 
+// Finds |name| in an application/x-www-form-urlencoded query.
+static bool GetQueryValue(
+    const std::string& query,
+    const std::string& name,
+    std::string* value) {
+  std::vector<std::string> pairs;
+  chromium::SplitString(query, '&', &pairs);
+  for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+    size_t equals_pos = it->find('=');
+    if (it->substr(0, equals_pos) != name)
+      continue;
+    *value = (equals_pos == std::string::npos) ? std::string() : it->substr(equals_pos + 1);
+    return true;
+  }
+  return false;
+}
+
 void
 kigoron::KigoronHttpServer::OnJsonRequestUI (
 	int connection_id,
@@ -184,89 +807,191 @@ kigoron::KigoronHttpServer::OnJsonRequestUI (
 	std::string command;
 	std::string target_id;
 	if (!ParseJsonPath(path, &command, &target_id)) {
-		SendJson(connection_id, net::HTTP_NOT_FOUND, nullptr, "Malformed query: " + info.path);
+		SendJsonError(connection_id, net::HTTP_NOT_FOUND, "Malformed query: " + info.path);
 		return;
 	}
 
+	json_buffer_.clear();
+	chromium::JSONStreamWriter writer (&json_buffer_);
+
 	if ("info" == command) {
-		chromium::DictionaryValue dict;
-		ProviderInfo info;
-		delegate_->CreateInfo (&info);
-		dict.SetString("hostname", info.hostname);
-		dict.SetString("username", info.username);
-		dict.SetInteger("pid", info.pid);
-		dict.SetInteger("clients", info.client_count);
-		dict.SetInteger("msgs", info.msgs_received);
-		SendJson(connection_id, net::HTTP_OK, &dict, std::string());
+		WriteInfo (&writer);
+		SendJson(connection_id, net::HTTP_OK);
+		return;
+	}
+
+	if ("latency" == command) {
+		delegate_->CreateLatency (query == "cumulative", &writer);
+		SendJson(connection_id, net::HTTP_OK);
+		return;
+	}
+
+// /json/clients?after=<id>&limit=<n> or /json/clients/<id>
+	if ("clients" == command) {
+		if (!target_id.empty()) {
+			uint64_t id;
+			if (!chromium::StringToUint64(target_id, &id) || !delegate_->CreateClient (id, &writer)) {
+				SendJsonError(connection_id, net::HTTP_NOT_FOUND, "Unknown client: " + target_id);
+				return;
+			}
+			SendJson(connection_id, net::HTTP_OK);
+			return;
+		}
+		std::string value;
+		uint64_t after_id = 0;
+		unsigned limit = kDefaultClientPageSize;
+		if (GetQueryValue(query, "after", &value) && !chromium::StringToUint64(value, &after_id)) {
+			SendJsonError(connection_id, net::HTTP_BAD_REQUEST, "Malformed query: " + info.path);
+			return;
+		}
+		if (GetQueryValue(query, "limit", &value) && (!chromium::StringToUint(value, &limit) || 0 == limit)) {
+			SendJsonError(connection_id, net::HTTP_BAD_REQUEST, "Malformed query: " + info.path);
+			return;
+		}
+		if (limit > kMaxClientPageSize)
+			limit = kMaxClientPageSize;
+		delegate_->CreateClients (after_id, limit, &writer);
+		SendJson(connection_id, net::HTTP_OK);
+		return;
+	}
+
+// /json/export
+	if ("export" == command) {
+		OnExportRequestUI (connection_id, SYMBOL_FORMAT_JSON);
+		return;
 	}
 
-	SendJson(connection_id, net::HTTP_NOT_FOUND, nullptr, "Unknown command: " + command);
+// POST /json/flight/dump
+	if ("flight" == command && "dump" == target_id) {
+		if (info.method != "POST") {
+			SendJsonError(connection_id, net::HTTP_METHOD_NOT_ALLOWED, "Method not allowed: " + info.method);
+			return;
+		}
+		delegate_->RequestFlightRecorderDump();
+		writer.String ("Flight recorder dump requested.");
+		SendJson(connection_id, net::HTTP_ACCEPTED);
+		return;
+	}
+
+// /json/flight?limit=<n>
+	if ("flight" == command) {
+		std::string value;
+		unsigned limit = kDefaultFlightEventCount;
+		if (GetQueryValue(query, "limit", &value) && !chromium::StringToUint(value, &limit)) {
+			SendJsonError(connection_id, net::HTTP_BAD_REQUEST, "Malformed query: " + info.path);
+			return;
+		}
+		delegate_->CreateFlightRecorder (limit, &writer);
+		SendJson(connection_id, net::HTTP_OK);
+		return;
+	}
+
+	SendJsonError(connection_id, net::HTTP_NOT_FOUND, "Unknown command: " + command);
 }
 
+// Most preferred coding available, brotli on a tie, and a bodyless 304 if the
+// client already holds it.  Provider details are filled in by the first
+// telemetry frame.
 void
-kigoron::KigoronHttpServer::OnDiscoveryPageRequestUI (
-	int connection_id
+kigoron::KigoronHttpServer::OnStaticAssetRequestUI (
+	int connection_id,
+	const net::HttpServerRequestInfo& info,
+	const StaticAsset& asset
 	)
 {
-	std::string response = GetDiscoveryPageHTML();
-	server_->Send200(connection_id, response, "text/html; charset=UTF-8");
+	const StaticAsset::Representation* selected = &asset.representations[StaticAsset::CODING_IDENTITY];
+	if (info.HasHeader ("accept-encoding")) {
+		const std::string accept_encoding = info.GetHeaderValue ("accept-encoding");
+		double selected_quality = 0.0;
+		for (unsigned coding = StaticAsset::CODING_GZIP; coding < StaticAsset::CODING_MAX; ++coding) {
+			const StaticAsset::Representation& representation = asset.representations[coding];
+			if (representation.body.empty())
+				continue;
+			const double quality = GetEncodingQuality (accept_encoding, kContentCodings[coding]);
+			if (quality > 0.0 && quality >= selected_quality) {
+				selected = &representation;
+				selected_quality = quality;
+			}
+		}
+	}
+	if (info.HasHeader ("if-none-match") &&
+		MatchesEntityTag (info.GetHeaderValue ("if-none-match"), selected->etag))
+	{
+		server_->SendPreparedResponse (connection_id, selected->not_modified_headers, chromium::StringPiece());
+		return;
+	}
+	server_->SendPreparedResponse (connection_id, selected->headers, selected->body);
 }
 
 void
-kigoron::KigoronHttpServer::OnPollScriptRequestUI (
+kigoron::KigoronHttpServer::OnMetricsRequestUI (
 	int connection_id
 	)
 {
-	std::string response = GetPollScriptJS();
-	server_->Send200(connection_id, response, "application/json; charset=UTF-8");
+	using chromium::StringAppendF;
+
+	metrics_buffer_.clear();
+	delegate_->WriteMetrics (&metrics_buffer_);
+
+/* HTTP connection reuse */
+	const net::HttpServer::ConnectionStats& stats = server_->stats();
+	StringAppendF (&metrics_buffer_, "# TYPE kigoron_http_connections gauge\nkigoron_http_connections %" PRIuS "\n", server_->connection_count());
+	StringAppendF (&metrics_buffer_, "# TYPE kigoron_http_connections_total counter\nkigoron_http_connections_total %" PRIu64 "\n", stats.connections);
+	StringAppendF (&metrics_buffer_, "# TYPE kigoron_http_requests_total counter\nkigoron_http_requests_total %" PRIu64 "\n", stats.requests);
+	StringAppendF (&metrics_buffer_, "# TYPE kigoron_http_reused_requests_total counter\nkigoron_http_reused_requests_total %" PRIu64 "\n", stats.reused_requests);
+	StringAppendF (&metrics_buffer_, "# TYPE kigoron_http_idle_timeouts_total counter\nkigoron_http_idle_timeouts_total %" PRIu64 "\n", stats.idle_timeouts);
+// Headers are formatted beside the body such that neither is copied again.
+	metrics_headers_.clear();
+	StringAppendF (&metrics_headers_,
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type:text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Content-Length:%" PRIuS "\r\n",
+		metrics_buffer_.length());
+	server_->SendPreparedResponse (connection_id, metrics_headers_, metrics_buffer_);
+}
+
+// Splices the dynamic counters after the pre-serialized identity.
+void
+kigoron::KigoronHttpServer::WriteInfo (
+	chromium::JSONStreamWriter* writer
+	)
+{
+	ProviderInfo info;
+	delegate_->CreateInfo (&info);
+	writer->BeginObject();
+	writer->RawMembers (delegate_->identity().json);
+	writer->Key ("clients");
+	writer->Uint64 (info.client_count);
+	writer->Key ("msgs");
+	writer->Uint64 (info.msgs_received);
+	writer->Key ("msgs_rate");
+	writer->Double (info.msgs_received_rate);
+	writer->EndObject();
 }
 
 void
 kigoron::KigoronHttpServer::SendJson (
 	int connection_id,
-	net::HttpStatusCode status_code,
-	chromium::Value* value,
-	const std::string& message
+	net::HttpStatusCode status_code
 	)
 {
-// Serialize value and message.
-	std::string json_value;
-	if (value) {
-		chromium::JSONWriter::WriteWithOptions(value,
-			chromium::JSONWriter::OPTIONS_PRETTY_PRINT,
-			&json_value);
-	}
-	std::string json_message;
-	std::shared_ptr<chromium::Value> message_object(new chromium::StringValue(message));
-	chromium::JSONWriter::Write(message_object.get(), &json_message);
-
+	DCHECK(!json_buffer_.empty());
 	net::HttpServerResponseInfo response(status_code);
-	response.SetBody(json_value + message, "application/json; charset=UTF-8");
+	response.SetBody(json_buffer_, "application/json; charset=UTF-8");
 	server_->SendResponse(connection_id, response);
 }
 
-#include "chromium/strings/string_util.hh"
-
-std::string
-kigoron::KigoronHttpServer::GetDiscoveryPageHTML() const
-{
-	ProviderInfo info;
-	delegate_->CreateInfo (&info);
-
-	std::string response (WWW_INDEX_HTML);
-	ReplaceFirstSubstringAfterOffset (&response, 0, "%HOSTNAME%", info.hostname);
-	ReplaceFirstSubstringAfterOffset (&response, 0, "%USERNAME%", info.username);
-	ReplaceFirstSubstringAfterOffset (&response, 0, "%PID%", std::to_string (info.pid));
-	ReplaceFirstSubstringAfterOffset (&response, 0, "%CLIENTS%", std::to_string (info.client_count));
-	ReplaceFirstSubstringAfterOffset (&response, 0, "%MSGS%", std::to_string (info.msgs_received));
-
-	return response;
-}
-
-std::string
-kigoron::KigoronHttpServer::GetPollScriptJS() const
+void
+kigoron::KigoronHttpServer::SendJsonError (
+	int connection_id,
+	net::HttpStatusCode status_code,
+	const std::string& message
+	)
 {
-	return std::string (WWW_POLL_JS);
+	json_buffer_.clear();
+	chromium::JSONStreamWriter writer (&json_buffer_);
+	writer.String (message);
+	SendJson(connection_id, status_code);
 }
 
 /* eof */
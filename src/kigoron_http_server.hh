@@ -8,14 +8,17 @@
 #	include <winsock2.h>
 #endif
 
+#include <map>
 #include <string>
 #include <memory>
 #include <vector>
 
 #include "chromium/basictypes.hh"
-#include "chromium/values.hh"
+#include "chromium/json/json_stream_writer.hh"
 #include "net/server/http_server.hh"
 #include "net/server/http_server_request_info.hh"
+#include "net/server/web_socket.hh"
+#include "worker_thread.hh"
 
 #ifdef _WIN32           
 #	define in_port_t	uint16_t
@@ -28,15 +31,39 @@ namespace kigoron
 // temporary integration until message loop is available.
 	class provider_t;
 
-	struct ProviderInfo {
-		ProviderInfo();
-		~ProviderInfo();
+// Fixed for the process lifetime.
+	struct ProviderIdentity {
+		ProviderIdentity();
+		~ProviderIdentity();
 
 		std::string hostname;
 		std::string username;
 		int pid;
+		std::string json;	/* above as JSON object members without braces */
+	};
+
+	struct ProviderInfo {
+		ProviderInfo();
+		~ProviderInfo();
+
 		unsigned client_count;	/* all RSSL port connections, active or not */
-		unsigned msgs_received; /* all message types including metadata */
+		uint64_t msgs_received; /* all message types including metadata */
+		double msgs_received_rate;	/* per second over the last snapshot interval */
+	};
+
+// Telemetry topics selectable per WebSocket subscriber.
+	enum telemetry_topic_e {
+		TELEMETRY_TOPIC_INFO,
+		TELEMETRY_TOPIC_COUNTERS,
+		TELEMETRY_TOPIC_LATENCY,
+// marker
+		TELEMETRY_TOPIC_MAX
+	};
+
+// Representations of the symbol store export.
+	enum symbol_format_e {
+		SYMBOL_FORMAT_JSON,
+		SYMBOL_FORMAT_CSV
 	};
 
 	class KigoronHttpServer
@@ -44,11 +71,41 @@ namespace kigoron
 	{
 	public:
 
+// Called on the HTTP thread, provider state is read from snapshots published
+// by the reactor rather than live session tables.
 		class Delegate {
 		public:
 			virtual ~Delegate() {}
 
+			virtual const ProviderIdentity& identity() const = 0;
+// Dynamic provider state, must not block.
 			virtual void CreateInfo(ProviderInfo* info) = 0;
+// Writers receive exactly one JSON value per call.
+// Latency histograms since the previous call, or since startup if cumulative.
+			virtual void CreateLatency(bool is_cumulative, chromium::JSONStreamWriter* writer) = 0;
+// Appends metrics in Prometheus text exposition format.
+			virtual void WriteMetrics(std::string* buffer) = 0;
+// Content of one telemetry topic for the current interval, called at most
+// once per topic per published frame.  The info topic is written by the
+// server itself.
+			virtual void CreateTelemetry(telemetry_topic_e topic, chromium::JSONStreamWriter* writer) = 0;
+// Page of up to |limit| client sessions with ids greater than |after_id|.
+			virtual void CreateClients(uint64_t after_id, unsigned limit, chromium::JSONStreamWriter* writer) = 0;
+// Single client session, returns false without writing if the id is unknown.
+			virtual bool CreateClient(uint64_t id, chromium::JSONStreamWriter* writer) = 0;
+// Most recent |limit| flight recorder events.
+			virtual void CreateFlightRecorder(size_t limit, chromium::JSONStreamWriter* writer) = 0;
+// Flight recorder dump to file, written by the reactor on its next
+// iteration.
+			virtual void RequestFlightRecorderDump() = 0;
+// Symbol map entry for |key|, e.g. "ISIN=...", returns false without writing
+// if unknown.  Called from the symbol thread.
+			virtual bool CreateSymbol(const std::string& key, chromium::JSONStreamWriter* writer) = 0;
+// Appends symbol store entries from |*cursor| until |output| reaches
+// |max_size|, returns false once the store is exhausted.  JSON entries are
+// comma separated objects, CSV records follow a header row.  Called from the
+// symbol thread.
+			virtual bool CreateSymbols(symbol_format_e format, size_t* cursor, size_t max_size, std::string* output) = 0;
 		};
 
 // Constructor doesn't start server.
@@ -63,21 +120,53 @@ namespace kigoron
 // Stops HTTP server.
 		void Shutdown();
 
+// Builds one telemetry frame per set of selected topics and sends it to every
+// WebSocket subscriber with that selection.
+		void PublishTelemetry();
+
+// Closes persistent HTTP connections left idle, call periodically.
+		void CloseIdleConnections();
+
 	private:
 // net::HttpServer::Delegate methods:
 		virtual void OnHttpRequest (int connection_id, const net::HttpServerRequestInfo& info) override;
+		virtual bool IsStreamingRequest (const net::HttpServerRequestInfo& info) override;
+		virtual void OnHttpRequestData (int connection_id, const chromium::StringPiece& data, bool is_complete) override;
+		virtual void OnSendQueueDrained (int connection_id) override;
 		virtual void OnWebSocketRequest(int connection_id, const net::HttpServerRequestInfo& info) override;
 		virtual void OnWebSocketMessage(int connection_id, const std::string& data) override;
 		virtual void OnClose(int connection_id) override;
 
 		void OnJsonRequestUI(int connection_id, const net::HttpServerRequestInfo& info);
-		void OnDiscoveryPageRequestUI(int connection_id);
-		void OnPollScriptRequestUI(int connection_id);
-
-		void SendJson(int connection_id, net::HttpStatusCode status_code, chromium::Value* value, const std::string& message);
-
-		std::string GetDiscoveryPageHTML() const;
-		std::string GetPollScriptJS() const;
+// Built-in dashboard files, precompressed and with responses rendered once.
+		struct StaticAsset;
+		void OnStaticAssetRequestUI(int connection_id, const net::HttpServerRequestInfo& info, const StaticAsset& asset);
+		void OnMetricsRequestUI(int connection_id);
+
+// Started on first use.
+		worker_thread_t* symbol_thread();
+
+// POST /json/lookup, newline separated keys resolved on |symbol_thread_|.
+		struct LookupSession;
+		void OnLookupRequestUI(int connection_id);
+		void DispatchLookupBatch(const std::shared_ptr<LookupSession>& session, bool is_last);
+		void OnLookupBatchResolved(int connection_id, const std::string& results, bool is_last);
+		void ResumeLookupIfReady(LookupSession* session);
+
+// GET /json/export or /csv/export, the whole symbol store written a page at a
+// time on |symbol_thread_| whilst the send queue is short.
+		struct ExportSession;
+		void OnExportRequestUI(int connection_id, symbol_format_e format);
+		void DispatchExportPage(const std::shared_ptr<ExportSession>& session);
+		void OnExportPageWritten(int connection_id, const std::string& output, bool is_last);
+
+		void WriteInfo(chromium::JSONStreamWriter* writer);
+// Sends |json_buffer_|.
+		void SendJson(int connection_id, net::HttpStatusCode status_code);
+// Sends |message| as a JSON string.
+		void SendJsonError(int connection_id, net::HttpStatusCode status_code, const std::string& message);
+
+		static unsigned ParseTelemetryTopics(const std::string& data);
 
 // Port for listening.
 		in_port_t port_;
@@ -89,6 +178,28 @@ namespace kigoron
 		chromium::MessageLoopForIO* message_loop_for_io_;
 
 		Delegate* delegate_;
+
+		std::unique_ptr<StaticAsset> discovery_page_;
+		std::unique_ptr<StaticAsset> poll_script_;
+
+// Metrics output reused between scrapes, capacity is retained.
+		std::string metrics_buffer_;
+		std::string metrics_headers_;
+// As above for JSON responses and telemetry topics.
+		std::string json_buffer_;
+		std::string telemetry_fragments_[TELEMETRY_TOPIC_MAX];
+
+// WebSocket subscribers and their topic bitmask, zero whilst paused.
+		std::map<int, unsigned> subscribers_;
+		uint64_t telemetry_sequence_;
+// Compression shared by the subscribers of each topic selection.
+		std::map<unsigned, std::unique_ptr<net::WebSocketBroadcast>> broadcasts_;
+
+// Bulk lookups and exports in progress by connection.
+		std::map<int, std::shared_ptr<LookupSession>> lookups_;
+		std::map<int, std::shared_ptr<ExportSession>> exports_;
+// Symbol store reads off the reactor thread.
+		std::unique_ptr<worker_thread_t> symbol_thread_;
 	};
 
 } /* namespace kigoron */
@@ -3,6 +3,10 @@
 
 #include "kigoron.hh"
 
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
 #include <windows.h>
 #include <mmsystem.h>
 #pragma comment (lib, "winmm")
@@ -10,31 +14,80 @@
 #include "chromium/chromium_switches.hh"
 #include "chromium/command_line.hh"
 #include "chromium/logging.hh"
+#include "chromium/strings/string_number_conversions.hh"
+#include "async_log.hh"
+
+namespace switches {
+
+//   Rotate log file when exceeding size in bytes, zero disables rotation.
+const char kLogFileSize[]		= "log-file-size";
 
+//   Number of rotated log files to keep.
+const char kLogFileCount[]		= "log-file-count";
+
+}  // namespace switches
 
 namespace { /* anonymous */
+
+static const uint64_t kDefaultLogFileSize	= 64 * 1024 * 1024;
+static const unsigned kDefaultLogFileCount	= 5;
 
 class env_t
 {
 public:
 	env_t (int argc, const char* argv[])
+		: is_valid_ (false)
 	{
 /* startup from clean string */
 		CommandLine::Init (argc, argv);
+		const CommandLine& command_line = *CommandLine::ForCurrentProcess();
 		std::string log_path = GetLogFileName();
+		logging::LoggingDestination log_mode = DetermineLogMode (command_line);
+		uint64_t log_file_size;
+		unsigned log_file_count;
+		if (!GetLogFileSize (command_line, &log_file_size) ||
+		    !GetLogFileCount (command_line, &log_file_count))
+			return;
+/* formatted messages are written by a background thread, fatal messages
+ * remain synchronous.
+ */
+		const bool is_file_logging = (logging::LOG_ONLY_TO_FILE == log_mode ||
+					      logging::LOG_TO_BOTH_FILE_AND_SYSTEM_DEBUG_LOG == log_mode);
+		async_log_.reset (new kigoron::async_log_t (is_file_logging ? log_path : std::string(),
+							   log_file_size,
+							   log_file_count,
+							   true /* stdout */));
+		const bool is_async = async_log_->Start();
+/* The asynchronous sink owns the file, a second handle without delete
+ * sharing would block rotation.
+ */
+		if (is_async && is_file_logging) {
+			log_mode = (logging::LOG_ONLY_TO_FILE == log_mode) ?
+				logging::LOG_NONE : logging::LOG_ONLY_TO_SYSTEM_DEBUG_LOG;
+		}
 /* forward onto logging */
 		logging::InitLogging(
 			log_path.c_str(),
-			DetermineLogMode (*CommandLine::ForCurrentProcess()),
+			log_mode,
 			logging::DONT_LOCK_LOG_FILE,
 			logging::APPEND_TO_OLD_LOG_FILE,
 			logging::ENABLE_DCHECK_FOR_NON_OFFICIAL_RELEASE_BUILDS
 			);
-		logging::SetLogMessageHandler (log_handler);
 		logging::SetLogItems (false, /* process id */
 				      false, /* thread id */
 				      true,  /* timestamp */
 				      true); /* tickcount */
+		if (is_async)
+			logging::SetLogMessageHandler (kigoron::async_log_t::log_handler);
+		else
+			logging::SetLogMessageHandler (log_handler);
+		is_valid_ = true;
+	}
+
+	~env_t()
+	{
+		if ((bool)async_log_)
+			async_log_->Stop();
 	}
 
 protected:
@@ -57,12 +110,45 @@ protected:
 		return log_mode;
 	}
 
+/* Logging is not yet initialized, errors go to stderr. */
+	bool GetLogFileSize (const CommandLine& command_line, uint64_t* log_file_size) {
+		*log_file_size = kDefaultLogFileSize;
+		if (!command_line.HasSwitch (switches::kLogFileSize))
+			return true;
+		const std::string value (command_line.GetSwitchValueASCII (switches::kLogFileSize));
+		if (!chromium::StringToUint64 (value, log_file_size)) {
+			fprintf (stderr, "Invalid log file size \"%s\".\n", value.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool GetLogFileCount (const CommandLine& command_line, unsigned* log_file_count) {
+		*log_file_count = kDefaultLogFileCount;
+		if (!command_line.HasSwitch (switches::kLogFileCount))
+			return true;
+		const std::string value (command_line.GetSwitchValueASCII (switches::kLogFileCount));
+		if (!chromium::StringToUint (value, log_file_count)) {
+			fprintf (stderr, "Invalid log file count \"%s\".\n", value.c_str());
+			return false;
+		}
+		return true;
+	}
+
 	static bool log_handler (int severity, const char* file, int line, size_t message_start, const std::string& str)
 	{
 		fprintf (stdout, "%s", str.c_str());
 		fflush (stdout);
 		return true;
 	}
+
+	std::unique_ptr<kigoron::async_log_t> async_log_;
+	bool is_valid_;
+
+public:
+	bool is_valid() const {
+		return is_valid_;
+	}
 };
 
 class timecaps_t
@@ -106,6 +192,8 @@ main (
 #endif
 
 	env_t env (argc, argv);
+	if (!env.is_valid())
+		return EXIT_FAILURE;
 	timecaps_t timecaps (1 /* ms */);
 
 	auto app = std::make_shared<kigoron::kigoron_t>();
@@ -1,12 +1,14 @@
 #ifndef CHROMIUM_MESSAGE_LOOP_HH_
 #define CHROMIUM_MESSAGE_LOOP_HH_
 
+#include <functional>
+
 #include "net/socket/socket_descriptor.hh"
 
 namespace kigoron
 {
 
-class provider_t;
+class io_thread_t;
 
 }
 
@@ -41,7 +43,7 @@ namespace chromium
 			bool StopWatchingFileDescriptor();
 
 		private:
-			friend class kigoron::provider_t;
+			friend class kigoron::io_thread_t;
 
 			typedef std::pair<net::SocketDescriptor, Mode> event;
 
@@ -52,18 +54,18 @@ namespace chromium
 // Used by MessagePumpLibevent to take ownership of event_.
 			event* ReleaseEvent();
 
-			void set_pump(kigoron::provider_t* pump) { pump_ = pump; }
-			kigoron::provider_t* pump() const { return pump_; }
+			void set_pump(kigoron::io_thread_t* pump) { pump_ = pump; }
+			kigoron::io_thread_t* pump() const { return pump_; }
 
 			void set_watcher(Watcher* watcher) { watcher_ = watcher; }
 
-			void OnFileCanReadWithoutBlocking(net::SocketDescriptor fd, kigoron::provider_t* pump);
-			void OnFileCanWriteWithoutBlocking(net::SocketDescriptor fd, kigoron::provider_t* pump);
+			void OnFileCanReadWithoutBlocking(net::SocketDescriptor fd, kigoron::io_thread_t* pump);
+			void OnFileCanWriteWithoutBlocking(net::SocketDescriptor fd, kigoron::io_thread_t* pump);
 
 /* pretend fd is a libevent event object */
 			event* event_;
 			Watcher* watcher_;
-			kigoron::provider_t* pump_;
+			kigoron::io_thread_t* pump_;
 			std::shared_ptr<FileDescriptorWatcher> weak_factory_;
 		};
 
@@ -74,6 +76,9 @@ namespace chromium
 		};
 
 		virtual bool WatchFileDescriptor (net::SocketDescriptor fd, bool persistent, Mode mode, FileDescriptorWatcher* controller, Watcher* delegate) = 0;
+
+// Runs |task| on the loop thread in order of posting, safe from any thread.
+		virtual void PostTask (std::function<void()> task) = 0;
 	};
 
 } /* namespace chromium */
@@ -4,6 +4,9 @@
 
 #include "net/server/http_connection.hh"
 
+#include <cstring>
+
+#include "chromium/logging.hh"
 #include "net/server/http_server.hh"
 #include "net/server/http_server_response_info.hh"
 #include "net/server/web_socket.hh"
@@ -25,6 +28,13 @@ void HttpConnection::Send(const char* bytes, int len) {
   socket_->Send(bytes, len);
 }
 
+void HttpConnection::SendBuffers(const chromium::StringPiece* buffers,
+                                 size_t count) {
+  if (!socket_.get())
+    return;
+  socket_->SendBuffers(buffers, count);
+}
+
 void HttpConnection::Send(const HttpServerResponseInfo& response) {
   Send(response.Serialize());
 }
@@ -35,6 +45,17 @@ HttpConnection::HttpConnection (
 	)
 	: server_ (server)
 	, socket_ (std::move (sock))
+	, is_response_pending_ (false)
+	, keep_alive_ (true)
+	, is_http10_ (false)
+	, is_closing_ (false)
+	, is_processing_ (false)
+	, is_chunked_ (false)
+	, is_body_streaming_ (false)
+	, is_body_paused_ (false)
+	, body_remaining_ (0)
+	, request_count_ (0)
+	, last_activity_ (chromium::TimeTicks::Now())
 {
   id_ = last_id_++;
 }
@@ -44,7 +65,42 @@ HttpConnection::~HttpConnection() {
 }
 
 void HttpConnection::Shift(int num_bytes) {
-  recv_data_ = recv_data_.substr(num_bytes);
+  DCHECK_GE(num_bytes, 0);
+  recv_buffer_.Consume(static_cast<size_t>(num_bytes));
+  parser_ = RequestParser();
+}
+
+HttpConnection::ReceiveBuffer::ReceiveBuffer()
+    : offset_(0) {
+}
+
+void HttpConnection::ReceiveBuffer::Append(const char* data, int len) {
+  if (offset_ > 0 && offset_ >= buffer_.size() / 2) {
+    const size_t remaining = buffer_.size() - offset_;
+    if (remaining > 0)
+      memmove(&buffer_[0], buffer_.data() + offset_, remaining);
+    buffer_.resize(remaining);
+    offset_ = 0;
+  }
+  buffer_.append(data, len);
+}
+
+void HttpConnection::ReceiveBuffer::Consume(size_t num_bytes) {
+  DCHECK_LE(num_bytes, length());
+  offset_ += num_bytes;
+  // Rewind once drained, nothing to move.
+  if (offset_ == buffer_.size()) {
+    buffer_.clear();
+    offset_ = 0;
+  }
+}
+
+// Starts in ST_METHOD.
+HttpConnection::RequestParser::RequestParser()
+    : state(0),
+      pos(0),
+      token_start(0),
+      header_length(0) {
 }
 
 }  // namespace net
@@ -5,10 +5,14 @@
 #ifndef NET_SERVER_HTTP_CONNECTION_HH_
 #define NET_SERVER_HTTP_CONNECTION_HH_
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "chromium/basictypes.hh"
+#include "chromium/strings/string_piece.hh"
+#include "chromium/time/time.hh"
 #include "net/http/http_status_code.hh"
 
 namespace net {
@@ -25,22 +29,95 @@ class HttpConnection {
   void Send(const std::string& data);
   void Send(const char* bytes, int len);
   void Send(const HttpServerResponseInfo& response);
+  // Segments sent with a single gather write.
+  void SendBuffers(const chromium::StringPiece* buffers, size_t count);
 
+  // Consumes |num_bytes| of received data and restarts request parsing.
   void Shift(int num_bytes);
 
-  const std::string& recv_data() const { return recv_data_; }
+  // Unconsumed received data, invalidated by the next read.
+  chromium::StringPiece recv_data() const { return recv_buffer_.data(); }
   int id() const { return id_; }
 
  private:
   friend class HttpServer;
   static int last_id_;
 
+  // Received bytes pending a parser.  Consuming advances a read offset, the
+  // storage is compacted on append only once the consumed prefix is at least
+  // half of it, so each byte is moved a bounded number of times however the
+  // requests are split across reads.
+  class ReceiveBuffer {
+   public:
+    ReceiveBuffer();
+
+    void Append(const char* data, int len);
+    void Consume(size_t num_bytes);
+
+    chromium::StringPiece data() const {
+      return chromium::StringPiece(buffer_.data() + offset_,
+                                   buffer_.size() - offset_);
+    }
+    size_t length() const { return buffer_.size() - offset_; }
+    bool empty() const { return buffer_.size() == offset_; }
+
+   private:
+    std::string buffer_;
+    size_t offset_;
+  };
+
+  // Request header parser state kept between reads so that each byte is
+  // scanned once, offsets are relative to the start of recv_data().
+  struct RequestParser {
+    struct Token {
+      Token() : offset(0), length(0) {}
+      size_t offset;
+      size_t length;
+    };
+
+    RequestParser();
+
+    int state;
+    // Next byte to scan.
+    size_t pos;
+    // First byte of the token for the current state.
+    size_t token_start;
+    // Length of the request head once complete, otherwise zero.
+    size_t header_length;
+    Token method;
+    Token url;
+    Token protocol;
+    Token name;
+    std::vector<std::pair<Token, Token> > headers;
+  };
+
   explicit HttpConnection (HttpServer* server, std::shared_ptr<StreamListenSocket> sock);
 
   HttpServer* server_;
   std::shared_ptr<StreamListenSocket> socket_;
   std::shared_ptr<WebSocket> web_socket_;
-  std::string recv_data_;
+  ReceiveBuffer recv_buffer_;
+  RequestParser parser_;
+  // A request awaits its response, pipelined requests behind it wait.
+  bool is_response_pending_;
+  // Whether the connection persists after the pending response.
+  bool keep_alive_;
+  bool is_http10_;
+  // Final response sent, further requests are ignored.
+  bool is_closing_;
+  // HttpServer::ProcessRequests is on the stack.
+  bool is_processing_;
+  // The pending response body is sent in chunks, headers not yet written
+  // are held in |chunked_headers_|.
+  bool is_chunked_;
+  std::string chunked_headers_;
+  // Body of a streaming request still being delivered, |body_remaining_|
+  // bytes yet to be received.
+  bool is_body_streaming_;
+  bool is_body_paused_;
+  uint64_t body_remaining_;
+  unsigned request_count_;
+  chromium::TimeTicks last_activity_;
   int id_;
 };
 
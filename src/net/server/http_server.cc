@@ -4,6 +4,8 @@
 
 #include "net/server/http_server.hh"
 
+#include <algorithm>
+
 #include "chromium/logging.hh"
 #include "chromium/stl_util.hh"
 #include "chromium/strings/string_number_conversions.hh"
@@ -18,10 +20,55 @@
 
 namespace net {
 
+namespace {
+
+const int kDefaultIdleTimeoutSeconds = 15;
+
+// Bounds the receive buffer while a request head is incomplete.
+const size_t kMaxHeadSize = 8 * 1024;
+
+// HTTP/1.1 connections persist unless the client opts out with
+// "Connection: close", HTTP/1.0 connections only if it opts in.
+bool IsKeepAlive(const HttpServerRequestInfo& request) {
+  if (request.HasHeaderValue("connection", "close"))
+    return false;
+  if (request.protocol == "HTTP/1.0")
+    return request.HasHeaderValue("connection", "keep-alive");
+  return true;
+}
+
+// Writes the chunk-size line for |size| to |line|, returns its length.
+size_t FormatChunkSize(size_t size, char* line) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  char digits[sizeof(size_t) * 2];
+  size_t count = 0;
+  do {
+    digits[count++] = kHexDigits[size & 0xf];
+    size >>= 4;
+  } while (size != 0);
+  size_t length = 0;
+  while (count > 0)
+    line[length++] = digits[--count];
+  line[length++] = '\r';
+  line[length++] = '\n';
+  return length;
+}
+
+}  // namespace
+
+HttpServer::ConnectionStats::ConnectionStats()
+    : connections(0),
+      requests(0),
+      reused_requests(0),
+      idle_timeouts(0) {
+}
+
 HttpServer::HttpServer(const StreamListenSocketFactory& factory,
                        HttpServer::Delegate* delegate)
     : delegate_(delegate),
-      server_(factory.CreateAndListen(this)) {
+      server_(factory.CreateAndListen(this)),
+      idle_timeout_(
+          chromium::TimeDelta::FromSeconds(kDefaultIdleTimeoutSeconds)) {
 }
 
 void HttpServer::AcceptWebSocket(
@@ -44,6 +91,22 @@ void HttpServer::SendOverWebSocket(int connection_id,
   connection->web_socket_->Send(data);
 }
 
+void HttpServer::BroadcastOverWebSocket(WebSocketBroadcast* broadcast,
+                                        const std::vector<int>& connection_ids,
+                                        const std::string& data) {
+  std::vector<WebSocket*> sockets;
+  sockets.reserve(connection_ids.size());
+  for (size_t i = 0; i < connection_ids.size(); ++i) {
+    HttpConnection* connection = FindConnection(connection_ids[i]);
+    if (connection == NULL)
+      continue;
+    DCHECK(connection->web_socket_.get());
+    sockets.push_back(connection->web_socket_.get());
+  }
+  if (!sockets.empty())
+    broadcast->Send(sockets, data);
+}
+
 void HttpServer::SendRaw(int connection_id, const std::string& data) {
   HttpConnection* connection = FindConnection(connection_id);
   if (connection == NULL)
@@ -56,7 +119,36 @@ void HttpServer::SendResponse(int connection_id,
   HttpConnection* connection = FindConnection(connection_id);
   if (connection == NULL)
     return;
-  connection->Send(response);
+  if (!connection->is_response_pending_) {
+    connection->Send(response);
+    return;
+  }
+  const char* persistence = "";
+  if (!connection->keep_alive_)
+    persistence = "Connection: close\r\n";
+  else if (connection->is_http10_)
+    persistence = "Connection: keep-alive\r\n";
+  const std::string headers = response.SerializeHeaders(persistence);
+  const chromium::StringPiece buffers[] = { headers, response.body() };
+  connection->SendBuffers(buffers, arraysize(buffers));
+  DidSendResponse(connection);
+}
+
+void HttpServer::SendPreparedResponse(int connection_id,
+                                      const chromium::StringPiece& headers,
+                                      const chromium::StringPiece& body) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL)
+    return;
+  const char* persistence = "";
+  if (!connection->keep_alive_)
+    persistence = "Connection: close\r\n";
+  else if (connection->is_http10_)
+    persistence = "Connection: keep-alive\r\n";
+  const chromium::StringPiece buffers[] = { headers, persistence, "\r\n", body };
+  connection->SendBuffers(buffers, arraysize(buffers));
+  if (connection->is_response_pending_)
+    DidSendResponse(connection);
 }
 
 void HttpServer::Send(int connection_id,
@@ -82,6 +174,108 @@ void HttpServer::Send500(int connection_id, const std::string& message) {
   SendResponse(connection_id, HttpServerResponseInfo::CreateFor500(message));
 }
 
+void HttpServer::SendChunkedHeaders(int connection_id,
+                                    const HttpServerResponseInfo& response) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL)
+    return;
+  DCHECK(connection->is_response_pending_);
+  DCHECK(!connection->is_chunked_);
+  DCHECK(response.body().empty());
+  if (!connection->is_response_pending_ || connection->is_chunked_)
+    return;
+  std::string extra_headers;
+  if (connection->is_http10_) {
+    // The body ends with the connection.
+    connection->keep_alive_ = false;
+    extra_headers = "Connection: close\r\n";
+  } else {
+    extra_headers = "Transfer-Encoding: chunked\r\n";
+    if (!connection->keep_alive_)
+      extra_headers.append("Connection: close\r\n");
+  }
+  connection->chunked_headers_ = response.SerializeHeaders(extra_headers);
+  connection->is_chunked_ = true;
+}
+
+void HttpServer::SendChunk(int connection_id,
+                           const chromium::StringPiece& data) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL)
+    return;
+  DCHECK(connection->is_chunked_);
+  // An empty chunk would end the body.
+  if (!connection->is_chunked_ || data.empty())
+    return;
+  SendChunkInternal(connection, data, false);
+}
+
+void HttpServer::SendLastChunk(int connection_id,
+                               const chromium::StringPiece& data) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL)
+    return;
+  DCHECK(connection->is_chunked_);
+  if (!connection->is_chunked_)
+    return;
+  SendChunkInternal(connection, data, true);
+  connection->is_chunked_ = false;
+  DidSendResponse(connection);
+}
+
+// One gather write per chunk with any unsent headers and the terminating
+// chunk, small writes would otherwise be held back by Nagle's algorithm.
+void HttpServer::SendChunkInternal(HttpConnection* connection,
+                                   const chromium::StringPiece& data,
+                                   bool is_last) {
+  static const char kChunkEnd[] = "\r\n";
+  static const char kLastChunk[] = "0\r\n\r\n";
+  char size_line[sizeof(size_t) * 2 + 2];
+  chromium::StringPiece buffers[5];
+  size_t count = 0;
+  buffers[count++] = connection->chunked_headers_;
+  if (connection->is_http10_) {
+    buffers[count++] = data;
+  } else {
+    if (!data.empty()) {
+      buffers[count++] = chromium::StringPiece(
+          size_line, FormatChunkSize(data.length(), size_line));
+      buffers[count++] = data;
+      buffers[count++] = chromium::StringPiece(kChunkEnd, 2);
+    }
+    if (is_last)
+      buffers[count++] = chromium::StringPiece(kLastChunk, 5);
+  }
+  connection->SendBuffers(buffers, count);
+  connection->chunked_headers_.clear();
+}
+
+void HttpServer::PauseRequestData(int connection_id) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL || connection->is_body_paused_)
+    return;
+  connection->is_body_paused_ = true;
+  connection->socket_->PauseReads();
+}
+
+void HttpServer::ResumeRequestData(int connection_id) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL || !connection->is_body_paused_)
+    return;
+  connection->is_body_paused_ = false;
+  connection->socket_->ResumeReads();
+  // Deliver what was received before the pause.
+  if (!connection->is_processing_)
+    ProcessRequests(connection);
+}
+
+size_t HttpServer::GetSendQueueSize(int connection_id) {
+  HttpConnection* connection = FindConnection(connection_id);
+  if (connection == NULL)
+    return 0;
+  return connection->socket_->send_queue_size();
+}
+
 void HttpServer::Close(int connection_id) {
   HttpConnection* connection = FindConnection(connection_id);
   if (connection == NULL)
@@ -92,6 +286,23 @@ void HttpServer::Close(int connection_id) {
   DidClose(connection->socket_.get());
 }
 
+void HttpServer::CloseIdleConnections() {
+  const chromium::TimeTicks now = chromium::TimeTicks::Now();
+  std::vector<int> idle_connections;
+  for (IdToConnectionMap::const_iterator it = id_to_connection_.begin();
+       it != id_to_connection_.end(); ++it) {
+    const HttpConnection* connection = it->second;
+    if (connection->web_socket_.get() || connection->is_response_pending_)
+      continue;
+    if (now - connection->last_activity_ >= idle_timeout_)
+      idle_connections.push_back(it->first);
+  }
+  for (size_t i = 0; i < idle_connections.size(); ++i) {
+    ++stats_.idle_timeouts;
+    Close(idle_connections[i]);
+  }
+}
+
 int HttpServer::GetLocalAddress(IPEndPoint* address) {
   if (!server_)
     return ERR_SOCKET_NOT_CONNECTED;
@@ -104,6 +315,7 @@ void HttpServer::DidAccept(StreamListenSocket* server,
   id_to_connection_[connection->id()] = connection;
   // TODO(szym): Fix socket access. Make HttpConnection the Delegate.
   socket_to_connection_[connection->socket_.get()] = connection;
+  ++stats_.connections;
 }
 
 void HttpServer::DidRead(StreamListenSocket* socket,
@@ -114,8 +326,39 @@ void HttpServer::DidRead(StreamListenSocket* socket,
   if (connection == NULL)
     return;
 
-  connection->recv_data_.append(data, len);
-  while (connection->recv_data_.length()) {
+  connection->recv_buffer_.Append(data, len);
+  connection->last_activity_ = chromium::TimeTicks::Now();
+  ProcessRequests(connection);
+}
+
+void HttpServer::ProcessRequests(HttpConnection* connection) {
+  const int connection_id = connection->id();
+  connection->is_processing_ = true;
+  for (;;) {
+    // A streaming request body is delivered as received, ahead of the
+    // pending response.
+    if (connection->is_body_streaming_) {
+      if (connection->is_body_paused_)
+        break;
+      const chromium::StringPiece recv_data = connection->recv_data();
+      const size_t length = static_cast<size_t>(std::min<uint64_t>(
+          connection->body_remaining_, recv_data.length()));
+      if (length == 0 && connection->body_remaining_ > 0)
+        break;
+      connection->body_remaining_ -= length;
+      connection->is_body_streaming_ = (connection->body_remaining_ > 0);
+      delegate_->OnHttpRequestData(connection_id, recv_data.substr(0, length),
+                                   !connection->is_body_streaming_);
+      connection = FindConnection(connection_id);
+      if (connection == NULL)
+        return;
+      connection->Shift(length);
+      continue;
+    }
+
+    if (connection->recv_buffer_.empty())
+      break;
+
     if (connection->web_socket_.get()) {
       std::string message;
       WebSocket::ParseResult result = connection->web_socket_->Read(&message);
@@ -124,20 +367,39 @@ void HttpServer::DidRead(StreamListenSocket* socket,
 
       if (result == WebSocket::FRAME_CLOSE ||
           result == WebSocket::FRAME_ERROR) {
-        Close(connection->id());
-        break;
+        Close(connection_id);
+        return;
       }
-      delegate_->OnWebSocketMessage(connection->id(), message);
+      delegate_->OnWebSocketMessage(connection_id, message);
+      // The delegate may have closed the connection.
+      connection = FindConnection(connection_id);
+      if (connection == NULL)
+        return;
       continue;
     }
 
+    // Pipelined requests wait for the response to the one before.
+    if (connection->is_response_pending_ || connection->is_closing_)
+      break;
+
     HttpServerRequestInfo request;
     size_t pos = 0;
-    if (!ParseHeaders(connection, &request, &pos))
+    const ParseHeadersResult result = ParseHeaders(connection, &request, &pos);
+    if (result == PARSE_HEADERS_INCOMPLETE)
       break;
+    if (result != PARSE_HEADERS_DONE) {
+      // Unusable heads are refused, closing once the reply is sent.
+      HttpServerResponseInfo response(result == PARSE_HEADERS_TOO_LARGE ?
+          HTTP_REQUEST_HEADER_FIELDS_TOO_LARGE : HTTP_BAD_REQUEST);
+      response.SetBody(std::string(), "text/html");
+      connection->is_response_pending_ = true;
+      connection->keep_alive_ = false;
+      SendResponse(connection_id, response);
+      break;
+    }
 
     // Sets peer address if exists.
-    socket->GetPeerAddress(&request.peer);
+    connection->socket_->GetPeerAddress(&request.peer);
 
     if (request.HasHeaderValue("connection", "upgrade")) {
       connection->web_socket_.reset(WebSocket::CreateWebSocket(connection,
@@ -146,34 +408,91 @@ void HttpServer::DidRead(StreamListenSocket* socket,
 
       if (!connection->web_socket_.get())  // Not enough data was received.
         break;
-      delegate_->OnWebSocketRequest(connection->id(), request);
+      delegate_->OnWebSocketRequest(connection_id, request);
+      connection = FindConnection(connection_id);
+      if (connection == NULL)
+        return;
       connection->Shift(pos);
       continue;
     }
 
     const char kContentLength[] = "content-length";
-    if (request.headers.count(kContentLength)) {
+    const bool is_streaming = delegate_->IsStreamingRequest(request);
+    if (is_streaming) {
+      // Bodies without a length are not supported, as for buffered requests.
+      uint64_t content_length = 0;
+      if (request.HasHeader(kContentLength) &&
+          !chromium::StringToUint64(request.GetHeaderValue(kContentLength),
+                                    &content_length)) {
+        connection->is_response_pending_ = true;
+        connection->keep_alive_ = false;
+        SendResponse(connection_id, HttpServerResponseInfo::CreateFor500(
+            "request content-length unknown: " +
+            request.GetHeaderValue(kContentLength)));
+        break;
+      }
+      connection->is_body_streaming_ = true;
+      connection->body_remaining_ = content_length;
+      // Clients awaiting permission to send the body get it at once.
+      if (content_length > 0 &&
+          request.HasHeaderValue("expect", "100-continue") &&
+          request.protocol != "HTTP/1.0")
+        connection->Send("HTTP/1.1 100 Continue\r\n\r\n");
+    } else if (request.HasHeader(kContentLength)) {
       size_t content_length = 0;
       const size_t kMaxBodySize = 100 << 20;
       if (!chromium::StringToSizeT(request.GetHeaderValue(kContentLength),
                                &content_length) ||
           content_length > kMaxBodySize) {
-        connection->Send(HttpServerResponseInfo::CreateFor500(
+        connection->is_response_pending_ = true;
+        connection->keep_alive_ = false;
+        SendResponse(connection_id, HttpServerResponseInfo::CreateFor500(
             "request content-length too big or unknown: " +
             request.GetHeaderValue(kContentLength)));
-        DidClose(socket);
         break;
       }
 
-      if (connection->recv_data_.length() - pos < content_length)
+      const chromium::StringPiece recv_data = connection->recv_data();
+      if (recv_data.length() - pos < content_length)
         break;  // Not enough data was received yet.
-      request.data = connection->recv_data_.substr(pos, content_length);
+      request.data = recv_data.substr(pos, content_length).as_string();
       pos += content_length;
     }
 
-    delegate_->OnHttpRequest(connection->id(), request);
+    connection->is_response_pending_ = true;
+    connection->keep_alive_ = IsKeepAlive(request);
+    connection->is_http10_ = (request.protocol == "HTTP/1.0");
+    ++stats_.requests;
+    if (connection->request_count_++ > 0)
+      ++stats_.reused_requests;
+
+    delegate_->OnHttpRequest(connection_id, request);
+    connection = FindConnection(connection_id);
+    if (connection == NULL)
+      return;
     connection->Shift(pos);
   }
+  connection->is_processing_ = false;
+}
+
+void HttpServer::DidSendResponse(HttpConnection* connection) {
+  connection->is_response_pending_ = false;
+  connection->last_activity_ = chromium::TimeTicks::Now();
+  if (!connection->keep_alive_) {
+    connection->is_closing_ = true;
+    connection->socket_->CloseAfterSend();
+    return;
+  }
+  // Resume requests queued behind a response completed asynchronously.
+  if (!connection->is_processing_)
+    ProcessRequests(connection);
+}
+
+void HttpServer::DidDrain(StreamListenSocket* socket) {
+  HttpConnection* connection = FindConnection(socket);
+  if (connection == NULL)
+    return;
+  delegate_->OnSendQueueDrained(connection->id());
 }
 
 void HttpServer::DidClose(StreamListenSocket* socket) {
@@ -252,79 +571,95 @@ int charToInput(char ch) {
   return INPUT_DEFAULT;
 }
 
-bool HttpServer::ParseHeaders(HttpConnection* connection,
-                              HttpServerRequestInfo* info,
-                              size_t* ppos) {
-  size_t& pos = *ppos;
-  size_t data_len = connection->recv_data_.length();
-  int state = ST_METHOD;
-  std::string buffer;
-  std::string header_name;
-  std::string header_value;
-  while (pos < data_len) {
-    char ch = connection->recv_data_[pos++];
+// Resumes scanning where the previous read stopped, tokens are recorded as
+// offsets into the receive buffer and only materialized into |info| once the
+// request head is complete.
+HttpServer::ParseHeadersResult HttpServer::ParseHeaders(
+    HttpConnection* connection,
+    HttpServerRequestInfo* info,
+    size_t* ppos) {
+  HttpConnection::RequestParser& parser = connection->parser_;
+  const chromium::StringPiece data = connection->recv_data();
+  const size_t limit = std::min(data.length(), kMaxHeadSize);
+  while (parser.header_length == 0 && parser.pos < limit) {
+    const size_t index = parser.pos++;
+    char ch = data[index];
     int input = charToInput(ch);
+    int state = parser.state;
     int next_state = parser_state[state][input];
 
     bool transition = (next_state != state);
-    HttpServerRequestInfo::HeadersMap::iterator it;
     if (transition) {
       // Do any actions based on state transitions.
+      HttpConnection::RequestParser::Token token;
+      token.offset = parser.token_start;
+      token.length = index - parser.token_start;
       switch (state) {
         case ST_METHOD:
-          info->method = buffer;
-          buffer.clear();
+          parser.method = token;
           break;
         case ST_URL:
-          info->path = buffer;
-          buffer.clear();
+          parser.url = token;
           break;
         case ST_PROTO:
           // TODO(mbelshe): Deal better with parsing protocol.
-          DCHECK(buffer == "HTTP/1.1");
-          buffer.clear();
+          DCHECK(data.substr(token.offset, token.length) == "HTTP/1.1" ||
+                 data.substr(token.offset, token.length) == "HTTP/1.0");
+          parser.protocol = token;
           break;
         case ST_NAME:
-          header_name = chromium::StringToLowerASCII(buffer);
-          buffer.clear();
+          parser.name = token;
           break;
         case ST_VALUE:
-          chromium::TrimWhitespaceASCII(buffer, chromium::TRIM_LEADING, &header_value);
-          it = info->headers.find(header_name);
-          // See last paragraph ("Multiple message-header fields...")
-          // of www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.2
-          if (it == info->headers.end()) {
-            info->headers[header_name] = header_value;
-          } else {
-            it->second.append(",");
-            it->second.append(header_value);
-          }
-          buffer.clear();
+          parser.headers.push_back(std::make_pair(parser.name, token));
           break;
         case ST_SEPARATOR:
           break;
       }
-      state = next_state;
+      parser.state = next_state;
+      parser.token_start = parser.pos;
     } else {
       // Do any actions based on current state
       switch (state) {
-        case ST_METHOD:
-        case ST_URL:
-        case ST_PROTO:
-        case ST_VALUE:
-        case ST_NAME:
-          buffer.append(&ch, 1);
-          break;
         case ST_DONE:
           DCHECK(input == INPUT_LF);
-          return true;
+          parser.header_length = parser.pos;
+          break;
         case ST_ERR:
-          return false;
+          // Remain in error, later reads do not rescan.
+          parser.pos = index;
+          return PARSE_HEADERS_INVALID;
       }
     }
   }
-  // No more characters, but we haven't finished parsing yet.
-  return false;
+  if (parser.state == ST_ERR)
+    return PARSE_HEADERS_INVALID;
+  if (parser.header_length == 0) {
+    if (parser.pos >= kMaxHeadSize)
+      return PARSE_HEADERS_TOO_LARGE;
+    // No more characters, but we haven't finished parsing yet.
+    return PARSE_HEADERS_INCOMPLETE;
+  }
+
+  info->method = data.substr(parser.method.offset,
+                             parser.method.length).as_string();
+  info->path = data.substr(parser.url.offset, parser.url.length).as_string();
+  info->protocol = data.substr(parser.protocol.offset,
+                               parser.protocol.length).as_string();
+  info->headers.clear();
+  info->headers.reserve(parser.headers.size());
+  for (size_t i = 0; i < parser.headers.size(); ++i) {
+    const HttpConnection::RequestParser::Token& name = parser.headers[i].first;
+    const HttpConnection::RequestParser::Token& value =
+        parser.headers[i].second;
+    chromium::StringPiece trimmed = data.substr(value.offset, value.length);
+    while (!trimmed.empty() && (trimmed[0] == ' ' || trimmed[0] == '\t'))
+      trimmed.remove_prefix(1);
+    info->headers.push_back(std::make_pair(
+        data.substr(name.offset, name.length), trimmed));
+  }
+  *ppos = parser.header_length;
+  return PARSE_HEADERS_DONE;
 }
 
 HttpConnection* HttpServer::FindConnection(int connection_id) {
@@ -7,8 +7,10 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 #include "chromium/basictypes.hh"
+#include "chromium/time/time.hh"
 #include "net/http/http_status_code.hh"
 #include "net/socket/stream_listen_socket.hh"
 
@@ -19,6 +21,7 @@ class HttpServerRequestInfo;
 class HttpServerResponseInfo;
 class IPEndPoint;
 class WebSocket;
+class WebSocketBroadcast;
 
 class HttpServer : public StreamListenSocket::Delegate {
  public:
@@ -27,6 +30,20 @@ class HttpServer : public StreamListenSocket::Delegate {
     virtual void OnHttpRequest(int connection_id,
                                const HttpServerRequestInfo& info) = 0;
 
+    // Returns true to receive the body of |info| through OnHttpRequestData
+    // as it arrives, OnHttpRequest is then called once the head is complete
+    // with an empty |info.data|.
+    virtual bool IsStreamingRequest(const HttpServerRequestInfo& info) {
+      return false;
+    }
+    // Next part of a streaming request body, |is_complete| on the last which
+    // may be empty.  |data| is valid only for the call.
+    virtual void OnHttpRequestData(int connection_id,
+                                   const chromium::StringPiece& data,
+                                   bool is_complete) {}
+    // Everything sent to the connection has been written to the socket.
+    virtual void OnSendQueueDrained(int connection_id) {}
+
     virtual void OnWebSocketRequest(int connection_id,
                                     const HttpServerRequestInfo& info) = 0;
 
@@ -39,17 +56,43 @@ class HttpServer : public StreamListenSocket::Delegate {
     virtual ~Delegate() {}
   };
 
+  // Connection reuse counters since startup.
+  struct ConnectionStats {
+    ConnectionStats();
+
+    uint64_t connections;
+    uint64_t requests;
+    // Requests after the first on a persistent connection.
+    uint64_t reused_requests;
+    uint64_t idle_timeouts;
+  };
+
   explicit HttpServer(const StreamListenSocketFactory& socket_factory,
              HttpServer::Delegate* delegate);
 
   void AcceptWebSocket(int connection_id,
                        const HttpServerRequestInfo& request);
   void SendOverWebSocket(int connection_id, const std::string& data);
+  // Sends |data| to each WebSocket connection as the next message of
+  // |broadcast|, sharing compression between the connections where possible.
+  void BroadcastOverWebSocket(WebSocketBroadcast* broadcast,
+                              const std::vector<int>& connection_ids,
+                              const std::string& data);
   // Sends the provided data directly to the given connection. No validation is
   // performed that data constitutes a valid HTTP response. A valid HTTP
   // response may be split across multiple calls to SendRaw.
   void SendRaw(int connection_id, const std::string& data);
+  // Completes the pending request, possibly after OnHttpRequest returns.
+  // Pipelined requests are delivered in order as each response completes,
+  // the connection closes after the response if the request did not permit
+  // it to persist.
   void SendResponse(int connection_id, const HttpServerResponseInfo& response);
+  // As above with the status line and headers already serialized, each line
+  // "\r\n" terminated but without the blank line.  Neither |headers| nor
+  // |body| is copied other than into the send queue.
+  void SendPreparedResponse(int connection_id,
+                            const chromium::StringPiece& headers,
+                            const chromium::StringPiece& body);
   void Send(int connection_id,
             HttpStatusCode status_code,
             const std::string& data,
@@ -60,8 +103,38 @@ class HttpServer : public StreamListenSocket::Delegate {
   void Send404(int connection_id);
   void Send500(int connection_id, const std::string& message);
 
+  // Starts the pending response with a body of unknown length sent by
+  // SendChunk and completed by SendLastChunk.  |response| must not have a
+  // body.  HTTP/1.0 clients receive the body unframed and the connection
+  // closes after it.  The headers are written with the first chunk.
+  void SendChunkedHeaders(int connection_id,
+                          const HttpServerResponseInfo& response);
+  void SendChunk(int connection_id, const chromium::StringPiece& data);
+  // Sends |data|, if any, and completes the response.
+  void SendLastChunk(int connection_id, const chromium::StringPiece& data);
+
+  // Stops delivery of a streaming request body and reading from the
+  // connection, until resumed.
+  void PauseRequestData(int connection_id);
+  void ResumeRequestData(int connection_id);
+
+  // Bytes sent to the connection not yet written to the socket, zero if the
+  // connection is unknown.
+  size_t GetSendQueueSize(int connection_id);
+
   void Close(int connection_id);
 
+  // Closes persistent connections without a pending request idle for longer
+  // than the idle timeout, WebSocket connections are exempt.  Call
+  // periodically.
+  void CloseIdleConnections();
+  void set_idle_timeout(chromium::TimeDelta idle_timeout) {
+    idle_timeout_ = idle_timeout;
+  }
+
+  const ConnectionStats& stats() const { return stats_; }
+  size_t connection_count() const { return id_to_connection_.size(); }
+
   // Copies the local address to |address|. Returns a network error code.
   int GetLocalAddress(IPEndPoint* address);
 
@@ -72,6 +145,7 @@ class HttpServer : public StreamListenSocket::Delegate {
                        const char* data,
                        int len) override;
   virtual void DidClose(StreamListenSocket* socket) override;
+  virtual void DidDrain(StreamListenSocket* socket) override;
 
  public:
   virtual ~HttpServer();
@@ -79,12 +153,27 @@ class HttpServer : public StreamListenSocket::Delegate {
  private:
   friend class HttpConnection;
 
-  // Expects the raw data to be stored in recv_data_. If parsing is successful,
-  // will remove the data parsed from recv_data_, leaving only the unused
-  // recv data.
-  bool ParseHeaders(HttpConnection* connection,
-                    HttpServerRequestInfo* info,
-                    size_t* pos);
+  enum ParseHeadersResult {
+    PARSE_HEADERS_INCOMPLETE,
+    PARSE_HEADERS_DONE,
+    PARSE_HEADERS_INVALID,
+    PARSE_HEADERS_TOO_LARGE,
+  };
+
+  // Parses the request head from the connection receive buffer, continuing
+  // from the previous call.  If parsing is successful, sets |pos| to the
+  // length of the head, the caller shifts it off with any body.
+  ParseHeadersResult ParseHeaders(HttpConnection* connection,
+                                  HttpServerRequestInfo* info,
+                                  size_t* pos);
+
+  // Dispatches complete requests and WebSocket frames from the receive
+  // buffer, may destroy |connection|.
+  void ProcessRequests(HttpConnection* connection);
+  void DidSendResponse(HttpConnection* connection);
+  void SendChunkInternal(HttpConnection* connection,
+                         const chromium::StringPiece& data,
+                         bool is_last);
 
   HttpConnection* FindConnection(int connection_id);
   HttpConnection* FindConnection(StreamListenSocket* socket);
@@ -95,6 +184,8 @@ class HttpServer : public StreamListenSocket::Delegate {
   IdToConnectionMap id_to_connection_;
   typedef std::map<StreamListenSocket*, HttpConnection*> SocketToConnectionMap;
   SocketToConnectionMap socket_to_connection_;
+  chromium::TimeDelta idle_timeout_;
+  ConnectionStats stats_;
 };
 
 }  // namespace net
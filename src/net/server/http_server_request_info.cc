@@ -13,14 +13,45 @@ HttpServerRequestInfo::HttpServerRequestInfo() {}
 
 HttpServerRequestInfo::~HttpServerRequestInfo() {}
 
+namespace {
+
+bool NameEquals(const chromium::StringPiece& name,
+                const std::string& header_name) {
+  return name.length() == header_name.length() &&
+         chromium::LowerCaseEqualsASCII(name.data(),
+                                        name.data() + name.length(),
+                                        header_name.c_str());
+}
+
+}  // namespace
+
 std::string HttpServerRequestInfo::GetHeaderValue(
     const std::string& header_name) const {
   DCHECK_EQ(chromium::StringToLowerASCII(header_name), header_name);
-  HttpServerRequestInfo::HeadersMap::const_iterator it =
-      headers.find(header_name);
-  if (it != headers.end())
-    return it->second;
-  return std::string();
+  std::string value;
+  bool found = false;
+  for (HeadersList::const_iterator it = headers.begin();
+       it != headers.end(); ++it) {
+    if (!NameEquals(it->first, header_name))
+      continue;
+    // See last paragraph ("Multiple message-header fields...")
+    // of www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.2
+    if (found)
+      value.push_back(',');
+    it->second.AppendToString(&value);
+    found = true;
+  }
+  return value;
+}
+
+bool HttpServerRequestInfo::HasHeader(const std::string& header_name) const {
+  DCHECK_EQ(chromium::StringToLowerASCII(header_name), header_name);
+  for (HeadersList::const_iterator it = headers.begin();
+       it != headers.end(); ++it) {
+    if (NameEquals(it->first, header_name))
+      return true;
+  }
+  return false;
 }
 
 bool HttpServerRequestInfo::HasHeaderValue(
@@ -5,26 +5,32 @@
 #ifndef NET_SERVER_HTTP_SERVER_REQUEST_INFO_HH_
 #define NET_SERVER_HTTP_SERVER_REQUEST_INFO_HH_
 
-#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "chromium/strings/string_piece.hh"
 #include "net/base/ip_endpoint.hh"
 
 namespace net {
 
 // Meta information about an HTTP request.
-// This is geared toward servers in that it keeps a map of the headers and
-// values rather than just a list of header strings (which net::HttpRequestInfo
-// does).
+// This is geared toward servers in that it keeps the headers split into names
+// and values rather than just a list of header strings (which
+// net::HttpRequestInfo does).  Names and values are views of the connection
+// receive buffer, valid only until the next read on the connection.
 class HttpServerRequestInfo {
  public:
   HttpServerRequestInfo();
   ~HttpServerRequestInfo();
 
-  // Returns header value for given header name. |header_name| should be
-  // lower case.
+  // Returns header value for given header name, repeated fields joined by
+  // commas. |header_name| should be lower case.
   std::string GetHeaderValue(const std::string& header_name) const;
 
+  // Checks for presence of the header. |header_name| should be lower case.
+  bool HasHeader(const std::string& header_name) const;
+
   // Checks for item in comma-separated header value for given header name.
   // Both |header_name| and |header_value| should be lower case.
   bool HasHeaderValue(
@@ -40,13 +46,17 @@ class HttpServerRequestInfo {
   // Request line.
   std::string path;
 
+  // Request protocol, "HTTP/1.1" or "HTTP/1.0".
+  std::string protocol;
+
   // Request data.
   std::string data;
 
-  // A map of the names -> values for HTTP headers. These should always
-  // contain lower case field names.
-  typedef std::map<std::string, std::string> HeadersMap;
-  mutable HeadersMap headers;
+  // HTTP header names and values in received order, names as sent and
+  // compared without case, values with leading whitespace removed.
+  typedef std::vector<std::pair<chromium::StringPiece, chromium::StringPiece> >
+      HeadersList;
+  HeadersList headers;
 };
 
 }  // namespace net
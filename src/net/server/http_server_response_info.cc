@@ -48,13 +48,25 @@ void HttpServerResponseInfo::SetBody(const std::string& body,
 }
 
 std::string HttpServerResponseInfo::Serialize() const {
+  std::string response = SerializeHeaders(std::string());
+  response.append(body_);
+  return response;
+}
+
+std::string HttpServerResponseInfo::SerializeHeaders(
+    const std::string& extra_headers) const {
   std::string response = chromium::StringPrintf(
       "HTTP/1.1 %d %s\r\n", status_code_, GetHttpReasonPhrase(status_code_));
   Headers::const_iterator header;
-  for (header = headers_.begin(); header != headers_.end(); ++header)
-    response += header->first + ":" + header->second + "\r\n";
-
-  return response + "\r\n" + body_;
+  for (header = headers_.begin(); header != headers_.end(); ++header) {
+    response.append(header->first);
+    response.push_back(':');
+    response.append(header->second);
+    response.append("\r\n");
+  }
+  response.append(extra_headers);
+  response.append("\r\n");
+  return response;
 }
 
 HttpStatusCode HttpServerResponseInfo::status_code() const {
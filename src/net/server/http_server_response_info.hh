@@ -29,6 +29,9 @@ class HttpServerResponseInfo {
   void SetBody(const std::string& body, const std::string& content_type);
 
   std::string Serialize() const;
+  // Status line and headers followed by |extra_headers|, each "\r\n"
+  // terminated, and the blank line but not the body.
+  std::string SerializeHeaders(const std::string& extra_headers) const;
 
   HttpStatusCode status_code() const;
   const std::string& body() const;
@@ -11,10 +11,14 @@
 #include "chromium/md5.hh"
 #include "chromium/sha1.hh"
 #include "chromium/strings/string_number_conversions.hh"
+#include "chromium/strings/string_split.hh"
+#include "chromium/strings/string_util.hh"
 #include "chromium/strings/stringprintf.hh"
 #include "net/server/http_connection.hh"
 #include "net/server/http_server_request_info.hh"
 #include "net/server/http_server_response_info.hh"
+#include "net/websockets/websocket_deflater.hh"
+#include "net/websockets/websocket_frame.hh"
 
 #ifdef max
 #	undef max
@@ -88,27 +92,36 @@ class WebSocketHixie76 : public net::WebSocket {
 
   virtual ParseResult Read(std::string* message) override {
     DCHECK(message);
-    const std::string& data = connection_->recv_data();
+    const chromium::StringPiece data = connection_->recv_data();
     if (data[0])
       return FRAME_ERROR;
 
     size_t pos = data.find('\377', 1);
-    if (pos == std::string::npos)
+    if (pos == chromium::StringPiece::npos)
       return FRAME_INCOMPLETE;
 
-    std::string buffer(data.begin() + 1, data.begin() + pos);
-    message->swap(buffer);
+    data.substr(1, pos - 1).CopyToString(message);
     connection_->Shift(pos + 1);
 
     return FRAME_OK;
   }
 
   virtual void Send(const std::string& message) override {
-    char message_start = 0;
-    char message_end = -1;
-    connection_->Send(&message_start, 1);
-    connection_->Send(message);
-    connection_->Send(&message_end, 1);
+    SendFrame(message, false);
+  }
+
+ protected:
+  virtual void SendFrame(const chromium::StringPiece& payload,
+                         bool compressed) override {
+    DCHECK(!compressed);
+    const char message_start = 0;
+    const char message_end = -1;
+    const chromium::StringPiece buffers[] = {
+      chromium::StringPiece(&message_start, 1),
+      payload,
+      chromium::StringPiece(&message_end, 1)
+    };
+    connection_->SendBuffers(buffers, arraysize(buffers));
   }
 
  private:
@@ -136,7 +149,7 @@ class WebSocketHixie76 : public net::WebSocket {
 
     key3_ = connection->recv_data().substr(
         *pos,
-        *pos + kWebSocketHandshakeBodyLen);
+        *pos + kWebSocketHandshakeBodyLen).as_string();
     *pos += kWebSocketHandshakeBodyLen;
   }
 
@@ -170,6 +183,97 @@ const size_t kTwoBytePayloadLengthField = 126;
 const size_t kEightBytePayloadLengthField = 127;
 const size_t kMaskingKeyWidthInBytes = 4;
 
+// Compressed messages are inflated up to the same limit as request bodies.
+const size_t kMaxInflatedMessageSize = 100 << 20;
+
+// zlib cannot produce a stream for an 8 bit window, the server accepts only
+// the default.
+const int kDeflateWindowBits = 15;
+
+// Accepted permessage-deflate offer, RFC 7692 section 7.1.
+struct DeflateParameters {
+  DeflateParameters()
+      : server_no_context_takeover(false),
+        client_no_context_takeover(false) {}
+
+  bool server_no_context_takeover;
+  bool client_no_context_takeover;
+};
+
+// Returns false if |offer| is not permessage-deflate or has parameters the
+// server cannot honour.
+bool ParseDeflateOffer(const std::string& offer, DeflateParameters* params) {
+  std::vector<std::string> tokens;
+  chromium::SplitString(offer, ';', &tokens);
+  if (tokens.empty() || tokens[0] != "permessage-deflate")
+    return false;
+  bool has_server_max_window_bits = false;
+  bool has_client_max_window_bits = false;
+  for (size_t i = 1; i < tokens.size(); ++i) {
+    std::string name = tokens[i];
+    std::string value;
+    bool has_value = false;
+    const size_t separator = name.find('=');
+    if (separator != std::string::npos) {
+      chromium::TrimWhitespaceASCII(name.substr(separator + 1),
+                                    chromium::TRIM_ALL, &value);
+      chromium::TrimWhitespaceASCII(name.substr(0, separator),
+                                    chromium::TRIM_ALL, &name);
+      if (value.length() >= 2 && value[0] == '"' &&
+          value[value.length() - 1] == '"')
+        value = value.substr(1, value.length() - 2);
+      has_value = true;
+    }
+    // Each parameter at most once.
+    if (name == "server_no_context_takeover" && !has_value &&
+        !params->server_no_context_takeover) {
+      params->server_no_context_takeover = true;
+    } else if (name == "client_no_context_takeover" && !has_value &&
+               !params->client_no_context_takeover) {
+      params->client_no_context_takeover = true;
+    } else if (name == "server_max_window_bits" && has_value &&
+               !has_server_max_window_bits) {
+      int bits = 0;
+      if (!chromium::StringToInt(value, &bits) || bits != kDeflateWindowBits)
+        return false;
+      has_server_max_window_bits = true;
+    } else if (name == "client_max_window_bits" &&
+               !has_client_max_window_bits) {
+      // Any client window decodes with the largest.
+      int bits = 0;
+      if (has_value &&
+          (!chromium::StringToInt(value, &bits) || bits < 8 || bits > 15))
+        return false;
+      has_client_max_window_bits = true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Picks the first acceptable offer of a Sec-WebSocket-Extensions header and
+// sets |response| to the value confirming it.
+bool NegotiateDeflate(const std::string& extensions,
+                      DeflateParameters* params,
+                      std::string* response) {
+  std::vector<std::string> offers;
+  chromium::SplitString(extensions, ',', &offers);
+  for (size_t i = 0; i < offers.size(); ++i) {
+    DeflateParameters offer_params;
+    if (!ParseDeflateOffer(offers[i], &offer_params))
+      continue;
+    *params = offer_params;
+    *response = "permessage-deflate";
+    if (params->server_no_context_takeover)
+      response->append("; server_no_context_takeover");
+    if (params->client_no_context_takeover)
+      response->append("; client_no_context_takeover");
+    return true;
+  }
+  return false;
+}
+
 class WebSocketHybi17 : public WebSocket {
  public:
   static WebSocket* Create(HttpConnection* connection,
@@ -201,18 +305,31 @@ class WebSocketHybi17 : public WebSocket {
         "HTTP/1.1 101 WebSocket Protocol Handshake\r\n"
         "Upgrade: WebSocket\r\n"
         "Connection: Upgrade\r\n"
-        "Sec-WebSocket-Accept: %s\r\n"
-        "\r\n",
+        "Sec-WebSocket-Accept: %s\r\n",
         encoded_hash.c_str());
+    if (!extensions_.empty()) {
+      response.append("Sec-WebSocket-Extensions: ");
+      response.append(extensions_);
+      response.append("\r\n");
+    }
+    response.append("\r\n");
     connection_->Send(response);
   }
 
   virtual ParseResult Read(std::string* message) override {
-    const std::string& frame = connection_->recv_data();
+    const chromium::StringPiece frame = connection_->recv_data();
     int bytes_consumed = 0;
-
-    ParseResult result =
-        WebSocket::DecodeFrameHybi17(frame, true, &bytes_consumed, message);
+    bool compressed = false;
+
+    ParseResult result = WebSocket::DecodeFrameHybi17(
+        frame, true, &bytes_consumed, message,
+        inflater_ ? &compressed : NULL);
+    if (result == FRAME_OK && compressed) {
+      message->swap(inflate_buffer_);
+      if (!inflater_->Inflate(inflate_buffer_, kMaxInflatedMessageSize,
+                              message))
+        result = FRAME_ERROR;
+    }
     if (result == FRAME_OK)
       connection_->Shift(bytes_consumed);
     if (result == FRAME_CLOSE)
@@ -223,8 +340,34 @@ class WebSocketHybi17 : public WebSocket {
   virtual void Send(const std::string& message) override {
     if (closed_)
       return;
-    std::string data = WebSocket::EncodeFrameHybi17(message, 0);
-    connection_->Send(data);
+    if (!deflater_) {
+      SendFrame(message, false);
+      return;
+    }
+    // The client history holds messages from another context.
+    if (sent_context_id_ != context_id_)
+      deflater_->ResetContext();
+    if (!deflater_->Deflate(message, &deflate_buffer_)) {
+      SendFrame(message, false);
+      return;
+    }
+    SendFrame(deflate_buffer_, true);
+    sent_context_id_ = context_id_;
+  }
+
+ protected:
+  virtual void SendFrame(const chromium::StringPiece& payload,
+                         bool compressed) override {
+    if (closed_)
+      return;
+    char header[kMaxFrameHeaderSizeHybi17];
+    const size_t header_length = WebSocket::EncodeFrameHeaderHybi17(
+        payload.length(), 0, compressed, header);
+    const chromium::StringPiece buffers[] = {
+      chromium::StringPiece(header, header_length),
+      payload
+    };
+    connection_->SendBuffers(buffers, arraysize(buffers));
   }
 
  private:
@@ -242,6 +385,21 @@ class WebSocketHybi17 : public WebSocket {
       payload_length_(0),
       frame_end_(0),
       closed_(false) {
+    DeflateParameters params;
+    if (!NegotiateDeflate(request.GetHeaderValue("sec-websocket-extensions"),
+                          &params, &extensions_))
+      return;
+    deflater_.reset(new WebSocketDeflater(
+        params.server_no_context_takeover
+            ? WebSocketDeflater::DO_NOT_TAKE_OVER_CONTEXT
+            : WebSocketDeflater::TAKE_OVER_CONTEXT));
+    inflater_.reset(new WebSocketInflater());
+    if (!deflater_->Initialize(kDeflateWindowBits) ||
+        !inflater_->Initialize(kDeflateWindowBits)) {
+      deflater_.reset();
+      inflater_.reset();
+      extensions_.clear();
+    }
   }
 
   OpCode op_code_;
@@ -254,6 +412,10 @@ class WebSocketHybi17 : public WebSocket {
   size_t payload_length_;
   const char* frame_end_;
   bool closed_;
+  // Negotiated Sec-WebSocket-Extensions, empty if none.
+  std::string extensions_;
+  std::string inflate_buffer_;
+  std::string deflate_buffer_;
 };
 
 }  // anonymous namespace
@@ -269,10 +431,12 @@ WebSocket* WebSocket::CreateWebSocket(HttpConnection* connection,
 }
 
 // static
-WebSocket::ParseResult WebSocket::DecodeFrameHybi17(const std::string& frame,
-                                                    bool client_frame,
-                                                    int* bytes_consumed,
-                                                    std::string* output) {
+WebSocket::ParseResult WebSocket::DecodeFrameHybi17(
+    const chromium::StringPiece& frame,
+    bool client_frame,
+    int* bytes_consumed,
+    std::string* output,
+    bool* compressed) {
   size_t data_length = frame.length();
   if (data_length < 2)
     return FRAME_INCOMPLETE;
@@ -290,8 +454,11 @@ WebSocket::ParseResult WebSocket::DecodeFrameHybi17(const std::string& frame,
   bool reserved3 = (first_byte & kReserved3Bit) != 0;
   int op_code = first_byte & kOpCodeMask;
   bool masked = (second_byte & kMaskBit) != 0;
-  if (!final || reserved1 || reserved2 || reserved3)
+  if (!final || reserved2 || reserved3)
     return FRAME_ERROR;  // Extensions and not supported.
+  // RSV1 marks a permessage-deflate data frame.
+  if (reserved1 && (!compressed || op_code != kOpCodeText))
+    return FRAME_ERROR;
 
   bool closed = false;
   switch (op_code) {
@@ -343,65 +510,173 @@ WebSocket::ParseResult WebSocket::DecodeFrameHybi17(const std::string& frame,
   if (static_cast<size_t>(buffer_end - p) < total_length)
     return FRAME_INCOMPLETE;
 
-  if (masked) {
-    output->resize(payload_length);
-    const char* masking_key = p;
-    char* payload = const_cast<char*>(p + kMaskingKeyWidthInBytes);
-    for (size_t i = 0; i < payload_length; ++i)  // Unmask the payload.
-      (*output)[i] = payload[i] ^ masking_key[i % kMaskingKeyWidthInBytes];
-  } else {
-    std::string buffer(p, p + payload_length);
-    output->swap(buffer);
+  // The message is copied out of the receive buffer once and unmasked in
+  // place.
+  output->assign(p + actual_masking_key_length, payload_length);
+  if (masked && payload_length > 0) {
+    WebSocketMaskingKey masking_key;
+    memcpy(masking_key.key, p, kMaskingKeyWidthInBytes);
+    MaskWebSocketFramePayload(masking_key, 0, &(*output)[0], payload_length);
   }
 
   size_t pos = p + actual_masking_key_length + payload_length - buffer_begin;
   *bytes_consumed = pos;
+  if (compressed)
+    *compressed = reserved1;
   return closed ? FRAME_CLOSE : FRAME_OK;
 }
 
 // static
 std::string WebSocket::EncodeFrameHybi17(const std::string& message,
                                          int masking_key) {
-  std::vector<char> frame;
-  OpCode op_code = kOpCodeText;
-  size_t data_length = message.length();
-
-  frame.push_back(kFinalBit | op_code);
-  char mask_key_bit = masking_key != 0 ? kMaskBit : 0;
-  if (data_length <= kMaxSingleBytePayloadLength)
-    frame.push_back(data_length | mask_key_bit);
-  else if (data_length <= 0xFFFF) {
-    frame.push_back(kTwoBytePayloadLengthField | mask_key_bit);
-    frame.push_back((data_length & 0xFF00) >> 8);
-    frame.push_back(data_length & 0xFF);
+  char header[kMaxFrameHeaderSizeHybi17];
+  const size_t header_length =
+      EncodeFrameHeaderHybi17(message.length(), masking_key, false, header);
+  std::string frame;
+  frame.reserve(header_length + message.length());
+  frame.append(header, header_length);
+  frame.append(message);
+  if (masking_key != 0 && !message.empty()) {
+    WebSocketMaskingKey key;
+    memcpy(key.key, &masking_key, kMaskingKeyWidthInBytes);
+    MaskWebSocketFramePayload(key, 0, &frame[header_length], message.length());
+  }
+  return frame;
+}
+
+// static
+size_t WebSocket::EncodeFrameHeaderHybi17(size_t payload_length,
+                                          int masking_key,
+                                          bool compressed,
+                                          char* header) {
+  char* p = header;
+  *p++ = kFinalBit | (compressed ? kReserved1Bit : 0) | kOpCodeText;
+  const char mask_key_bit = masking_key != 0 ? kMaskBit : 0;
+  if (payload_length <= kMaxSingleBytePayloadLength) {
+    *p++ = static_cast<char>(payload_length) | mask_key_bit;
+  } else if (payload_length <= 0xFFFF) {
+    *p++ = kTwoBytePayloadLengthField | mask_key_bit;
+    *p++ = (payload_length & 0xFF00) >> 8;
+    *p++ = payload_length & 0xFF;
   } else {
-    frame.push_back(kEightBytePayloadLengthField | mask_key_bit);
-    char extended_payload_length[8];
-    size_t remaining = data_length;
-    // Fill the length into extended_payload_length in the network byte order.
-    for (int i = 0; i < 8; ++i) {
-      extended_payload_length[7 - i] = remaining & 0xFF;
+    *p++ = kEightBytePayloadLengthField | mask_key_bit;
+    // Fill the length into the extended payload length in the network byte
+    // order.
+    uint64_t remaining = payload_length;
+    for (int i = 7; i >= 0; --i) {
+      p[i] = remaining & 0xFF;
       remaining >>= 8;
     }
-    frame.insert(frame.end(),
-                 extended_payload_length,
-                 extended_payload_length + 8);
+    p += 8;
     DCHECK(!remaining);
   }
-
-  const char* data = const_cast<char*>(message.data());
   if (masking_key != 0) {
-    const char* mask_bytes = reinterpret_cast<char*>(&masking_key);
-    frame.insert(frame.end(), mask_bytes, mask_bytes + 4);
-    for (size_t i = 0; i < data_length; ++i)  // Mask the payload.
-      frame.push_back(data[i] ^ mask_bytes[i % kMaskingKeyWidthInBytes]);
-  } else {
-    frame.insert(frame.end(), data, data + data_length);
+    memcpy(p, &masking_key, kMaskingKeyWidthInBytes);
+    p += kMaskingKeyWidthInBytes;
   }
-  return std::string(&frame[0], frame.size());
+  DCHECK(static_cast<size_t>(p - header) <= kMaxFrameHeaderSizeHybi17);
+  return p - header;
 }
 
-WebSocket::WebSocket(HttpConnection* connection) : connection_(connection) {
+WebSocket::WebSocket(HttpConnection* connection)
+    : connection_(connection),
+      context_id_(NewContextId()),
+      sent_context_id_(0),
+      sent_sequence_(0) {
+}
+
+WebSocket::~WebSocket() {
+}
+
+// static
+uint64_t WebSocket::NewContextId() {
+  // Connections are only served from the server thread.
+  static uint64_t last_context_id = 0;
+  return ++last_context_id;
+}
+
+WebSocketBroadcast::WebSocketBroadcast()
+    : context_id_(WebSocket::NewContextId()),
+      sequence_(0) {
+}
+
+WebSocketBroadcast::~WebSocketBroadcast() {
+}
+
+void WebSocketBroadcast::Send(const std::vector<WebSocket*>& sockets,
+                              const std::string& message) {
+  bool has_shared = false;
+  bool has_fresh = false;
+  bool is_in_step = true;
+  for (std::vector<WebSocket*>::const_iterator it = sockets.begin();
+       it != sockets.end(); ++it) {
+    const WebSocket* socket = *it;
+    if (!socket->deflater_)
+      continue;
+    if (socket->deflater_->mode() == WebSocketDeflater::TAKE_OVER_CONTEXT) {
+      has_shared = true;
+      if (socket->sent_context_id_ != context_id_ ||
+          socket->sent_sequence_ != sequence_)
+        is_in_step = false;
+    } else {
+      has_fresh = true;
+    }
+  }
+
+  bool is_shared_compressed = false;
+  if (has_shared) {
+    if (!deflater_) {
+      deflater_.reset(
+          new WebSocketDeflater(WebSocketDeflater::TAKE_OVER_CONTEXT));
+      if (!deflater_->Initialize(kDeflateWindowBits))
+        deflater_.reset();
+    }
+    if (deflater_) {
+      // A restarted context is decodable by every recipient.
+      if (!is_in_step)
+        deflater_->ResetContext();
+      is_shared_compressed = deflater_->Deflate(message, &compressed_);
+    }
+    ++sequence_;
+  }
+  // Output of a restarted context serves as a fresh compression too.
+  const std::string* fresh = NULL;
+  if (has_fresh) {
+    if (is_shared_compressed && !is_in_step) {
+      fresh = &compressed_;
+    } else {
+      if (!fresh_deflater_) {
+        fresh_deflater_.reset(
+            new WebSocketDeflater(WebSocketDeflater::DO_NOT_TAKE_OVER_CONTEXT));
+        if (!fresh_deflater_->Initialize(kDeflateWindowBits))
+          fresh_deflater_.reset();
+      }
+      if (fresh_deflater_ &&
+          fresh_deflater_->Deflate(message, &fresh_compressed_))
+        fresh = &fresh_compressed_;
+    }
+  }
+
+  for (std::vector<WebSocket*>::const_iterator it = sockets.begin();
+       it != sockets.end(); ++it) {
+    WebSocket* socket = *it;
+    if (!socket->deflater_) {
+      socket->SendFrame(message, false);
+    } else if (socket->deflater_->mode() ==
+               WebSocketDeflater::TAKE_OVER_CONTEXT) {
+      if (is_shared_compressed) {
+        socket->SendFrame(compressed_, true);
+        socket->sent_context_id_ = context_id_;
+        socket->sent_sequence_ = sequence_;
+      } else {
+        socket->SendFrame(message, false);
+      }
+    } else if (fresh) {
+      socket->SendFrame(*fresh, true);
+    } else {
+      socket->SendFrame(message, false);
+    }
+  }
 }
 
 }  // namespace net
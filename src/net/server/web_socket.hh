@@ -5,14 +5,21 @@
 #ifndef NET_SERVER_WEB_SOCKET_HH_
 #define NET_SERVER_WEB_SOCKET_HH_
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "chromium/basictypes.hh"
+#include "chromium/strings/string_piece.hh"
 
 namespace net {
 
 class HttpConnection;
 class HttpServerRequestInfo;
+class WebSocketBroadcast;
+class WebSocketDeflater;
+class WebSocketInflater;
 
 class WebSocket {
  public:
@@ -27,22 +34,81 @@ class WebSocket {
                                     const HttpServerRequestInfo& request,
                                     size_t* pos);
 
-  static ParseResult DecodeFrameHybi17(const std::string& frame,
+  // |compressed| reports the permessage-deflate bit of a data frame, if
+  // NULL the bit is a protocol error.
+  static ParseResult DecodeFrameHybi17(const chromium::StringPiece& frame,
                                        bool client_frame,
                                        int* bytes_consumed,
-                                       std::string* output);
+                                       std::string* output,
+                                       bool* compressed);
 
   static std::string EncodeFrameHybi17(const std::string& data,
                                        int masking_key);
 
+  // Largest frame header: two bytes, an eight byte extended payload length
+  // and a masking key.
+  static const size_t kMaxFrameHeaderSizeHybi17 = 14;
+
+  // Writes the header of a text frame carrying |payload_length| bytes into
+  // |header|, returns its length.  A non-zero |masking_key| is appended, the
+  // payload must then be masked by the caller.  |compressed| marks a
+  // permessage-deflate payload.
+  static size_t EncodeFrameHeaderHybi17(size_t payload_length,
+                                        int masking_key,
+                                        bool compressed,
+                                        char* header);
+
   virtual void Accept(const HttpServerRequestInfo& request) = 0;
   virtual ParseResult Read(std::string* message) = 0;
   virtual void Send(const std::string& message) = 0;
-  virtual ~WebSocket() {}
+  virtual ~WebSocket();
 
  protected:
+  friend class WebSocketBroadcast;
+
   explicit WebSocket(HttpConnection* connection);
+
+  // Writes one message frame with |payload| as is.
+  virtual void SendFrame(const chromium::StringPiece& payload,
+                         bool compressed) = 0;
+
+  // Identifies a compression context for the lifetime of the process.
+  static uint64_t NewContextId();
+
   HttpConnection* connection_;
+
+  // permessage-deflate state, NULL unless negotiated.
+  std::unique_ptr<WebSocketDeflater> deflater_;
+  std::unique_ptr<WebSocketInflater> inflater_;
+  const uint64_t context_id_;
+  // The client decodes each compressed message against the history of every
+  // compressed message before it, so a context may only continue where the
+  // last compressed message sent came from it.
+  uint64_t sent_context_id_;
+  // Position within a WebSocketBroadcast stream of the last message sent.
+  uint64_t sent_sequence_;
+};
+
+// One stream of messages sent to many WebSocket connections.  Connections
+// with permessage-deflate context takeover that received every earlier
+// message of the stream share a single compression of each message, the
+// shared context restarts whenever a recipient is out of step.  Connections
+// without context takeover share a compression from a fresh context.
+class WebSocketBroadcast {
+ public:
+  WebSocketBroadcast();
+  ~WebSocketBroadcast();
+
+  void Send(const std::vector<WebSocket*>& sockets, const std::string& message);
+
+ private:
+  std::unique_ptr<WebSocketDeflater> deflater_;
+  std::unique_ptr<WebSocketDeflater> fresh_deflater_;
+  const uint64_t context_id_;
+  uint64_t sequence_;
+  // Output buffers reused between messages.
+  std::string compressed_;
+  std::string fresh_compressed_;
 };
 
 }  // namespace net
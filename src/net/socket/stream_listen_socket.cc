@@ -14,10 +14,9 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #endif
 
-#include <boost/thread/thread.hpp>
-
 #include "chromium/logging.hh"
 #include "net/base/ip_endpoint.hh"
 #include "net/base/net_errors.hh"
@@ -36,8 +35,29 @@ namespace {
 
 const int kReadBufSize = 4096;
 
+// Small sends are coalesced into queued buffers up to this size.
+const size_t kSendChunkSize = 16 * 1024;
+
+bool IsWouldBlock() {
+#if defined(_WIN32)
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+int LastSocketError() {
+#if defined(_WIN32)
+  return WSAGetLastError();
+#else
+  return errno;
+#endif
+}
+
 }  // namespace
 
+const size_t StreamListenSocket::kMaxSendQueueSize = 8 * 1024 * 1024;
+
 #if defined(_WIN32)
 const int StreamListenSocket::kSocketError = SOCKET_ERROR;
 #elif defined(OS_POSIX)
@@ -49,6 +69,12 @@ StreamListenSocket::StreamListenSocket(chromium::MessageLoopForIO* message_loop_
                                        StreamListenSocket::Delegate* del)
     : message_loop_for_io_(message_loop_for_io),
       socket_delegate_(del),
+      send_queue_offset_(0),
+      send_queue_size_(0),
+      is_watching_write_(false),
+      reads_paused_(false),
+      is_aborted_(false),
+      is_closing_(false),
       socket_(s) {
   wait_state_ = NOT_WAITING;
 }
@@ -68,6 +94,96 @@ void StreamListenSocket::Send(const string& str, bool append_linefeed) {
   Send(str.data(), static_cast<int>(str.length()), append_linefeed);
 }
 
+// Separate sends of a frame header and payload would otherwise be split
+// into two segments and the second held back by Nagle's algorithm.
+void StreamListenSocket::SendBuffers(const chromium::StringPiece* buffers,
+                                     size_t count) {
+  DCHECK(count <= kMaxSendBuffers);
+  if (is_aborted_)
+    return;
+  size_t sent = 0;
+  if (send_queue_.empty()) {
+#if defined(_WIN32)
+    WSABUF vectors[kMaxSendBuffers];
+    DWORD vector_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (buffers[i].empty())
+        continue;
+      vectors[vector_count].buf = const_cast<char*>(buffers[i].data());
+      vectors[vector_count].len = static_cast<ULONG>(buffers[i].length());
+      ++vector_count;
+    }
+    if (vector_count == 0)
+      return;
+    DWORD bytes_sent = 0;
+    if (WSASend(socket_, vectors, vector_count, &bytes_sent, 0, NULL, NULL) ==
+        SOCKET_ERROR) {
+      if (!IsWouldBlock()) {
+        LOG(ERROR) << "WSASend failed: WSAGetLastError()=="
+                   << WSAGetLastError();
+        AbortSend();
+        return;
+      }
+      bytes_sent = 0;
+    }
+    sent = bytes_sent;
+#else
+    struct iovec vectors[kMaxSendBuffers];
+    int vector_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (buffers[i].empty())
+        continue;
+      vectors[vector_count].iov_base = const_cast<char*>(buffers[i].data());
+      vectors[vector_count].iov_len = buffers[i].length();
+      ++vector_count;
+    }
+    if (vector_count == 0)
+      return;
+    const ssize_t bytes_sent = writev(socket_, vectors, vector_count);
+    if (bytes_sent == -1) {
+      if (!IsWouldBlock()) {
+        LOG(ERROR) << "writev failed: errno==" << errno;
+        AbortSend();
+        return;
+      }
+    } else {
+      sent = static_cast<size_t>(bytes_sent);
+    }
+#endif
+  }
+  // Queue the unsent remainder of each segment.
+  for (size_t i = 0; i < count; ++i) {
+    const size_t length = buffers[i].length();
+    if (sent >= length) {
+      sent -= length;
+      continue;
+    }
+    if (!QueueInternal(buffers[i].data() + sent, length - sent))
+      return;
+    sent = 0;
+  }
+}
+
+void StreamListenSocket::CloseAfterSend() {
+  if (is_closing_ || is_aborted_)
+    return;
+  is_closing_ = true;
+  if (send_queue_.empty())
+    ShutdownSend();
+}
+
+void StreamListenSocket::PauseReads() {
+  DCHECK(!reads_paused_);
+  reads_paused_ = true;
+  UpdateWatch();
+}
+
+void StreamListenSocket::ResumeReads() {
+  DCHECK(reads_paused_);
+  reads_paused_ = false;
+  UpdateWatch();
+}
+
 int StreamListenSocket::GetLocalAddress(IPEndPoint* address) {
   SockaddrStorage storage;
   if (getsockname(socket_, storage.addr, &storage.addr_len)) {
@@ -110,33 +226,151 @@ SocketDescriptor StreamListenSocket::AcceptSocket() {
 }
 
 void StreamListenSocket::SendInternal(const char* bytes, int len) {
-  char* send_buf = const_cast<char *>(bytes);
-  int len_left = len;
-  while (true) {
-    int sent = send(socket_, send_buf, len_left, 0);
-    if (sent == len_left) {  // A shortcut to avoid extraneous checks.
-      break;
-    }
+  if (is_aborted_ || len <= 0)
+    return;
+  // Send directly unless earlier data is still queued.
+  if (send_queue_.empty()) {
+    int sent = send(socket_, bytes, len, 0);
+    if (sent == len)  // A shortcut to avoid extraneous checks.
+      return;
     if (sent == kSocketError) {
+      if (!IsWouldBlock()) {
+        LOG(ERROR) << "send failed: error==" << LastSocketError();
+        AbortSend();
+        return;
+      }
+      sent = 0;
+    }
+    bytes += sent;
+    len -= sent;
+  }
+  QueueInternal(bytes, static_cast<size_t>(len));
+}
+
+bool StreamListenSocket::QueueInternal(const char* bytes, size_t len) {
+  if (is_aborted_)
+    return false;
+  if (send_queue_size_ + len > kMaxSendQueueSize) {
+    LOG(WARNING) << "Send queue limit of " << kMaxSendQueueSize
+                 << " bytes exceeded, dropping connection.";
+    AbortSend();
+    return false;
+  }
+  if (!send_queue_.empty() && send_queue_.back().size() + len <= kSendChunkSize)
+    send_queue_.back().append(bytes, len);
+  else
+    send_queue_.push_back(std::string(bytes, len));
+  send_queue_size_ += len;
+  WatchWrite(true);
+  return true;
+}
+
+bool StreamListenSocket::FlushSendQueue() {
+  while (!send_queue_.empty()) {
+    size_t sent = 0;
 #if defined(_WIN32)
-      if (WSAGetLastError() != WSAEWOULDBLOCK) {
-        LOG(ERROR) << "send failed: WSAGetLastError()==" << WSAGetLastError();
-#elif defined(OS_POSIX)
-      if (errno != EWOULDBLOCK && errno != EAGAIN) {
-        LOG(ERROR) << "send failed: errno==" << errno;
+    WSABUF buffers[kMaxSendBuffers];
+    DWORD count = 0;
+    for (std::deque<std::string>::iterator it = send_queue_.begin();
+         it != send_queue_.end() && count < kMaxSendBuffers; ++it, ++count) {
+      const size_t offset = (count == 0) ? send_queue_offset_ : 0;
+      buffers[count].buf = const_cast<char*>(it->data()) + offset;
+      buffers[count].len = static_cast<ULONG>(it->size() - offset);
+    }
+    DWORD bytes_sent = 0;
+    if (WSASend(socket_, buffers, count, &bytes_sent, 0, NULL, NULL) ==
+        SOCKET_ERROR) {
+      if (IsWouldBlock())
+        return true;
+      LOG(ERROR) << "WSASend failed: WSAGetLastError()==" << WSAGetLastError();
+      return false;
+    }
+    sent = bytes_sent;
+#else
+    struct iovec buffers[kMaxSendBuffers];
+    size_t count = 0;
+    for (std::deque<std::string>::iterator it = send_queue_.begin();
+         it != send_queue_.end() && count < kMaxSendBuffers; ++it, ++count) {
+      const size_t offset = (count == 0) ? send_queue_offset_ : 0;
+      buffers[count].iov_base = const_cast<char*>(it->data()) + offset;
+      buffers[count].iov_len = it->size() - offset;
+    }
+    const ssize_t bytes_sent = writev(socket_, buffers, static_cast<int>(count));
+    if (bytes_sent == -1) {
+      if (IsWouldBlock())
+        return true;
+      LOG(ERROR) << "writev failed: errno==" << errno;
+      return false;
+    }
+    sent = static_cast<size_t>(bytes_sent);
 #endif
+    send_queue_size_ -= sent;
+    // Release completed buffers.
+    while (sent > 0) {
+      const size_t remaining = send_queue_.front().size() - send_queue_offset_;
+      if (sent < remaining) {
+        send_queue_offset_ += sent;
         break;
       }
-      // Otherwise we would block, and now we have to wait for a retry.
-      // Fall through to PlatformThread::YieldCurrentThread()
-    } else {
-      // sent != len_left according to the shortcut above.
-      // Shift the buffer start and send the remainder after a short while.
-      send_buf += sent;
-      len_left -= sent;
+      sent -= remaining;
+      send_queue_.pop_front();
+      send_queue_offset_ = 0;
     }
-    boost::this_thread::yield();
   }
+  WatchWrite(false);
+  if (is_closing_)
+    ShutdownSend();
+  return true;
+}
+
+void StreamListenSocket::WatchWrite(bool is_watching_write) {
+  if (is_watching_write_ == is_watching_write || wait_state_ == NOT_WAITING)
+    return;
+  is_watching_write_ = is_watching_write;
+  UpdateWatch();
+}
+
+// Paused reads are not watched, a readable socket would otherwise wake the
+// loop continuously.
+void StreamListenSocket::UpdateWatch() {
+  if (wait_state_ == NOT_WAITING)
+    return;
+  const bool is_watching_read = !reads_paused_ || is_aborted_;
+  if (!is_watching_read && !is_watching_write_) {
+    watcher_.StopWatchingFileDescriptor();
+    return;
+  }
+  chromium::MessageLoopForIO::Mode mode = chromium::MessageLoopForIO::WATCH_READ;
+  if (!is_watching_read)
+    mode = chromium::MessageLoopForIO::WATCH_WRITE;
+  else if (is_watching_write_)
+    mode = chromium::MessageLoopForIO::WATCH_READ_WRITE;
+  message_loop_for_io_->WatchFileDescriptor(socket_, true, mode, &watcher_,
+                                            this);
+}
+
+void StreamListenSocket::AbortSend() {
+  is_aborted_ = true;
+  send_queue_.clear();
+  send_queue_offset_ = 0;
+  send_queue_size_ = 0;
+#if defined(_WIN32)
+  shutdown(socket_, SD_BOTH);
+#else
+  shutdown(socket_, SHUT_RDWR);
+#endif
+  // Either notification completes the close.
+  WatchWrite(true);
+}
+
+// Without a receive shutdown so that a peer still sending does not reset
+// the connection before it has read the final response.
+void StreamListenSocket::ShutdownSend() {
+#if defined(_WIN32)
+  shutdown(socket_, SD_SEND);
+#else
+  shutdown(socket_, SHUT_WR);
+#endif
 }
 
 void StreamListenSocket::Listen() {
@@ -163,19 +397,25 @@ void StreamListenSocket::Read() {
 #endif
         break;
       } else {
-        // TODO(ibrar): some error handling required here.
+        LOG(WARNING) << "recv failed: error==" << LastSocketError();
+        Close();
         break;
       }
     } else if (len == 0) {
       Close();
+    } else if (is_closing_) {
+      // Drain until the peer closes.
     } else {
       // TODO(ibrar): maybe change DidRead to take a length instead.
       DCHECK_GT(len, 0);
       DCHECK_LE(len, kReadBufSize);
       buf[len] = 0;  // Already create a buffer with +1 length.
+      // The delegate may destroy this object, it must be the last access.
+      // Any further data is picked up on the next read notification.
       socket_delegate_->DidRead(this, buf, len);
+      return;
     }
-  } while (len == kReadBufSize);
+  } while (len == kReadBufSize && !reads_paused_);
 }
 
 void StreamListenSocket::Close() {
@@ -201,13 +441,19 @@ void StreamListenSocket::WatchSocket(WaitState state) {
   message_loop_for_io_->WatchFileDescriptor(
       socket_, true, chromium::MessageLoopForIO::WATCH_READ, &watcher_, this);
   wait_state_ = state;
+  is_watching_write_ = false;
 }
 
 void StreamListenSocket::UnwatchSocket() {
   watcher_.StopWatchingFileDescriptor();
+  is_watching_write_ = false;
 }
 
 void StreamListenSocket::OnFileCanReadWithoutBlocking(SocketDescriptor fd) {
+  if (is_aborted_) {
+    Close();
+    return;
+  }
   switch (wait_state_) {
     case WAITING_ACCEPT:
       Accept();
@@ -223,9 +469,14 @@ void StreamListenSocket::OnFileCanReadWithoutBlocking(SocketDescriptor fd) {
 }
 
 void StreamListenSocket::OnFileCanWriteWithoutBlocking(SocketDescriptor fd) {
-  // MessagePumpLibevent callback, we don't listen for write events
-  // so we shouldn't ever reach here.
-  NOTREACHED();
+  // Close() may destroy this object, it must be the last access.
+  if (is_aborted_ || !FlushSendQueue()) {
+    Close();
+    return;
+  }
+  // As may the delegate.
+  if (send_queue_.empty() && !is_closing_)
+    socket_delegate_->DidDrain(this);
 }
 
 }  // namespace net
@@ -19,11 +19,13 @@
 #if defined(_WIN32)
 #include <winsock2.h>
 #endif
+#include <deque>
 #include <memory>
 #include <string>
 #include "message_loop.hh"
 
 #include "chromium/basictypes.hh"
+#include "chromium/strings/string_piece.hh"
 #include "net/socket/socket_descriptor.hh"
 
 namespace net {
@@ -48,14 +50,30 @@ class StreamListenSocket : public chromium::MessageLoopForIO::Watcher {
                          const char* data,
                          int len) = 0;
     virtual void DidClose(StreamListenSocket* sock) = 0;
+    // Data queued by an earlier send has all been written.
+    virtual void DidDrain(StreamListenSocket* connection) {}
 
    protected:
     virtual ~Delegate() {}
   };
 
-  // Send data to the socket.
+  // Send data to the socket.  Data the socket cannot take immediately is
+  // queued and written as the socket becomes writable, the connection is
+  // dropped if the queue would exceed kMaxSendQueueSize.
   void Send(const char* bytes, int len, bool append_linefeed = false);
   void Send(const std::string& str, bool append_linefeed = false);
+  // As above for |count| segments written with a single gather write, at
+  // most kMaxSendBuffers.
+  void SendBuffers(const chromium::StringPiece* buffers, size_t count);
+
+  // Half-closes the connection once queued data is written, later received
+  // data is discarded and the close completes when the peer closes.
+  void CloseAfterSend();
+
+  // Stops and restarts reading from the socket so that a peer sending faster
+  // than the delegate consumes is held back by TCP flow control.
+  void PauseReads();
+  void ResumeReads();
 
   // Copies the local address to |address|. Returns a network error code.
   // This method is virtual to support unit testing.
@@ -66,6 +84,15 @@ class StreamListenSocket : public chromium::MessageLoopForIO::Watcher {
 
   static const int kSocketError;
 
+  // Limit of outbound bytes queued for a peer that is not reading.
+  static const size_t kMaxSendQueueSize;
+
+  // Segments per gather write.
+  static const size_t kMaxSendBuffers = 16;
+
+  // Bytes queued awaiting the socket becoming writable.
+  size_t send_queue_size() const { return send_queue_size_; }
+
  protected:
   enum WaitState {
     NOT_WAITING      = 0,
@@ -92,12 +119,36 @@ class StreamListenSocket : public chromium::MessageLoopForIO::Watcher {
 
  private:
   void SendInternal(const char* bytes, int len);
+  // Appends to the send queue, returns false if the connection was dropped.
+  bool QueueInternal(const char* bytes, size_t len);
+
+  // Writes queued data with gather I/O until the socket would block, returns
+  // false on socket error.
+  bool FlushSendQueue();
+  // Adds or removes write readiness from the watched events.
+  void WatchWrite(bool is_watching_write);
+  // Watches the events for the current read and write state.
+  void UpdateWatch();
+  // Discards queued data and shuts down the socket, the close is completed
+  // from the next I/O notification as the delegate may be mid-call.
+  void AbortSend();
+  void ShutdownSend();
 
   // Called by MessagePumpLibevent when the socket is ready to do I/O.
   virtual void OnFileCanReadWithoutBlocking(SocketDescriptor fd) override;
   virtual void OnFileCanWriteWithoutBlocking(SocketDescriptor fd) override;
   WaitState wait_state_;
 
+  // Outbound buffer chain, the front buffer is partially sent by
+  // |send_queue_offset_| bytes.
+  std::deque<std::string> send_queue_;
+  size_t send_queue_offset_;
+  size_t send_queue_size_;
+  bool is_watching_write_;
+  bool reads_paused_;
+  bool is_aborted_;
+  bool is_closing_;
+
 // temporary integration
   chromium::MessageLoopForIO::FileDescriptorWatcher watcher_;
  protected:
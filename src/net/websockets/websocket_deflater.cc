@@ -0,0 +1,175 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/websockets/websocket_deflater.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "chromium/basictypes.hh"
+#include "chromium/logging.hh"
+
+namespace net {
+
+namespace {
+
+// Every Z_SYNC_FLUSH ends with an empty stored block, the extension strips
+// it from each message and the receiver appends it again.
+const char kTrailer[] = { '\x00', '\x00', '\xff', '\xff' };
+const size_t kTrailerLength = sizeof(kTrailer);
+
+// Output growth whilst inflating.
+const size_t kInflateChunkSize = 16 * 1024;
+
+}  // namespace
+
+WebSocketDeflater::WebSocketDeflater(ContextTakeOverMode mode)
+    : mode_(mode) {
+}
+
+WebSocketDeflater::~WebSocketDeflater() {
+  if (stream_) {
+    deflateEnd(stream_.get());
+    stream_.reset();
+  }
+}
+
+bool WebSocketDeflater::Initialize(int window_bits) {
+  DCHECK(!stream_);
+  // zlib silently raises a window of 8 bits to 9, which the peer would not
+  // be able to decode.
+  DCHECK_LE(9, window_bits);
+  DCHECK_GE(15, window_bits);
+  stream_.reset(new z_stream);
+  memset(stream_.get(), 0, sizeof(z_stream));
+  // Negative window bits for a raw deflate stream without zlib framing.
+  int result = deflateInit2(stream_.get(),
+                            Z_DEFAULT_COMPRESSION,
+                            Z_DEFLATED,
+                            -window_bits,
+                            8,  // default mem level
+                            Z_DEFAULT_STRATEGY);
+  if (result != Z_OK) {
+    deflateEnd(stream_.get());
+    stream_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool WebSocketDeflater::Deflate(const chromium::StringPiece& message,
+                                std::string* output) {
+  DCHECK(stream_);
+  output->clear();
+  stream_->next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+  stream_->avail_in = static_cast<uInt>(message.length());
+  // Sized so that a single pass normally suffices.
+  size_t capacity =
+      deflateBound(stream_.get(), static_cast<uLong>(message.length())) +
+      kTrailerLength;
+  size_t length = 0;
+  do {
+    output->resize(capacity);
+    stream_->next_out = reinterpret_cast<Bytef*>(&(*output)[length]);
+    stream_->avail_out = static_cast<uInt>(capacity - length);
+    int result = deflate(stream_.get(), Z_SYNC_FLUSH);
+    if (result != Z_OK && result != Z_BUF_ERROR) {
+      LOG(ERROR) << "deflate failed: " << result;
+      output->clear();
+      return false;
+    }
+    length = capacity - stream_->avail_out;
+    capacity *= 2;
+  } while (stream_->avail_out == 0);
+  output->resize(length);
+
+  DCHECK_GE(length, kTrailerLength);
+  DCHECK_EQ(0, memcmp(output->data() + length - kTrailerLength, kTrailer,
+                      kTrailerLength));
+  output->resize(length - kTrailerLength);
+  if (mode_ == DO_NOT_TAKE_OVER_CONTEXT)
+    ResetContext();
+  return true;
+}
+
+void WebSocketDeflater::ResetContext() {
+  DCHECK(stream_);
+  deflateReset(stream_.get());
+}
+
+WebSocketInflater::WebSocketInflater() {
+}
+
+WebSocketInflater::~WebSocketInflater() {
+  if (stream_) {
+    inflateEnd(stream_.get());
+    stream_.reset();
+  }
+}
+
+bool WebSocketInflater::Initialize(int window_bits) {
+  DCHECK(!stream_);
+  DCHECK_LE(8, window_bits);
+  DCHECK_GE(15, window_bits);
+  stream_.reset(new z_stream);
+  memset(stream_.get(), 0, sizeof(z_stream));
+  // A 15 bit window decodes streams compressed with any smaller window.
+  int result = inflateInit2(stream_.get(), -window_bits);
+  if (result != Z_OK) {
+    inflateEnd(stream_.get());
+    stream_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool WebSocketInflater::Inflate(const chromium::StringPiece& payload,
+                                size_t max_size,
+                                std::string* output) {
+  DCHECK(stream_);
+  output->clear();
+  const chromium::StringPiece inputs[] = {
+    payload,
+    chromium::StringPiece(kTrailer, kTrailerLength)
+  };
+  size_t length = 0;
+  for (size_t i = 0; i < arraysize(inputs); ++i) {
+    stream_->next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(inputs[i].data()));
+    stream_->avail_in = static_cast<uInt>(inputs[i].length());
+    for (;;) {
+      if (length == output->size()) {
+        if (length >= max_size) {
+          output->clear();
+          return false;
+        }
+        output->resize(std::min(length + kInflateChunkSize, max_size));
+      }
+      stream_->next_out = reinterpret_cast<Bytef*>(&(*output)[length]);
+      stream_->avail_out = static_cast<uInt>(output->size() - length);
+      int result = inflate(stream_.get(), Z_SYNC_FLUSH);
+      length = output->size() - stream_->avail_out;
+      if (result == Z_STREAM_END) {
+        // A final block ends the message, the next one starts a new stream.
+        inflateReset(stream_.get());
+        output->resize(length);
+        return true;
+      }
+      if (result != Z_OK && result != Z_BUF_ERROR) {
+        output->clear();
+        return false;
+      }
+      // Input consumed and pending output flushed.
+      if (stream_->avail_in == 0 && stream_->avail_out > 0)
+        break;
+    }
+  }
+  output->resize(length);
+  return true;
+}
+
+}  // namespace net
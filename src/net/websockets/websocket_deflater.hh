@@ -0,0 +1,71 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_WEBSOCKETS_WEBSOCKET_DEFLATER_HH_
+#define NET_WEBSOCKETS_WEBSOCKET_DEFLATER_HH_
+
+#include <memory>
+#include <string>
+
+#include "chromium/strings/string_piece.hh"
+
+extern "C" struct z_stream_s;
+
+namespace net {
+
+// Compressor for the permessage-deflate extension, RFC 7692.
+class WebSocketDeflater {
+ public:
+  enum ContextTakeOverMode {
+    DO_NOT_TAKE_OVER_CONTEXT,
+    TAKE_OVER_CONTEXT,
+  };
+
+  explicit WebSocketDeflater(ContextTakeOverMode mode);
+  ~WebSocketDeflater();
+
+  // Returns true if there is no error.  |window_bits| must be between 9 and
+  // 15 inclusive.
+  bool Initialize(int window_bits);
+
+  // Compresses one message into |output|, replacing its content, without
+  // the trailing empty block the extension strips.  Returns true if there is
+  // no error.
+  bool Deflate(const chromium::StringPiece& message, std::string* output);
+
+  // Discards the compression history so that the next message does not
+  // reference data the peer may not have.
+  void ResetContext();
+
+  ContextTakeOverMode mode() const { return mode_; }
+
+ private:
+  std::unique_ptr<z_stream_s> stream_;
+  ContextTakeOverMode mode_;
+};
+
+// Decompressor for the permessage-deflate extension, RFC 7692.
+class WebSocketInflater {
+ public:
+  WebSocketInflater();
+  ~WebSocketInflater();
+
+  // Returns true if there is no error.  |window_bits| must be between 8 and
+  // 15 inclusive.
+  bool Initialize(int window_bits);
+
+  // Decompresses the payload of one message into |output|, replacing its
+  // content.  Returns false on a malformed payload or if the message would
+  // exceed |max_size| bytes.
+  bool Inflate(const chromium::StringPiece& payload,
+               size_t max_size,
+               std::string* output);
+
+ private:
+  std::unique_ptr<z_stream_s> stream_;
+};
+
+}  // namespace net
+
+#endif  // NET_WEBSOCKETS_WEBSOCKET_DEFLATER_HH_
@@ -0,0 +1,114 @@
+// Copyright (c) 2012 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/websockets/websocket_frame.hh"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define WEBSOCKET_MASK_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// MSVC 2012 and later compile AVX2 intrinsics without /arch:AVX2, the kernel
+// is selected at run time.  Elsewhere only when the whole build targets AVX2.
+#if defined(_MSC_VER) && _MSC_VER >= 1700 && \
+    (defined(_M_X64) || defined(_M_IX86))
+#define WEBSOCKET_MASK_AVX2 1
+#define WEBSOCKET_MASK_AVX2_RUNTIME 1
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define WEBSOCKET_MASK_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace net {
+
+namespace {
+
+// Key repeated from the starting phase, wide enough for one AVX2 vector.
+const size_t kPatternLength = 32;
+
+#if defined(WEBSOCKET_MASK_AVX2_RUNTIME)
+bool CpuHasAVX2() {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  const int kOSXSAVE = 1 << 27;
+  const int kAVX = 1 << 28;
+  if ((info[2] & (kOSXSAVE | kAVX)) != (kOSXSAVE | kAVX))
+    return false;
+  // The OS must preserve the YMM state across context switches.
+  if ((_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+#endif
+
+#if defined(WEBSOCKET_MASK_AVX2)
+bool UseAVX2() {
+#if defined(WEBSOCKET_MASK_AVX2_RUNTIME)
+  static const bool use_avx2 = CpuHasAVX2();
+  return use_avx2;
+#else
+  return true;
+#endif
+}
+#endif
+
+}  // namespace
+
+void MaskWebSocketFramePayload(const WebSocketMaskingKey& masking_key,
+                               uint64_t frame_offset,
+                               char* const data,
+                               size_t data_size) {
+  static const size_t kMaskingKeyLength = WebSocketMaskingKey::kMaskingKeyLength;
+  char pattern[kPatternLength];
+  const size_t key_offset = static_cast<size_t>(frame_offset % kMaskingKeyLength);
+  for (size_t i = 0; i < kPatternLength; ++i)
+    pattern[i] = masking_key.key[(key_offset + i) % kMaskingKeyLength];
+
+  // Every stride is a multiple of the key length so the phase is unchanged
+  // between the loops below.
+  char* p = data;
+  char* const end = data + data_size;
+#if defined(WEBSOCKET_MASK_AVX2)
+  if (end - p >= 32 && UseAVX2()) {
+    const __m256i key256 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern));
+    for (; end - p >= 32; p += 32) {
+      __m256i* const chunk = reinterpret_cast<__m256i*>(p);
+      _mm256_storeu_si256(chunk,
+                          _mm256_xor_si256(_mm256_loadu_si256(chunk), key256));
+    }
+    // Avoid the AVX to SSE transition penalty in the code that follows.
+    _mm256_zeroupper();
+  }
+#endif
+#if defined(WEBSOCKET_MASK_SSE2)
+  const __m128i key128 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+  for (; end - p >= 16; p += 16) {
+    __m128i* const chunk = reinterpret_cast<__m128i*>(p);
+    _mm_storeu_si128(chunk, _mm_xor_si128(_mm_loadu_si128(chunk), key128));
+  }
+#endif
+  uint64_t key64;
+  memcpy(&key64, pattern, sizeof(key64));
+  for (; end - p >= 8; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    word ^= key64;
+    memcpy(p, &word, sizeof(word));
+  }
+  for (size_t i = 0; p < end; ++p, ++i)
+    *p ^= pattern[i];
+}
+
+}  // namespace net
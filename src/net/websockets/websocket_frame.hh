@@ -0,0 +1,34 @@
+// Copyright (c) 2012 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_WEBSOCKETS_WEBSOCKET_FRAME_HH_
+#define NET_WEBSOCKETS_WEBSOCKET_FRAME_HH_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace net {
+
+// Masking key of a WebSocket frame, in the byte order it appears in the
+// frame header.
+struct WebSocketMaskingKey {
+  static const size_t kMaskingKeyLength = 4;
+
+  char key[kMaskingKeyLength];
+};
+
+// Masks or unmasks |data_size| bytes of payload in place, |frame_offset| is
+// the position of |data| within the frame payload so that a payload may be
+// processed in pieces.  Masking and unmasking are the same operation.
+//
+// Uses AVX2 when the processor supports it, SSE2 on x86, otherwise eight
+// bytes at a time.
+void MaskWebSocketFramePayload(const WebSocketMaskingKey& masking_key,
+                               uint64_t frame_offset,
+                               char* data,
+                               size_t data_size);
+
+}  // namespace net
+
+#endif  // NET_WEBSOCKETS_WEBSOCKET_FRAME_HH_
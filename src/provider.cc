@@ -18,9 +18,14 @@
 #	include <sys/socket.h>
 #endif
 
+#include "chromium/basictypes.hh"
+#include "chromium/format_macros.hh"
+#include "chromium/json/json_stream_writer.hh"
 #include "chromium/logging.hh"
+#include "chromium/strings/stringprintf.hh"
 #include "upaostream.hh"
 #include "client.hh"
+#include "dictionary.hh"
 #include "kigoron_http_server.hh"
 
 #ifdef _WIN32
@@ -28,48 +33,67 @@
 #	define getpid		_getpid
 #endif
 
-/* Reuters Wire Format nomenclature for RDM dictionary names. */
-static const std::string kRdmFieldDictionaryName ("RWFFld");
-static const std::string kEnumTypeDictionaryName ("RWFEnum");
+/* Interval between performance counter snapshots, in seconds. */
+static const unsigned kSnapshotInterval = 1;
+
+/* Refresh images held per reactor before the cache is emptied. */
+static const size_t kRefreshImageCapacity = 64 * 1024;
 
 kigoron::provider_t::provider_t (
 	const kigoron::config_t& config,
+	const kigoron::listener_config_t& listener,
 	std::shared_ptr<kigoron::upa_t> upa,
+	std::shared_ptr<kigoron::dictionary_t> dictionary,
 	kigoron::client_t::Delegate* request_delegate 
 	) :
 	creation_time_ (boost::posix_time::second_clock::universal_time()),
 	last_activity_ (creation_time_),
 	config_ (config),
+	listener_ (listener),
 	upa_ (upa),
+	dictionary_ (dictionary),
 	request_delegate_ (request_delegate),
 	rssl_sock_ (nullptr),
 	keep_running_ (true),
-	min_rwf_version_ (0),
 	service_id_ (1),	// first and only service
 	is_accepting_connections_ (true),
-	is_accepting_requests_ (true)
+	is_accepting_requests_ (true),
+	receipt_time_ (0),
+	receipt_domain_ (LATENCY_DOMAIN_OTHER),
+	receipt_client_ (nullptr),
+	receipt_stream_id_ (0),
+	latency_previous_time_ (creation_time_),
+	is_flight_dump_requested_ (false),
+	symbol_count_ (0),
+	next_client_id_ (0)
 {
-	ZeroMemory (cumulative_stats_, sizeof (cumulative_stats_));
-	ZeroMemory (snap_stats_, sizeof (snap_stats_));
+	cumulative_stats_.Snapshot (&snap_stats_);
+	next_snapshot_ = creation_time_ + boost::posix_time::seconds (kSnapshotInterval);
 }
 
 kigoron::provider_t::~provider_t()
 {
 	DLOG(INFO) << "~provider_t";
 	Close();
+	dictionary_.reset();
 /* Cleanup RSSL stack. */
 	upa_.reset();
 /* Summary output */
 	using namespace boost::posix_time;
 	auto uptime = second_clock::universal_time() - creation_time_;
 	VLOG(3) << "Provider summary: {"
-		 " \"Uptime\": \"" << to_simple_string (uptime) << "\""
-		", \"ConnectionsReceived\": " << cumulative_stats_[PROVIDER_PC_CONNECTION_RECEIVED] <<
-		", \"ClientSessions\": " << cumulative_stats_[PROVIDER_PC_CLIENT_SESSION_ACCEPTED] <<
-		", \"MsgsReceived\": " << cumulative_stats_[PROVIDER_PC_RSSL_MSGS_RECEIVED] <<
-		", \"MsgsMalformed\": " << cumulative_stats_[PROVIDER_PC_RSSL_MSGS_MALFORMED] <<
-		", \"MsgsSent\": " << cumulative_stats_[PROVIDER_PC_RSSL_MSGS_SENT] <<
-		", \"MsgsEnqueued\": " << cumulative_stats_[PROVIDER_PC_RSSL_MSGS_ENQUEUED] <<
+		 " \"Listener\": \"" << listener_.name << "\""
+		", \"Uptime\": \"" << to_simple_string (uptime) << "\""
+		", \"ConnectionsReceived\": " << cumulative_stats_.value (PROVIDER_PC_CONNECTION_RECEIVED) <<
+		", \"ClientSessions\": " << cumulative_stats_.value (PROVIDER_PC_CLIENT_SESSION_ACCEPTED) <<
+		", \"MsgsReceived\": " << cumulative_stats_.value (PROVIDER_PC_RSSL_MSGS_RECEIVED) <<
+		", \"MsgsMalformed\": " << cumulative_stats_.value (PROVIDER_PC_RSSL_MSGS_MALFORMED) <<
+		", \"MsgsSent\": " << cumulative_stats_.value (PROVIDER_PC_RSSL_MSGS_SENT) <<
+		", \"MsgsEnqueued\": " << cumulative_stats_.value (PROVIDER_PC_RSSL_MSGS_ENQUEUED) <<
+		", \"BytesReceived\": " << cumulative_stats_.value (PROVIDER_PC_BYTES_RECEIVED) <<
+		", \"UncompressedBytesReceived\": " << cumulative_stats_.value (PROVIDER_PC_UNCOMPRESSED_BYTES_RECEIVED) <<
+		", \"BytesSent\": " << cumulative_stats_.value (PROVIDER_PC_BYTES_SENT) <<
+		", \"UncompressedBytesSent\": " << cumulative_stats_.value (PROVIDER_PC_UNCOMPRESSED_BYTES_SENT) <<
 		" }";
 }
 
@@ -94,11 +118,33 @@ kigoron::provider_t::Initialize()
 		return false;
 
 /* 9.4.1. Bind server socket. */
-	VLOG(3) << "Binding RSSL server socket.";
-	addr.serviceName	     = const_cast<char*> (config_.rssl_port.c_str());	// port or service name
+	VLOG(3) << "Binding RSSL server socket for listener \"" << listener_.name << "\".";
+	addr.serviceName	     = const_cast<char*> (listener_.rssl_port.c_str());	// port or service name
 	addr.protocolType	     = RSSL_RWF_PROTOCOL_TYPE;
 	addr.majorVersion	     = RSSL_RWF_MAJOR_VERSION;
 	addr.minorVersion	     = RSSL_RWF_MINOR_VERSION;
+/* Compression offered to clients, a client may request none. */
+	if (config_.compression_type == "zlib") {
+		addr.compressionType = RSSL_COMP_ZLIB;
+	} else if (config_.compression_type == "lz4") {
+		addr.compressionType = RSSL_COMP_LZ4;
+	} else {
+		LOG_IF(WARNING, config_.compression_type != "none" && !config_.compression_type.empty()) << "Unsupported compression type \"" << config_.compression_type << "\", compression disabled.";
+		addr.compressionType = RSSL_COMP_NONE;
+	}
+	addr.compressionLevel	     = config_.compression_level;
+/* Socket buffers before listen() so that window scaling is negotiated. */
+	if (0 != listener_.send_buffer_size)
+		addr.sysSendBufSize  = listener_.send_buffer_size;
+	if (0 != listener_.recv_buffer_size)
+		addr.sysRecvBufSize  = listener_.recv_buffer_size;
+/* Channel buffer pools inherited by every accepted session. */
+	if (0 != listener_.guaranteed_output_buffers)
+		addr.guaranteedOutputBuffers = listener_.guaranteed_output_buffers;
+	if (0 != listener_.num_input_buffers)
+		addr.numInputBuffers = listener_.num_input_buffers;
+	if (0 != listener_.max_output_buffers)
+		addr.maxOutputBuffers = listener_.max_output_buffers;
 
 	RsslServer* s = rsslBind (&addr, &rssl_err);
 /* Hard failure on bind as likely a configuration issue. */
@@ -111,27 +157,51 @@ kigoron::provider_t::Initialize()
 			", \"protocolType\": \"" << internal::protocol_type_string (addr.protocolType) << "\""
 			", \"majorVersion\": " << static_cast<unsigned> (addr.majorVersion) << ""
 			", \"minorVersion\": " << static_cast<unsigned> (addr.minorVersion) << ""
+			", \"compressionType\": \"" << internal::compression_type_string (static_cast<RsslCompTypes> (addr.compressionType)) << "\""
+			", \"compressionLevel\": " << static_cast<unsigned> (addr.compressionLevel) << ""
+			", \"sysSendBufSize\": " << addr.sysSendBufSize << ""
+			", \"sysRecvBufSize\": " << addr.sysRecvBufSize << ""
+			", \"guaranteedOutputBuffers\": " << addr.guaranteedOutputBuffers << ""
+			", \"numInputBuffers\": " << addr.numInputBuffers << ""
+			", \"maxOutputBuffers\": " << addr.maxOutputBuffers << ""
 			" }";
 		return false;
 	} else {
 		LOG(INFO) << "RSSL server socket created: { "
-			  "\"portNumber\": " << s->portNumber << ""
+			  "\"listener\": \"" << listener_.name << "\""
+			", \"portNumber\": " << s->portNumber << ""
 			", \"protocolType\": \"" << internal::protocol_type_string (addr.protocolType) << "\""
 			", \"majorVersion\": " << static_cast<unsigned> (addr.majorVersion) << ""
 			", \"minorVersion\": " << static_cast<unsigned> (addr.minorVersion) << ""
+			", \"compressionType\": \"" << internal::compression_type_string (static_cast<RsslCompTypes> (addr.compressionType)) << "\""
+			", \"compressionLevel\": " << static_cast<unsigned> (addr.compressionLevel) << ""
+			", \"sysSendBufSize\": " << addr.sysSendBufSize << ""
+			", \"sysRecvBufSize\": " << addr.sysRecvBufSize << ""
+			", \"guaranteedOutputBuffers\": " << addr.guaranteedOutputBuffers << ""
+			", \"numInputBuffers\": " << addr.numInputBuffers << ""
+			", \"maxOutputBuffers\": " << addr.maxOutputBuffers << ""
 			", \"socketId\": " << s->socketId << ""
 			", \"state\": \"" << internal::channel_state_string (s->state) << "\""
 			" }";
 		rssl_sock_ = s;
 	}
 
-/* temporary race condition setting selector */
-	FD_ZERO (&in_rfds_);
-/* Built in HTTPD server. */
-	server_.reset (new KigoronHttpServer (this, this));
-	if (!(bool)server_ || !server_->Start (7580))
+/* Pre-encode dictionaries for every RWF version and verbosity served. */
+	if ((bool)dictionary_ && !dictionary_->EncodeAll (service_id()))
 		return false;
 
+/* Built in HTTPD server, listening before its thread starts. */
+	CreateIdentity();
+	if (0 != listener_.http_port) {
+		PublishSnapshot();
+		http_thread_.reset (new io_thread_t());
+		server_.reset (new KigoronHttpServer (http_thread_.get(), this));
+		if (!(bool)server_ || !server_->Start (static_cast<in_port_t> (listener_.http_port)))
+			return false;
+		if (!http_thread_->Start())
+			return false;
+	}
+
 	return true;
 }
 
@@ -225,10 +295,14 @@ kigoron::provider_t::Close()
 		}
 	}
 /* 5) Cleanup */
+	clients_by_id_.clear();
 	clients_.clear();
 
-/* Drop http port. */
+/* Drop http port, stopping the thread first as the server lives on it. */
+	if ((bool)http_thread_)
+		http_thread_->Stop();
 	server_.reset();
+	http_thread_.reset();
 
 /* Closing listening socket. */
 	if (nullptr != rssl_sock_) {
@@ -369,6 +443,616 @@ kigoron::provider_t::WriteRawClose (
 	return true;
 }
 
+/* Rewrite the stream id, and optionally stream state, of a pre-encoded
+ * message in place.  Stream state is only present on refresh and status
+ * messages, pass RSSL_STREAM_UNSPECIFIED to leave unchanged.
+ */
+bool
+kigoron::provider_t::ReplaceStreamId (
+	uint16_t rwf_version,
+	int32_t request_token,
+	uint8_t stream_state,
+	void* data,
+	size_t length
+	)
+{
+#ifndef NDEBUG
+	RsslEncodeIterator it = RSSL_INIT_ENCODE_ITERATOR;
+#else
+	RsslEncodeIterator it;
+	rsslClearEncodeIterator (&it);
+#endif
+	RsslBuffer buf = { static_cast<uint32_t> (length), static_cast<char*> (data) };
+	RsslRet rc;
+
+	rc = rsslSetEncodeIteratorBuffer (&it, &buf);
+	if (RSSL_RET_SUCCESS != rc) {
+		LOG(ERROR) << "rsslSetEncodeIteratorBuffer: { "
+			  "\"returnCode\": " << static_cast<signed> (rc) << ""
+			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+			" }";
+		return false;
+	}
+	rc = rsslSetEncodeIteratorRWFVersion (&it, rwf_major_version (rwf_version), rwf_minor_version (rwf_version));
+	if (RSSL_RET_SUCCESS != rc) {
+		LOG(ERROR) << "rsslSetEncodeIteratorRWFVersion: { "
+			  "\"returnCode\": " << static_cast<signed> (rc) << ""
+			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+			", \"majorVersion\": " << static_cast<unsigned> (rwf_major_version (rwf_version)) << ""
+			", \"minorVersion\": " << static_cast<unsigned> (rwf_minor_version (rwf_version)) << ""
+			" }";
+		return false;
+	}
+	rc = rsslReplaceStreamId (&it, request_token);
+	if (RSSL_RET_SUCCESS != rc) {
+		LOG(ERROR) << "rsslReplaceStreamId: { "
+			  "\"returnCode\": " << static_cast<signed> (rc) << ""
+			", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+			", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+			", \"streamId\": " << request_token << ""
+			" }";
+		return false;
+	}
+	if (RSSL_STREAM_UNSPECIFIED != stream_state) {
+		rc = rsslReplaceStreamState (&it, stream_state);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslReplaceStreamState: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				", \"streamState\": \"" << rsslStreamStateToString (stream_state) << "\""
+				" }";
+			return false;
+		}
+	}
+	return true;
+}
+
+const std::string*
+kigoron::provider_t::GetEncodedMessage (
+	uint64_t key
+	)
+{
+	boost::lock_guard<boost::mutex> lock (encoded_messages_lock_);
+	auto it = encoded_messages_.find (key);
+	if (encoded_messages_.end() == it)
+		return nullptr;
+	return &it->second;
+}
+
+const std::string*
+kigoron::provider_t::SetEncodedMessage (
+	uint64_t key,
+	const void* data,
+	size_t length
+	)
+{
+	boost::lock_guard<boost::mutex> lock (encoded_messages_lock_);
+	auto it = encoded_messages_.emplace (key, std::string (static_cast<const char*> (data), length));
+	return &it.first->second;
+}
+
+const std::string*
+kigoron::provider_t::GetRefreshImage (
+	const void* item,
+	uint64_t key
+	) const
+{
+	auto it = refresh_images_.find (std::make_pair (item, key));
+	if (refresh_images_.end() == it)
+		return nullptr;
+	return &it->second;
+}
+
+/* Emptied rather than evicted when full, images are cheap to re-encode. */
+void
+kigoron::provider_t::SetRefreshImage (
+	const void* item,
+	uint64_t key,
+	const void* data,
+	size_t length
+	)
+{
+	if (refresh_images_.size() >= kRefreshImageCapacity)
+		refresh_images_.clear();
+	refresh_images_.emplace (std::make_pair (item, key), std::string (static_cast<const char*> (data), length));
+}
+
+void
+kigoron::provider_t::RecordLatency (
+	latency_stage_e stage
+	)
+{
+	if (0 == receipt_time_)
+		return;
+	RecordLatency (receipt_client_, receipt_domain_, receipt_time_, stage);
+}
+
+void
+kigoron::provider_t::RecordLatency (
+	client_t* client,
+	unsigned domain,
+	uint64_t receipt_time,
+	latency_stage_e stage
+	)
+{
+	DCHECK(domain < LATENCY_DOMAIN_MAX);
+	DCHECK(stage < LATENCY_STAGE_MAX);
+	const uint64_t elapsed = latency::ToNanoseconds (latency::Now() - receipt_time);
+	latency_[stage].Record (elapsed);
+	domain_latency_[domain][stage].Record (elapsed);
+	if (nullptr != client)
+		client->latency_->stages[stage].Record (elapsed);
+}
+
+unsigned
+kigoron::provider_t::latency_domain (
+	uint8_t domain_type
+	)
+{
+	switch (domain_type) {
+	case RSSL_DMT_LOGIN:		return LATENCY_DOMAIN_LOGIN;
+	case RSSL_DMT_SOURCE:		return LATENCY_DOMAIN_SOURCE;
+	case RSSL_DMT_DICTIONARY:	return LATENCY_DOMAIN_DICTIONARY;
+	case RSSL_DMT_MARKET_PRICE:	return LATENCY_DOMAIN_MARKET_PRICE;
+	default:			return LATENCY_DOMAIN_OTHER;
+	}
+}
+
+namespace {
+
+/* Object of histograms per stage, as the change since the previous call
+ * unless cumulative.
+ */
+template <typename Histogram>
+void
+WriteLatencyStages (
+	const Histogram* histograms,
+	kigoron::histogram_snapshot_t* previous,
+	bool is_cumulative,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	writer->BeginObject();
+	for (unsigned i = 0; i < kigoron::LATENCY_STAGE_MAX; ++i) {
+		kigoron::histogram_snapshot_t snapshot;
+		histograms[i].Snapshot (&snapshot);
+		writer->Key (kigoron::latency_stage_string (static_cast<kigoron::latency_stage_e> (i)));
+		if (is_cumulative) {
+			snapshot.WriteJson (writer);
+		} else {
+			kigoron::histogram_snapshot_t interval (snapshot);
+			interval.Subtract (previous[i]);
+			interval.WriteJson (writer);
+			previous[i] = snapshot;
+		}
+	}
+	writer->EndObject();
+}
+
+const char* kLatencyDomainNames[kigoron::LATENCY_DOMAIN_MAX] = {
+	"MMT_LOGIN",
+	"MMT_DIRECTORY",
+	"MMT_DICTIONARY",
+	"MMT_MARKET_PRICE",
+	"other"
+};
+
+}  // namespace anon
+
+/* Latency in nanoseconds from receipt, per stage for all messages, per
+ * domain, and per client.  Interval values cover the period since the
+ * previous interval request, clients are those of the published snapshot.
+ */
+void
+kigoron::provider_t::CreateLatency (
+	bool is_cumulative,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	const auto now = boost::posix_time::second_clock::universal_time();
+	writer->BeginObject();
+	writer->Key ("interval");
+	if (!is_cumulative) {
+		writer->Int64 ((now - latency_previous_time_).total_seconds());
+		latency_previous_time_ = now;
+	} else {
+		writer->Int64 ((now - creation_time_).total_seconds());
+	}
+
+	writer->Key ("global");
+	WriteLatencyStages (latency_, latency_previous_, is_cumulative, writer);
+
+	writer->Key ("domains");
+	writer->BeginObject();
+	for (unsigned i = 0; i < LATENCY_DOMAIN_MAX; ++i) {
+		writer->Key (kLatencyDomainNames[i]);
+		WriteLatencyStages (domain_latency_[i], domain_latency_previous_[i], is_cumulative, writer);
+	}
+	writer->EndObject();
+
+	writer->Key ("clients");
+	writer->BeginArray();
+	const auto snapshot = this->snapshot();
+/* Rebuilt per call such that closed sessions are dropped. */
+	std::map<uint64_t, std::vector<histogram_snapshot_t>> client_latency_previous;
+	for (auto it = snapshot->clients.begin(); it != snapshot->clients.end(); ++it) {
+		const client_snapshot_t& client = **it;
+		std::vector<histogram_snapshot_t>& previous = client_latency_previous[client.id];
+		auto jt = client_latency_previous_.find (client.id);
+		if (client_latency_previous_.end() != jt)
+			previous.swap (jt->second);
+		else
+			previous.resize (LATENCY_STAGE_MAX);
+		writer->BeginObject();
+		writer->Key ("address");
+		writer->String (*client.address);
+		writer->Key ("latency");
+		WriteLatencyStages (client.latency->stages, previous.data(), is_cumulative, writer);
+		writer->EndObject();
+	}
+	client_latency_previous_.swap (client_latency_previous);
+	writer->EndArray();
+	writer->EndObject();
+}
+
+namespace {
+
+/* Prometheus metric name suffixes, in performance counter order. */
+const char* kProviderCounterNames[] = {
+	"bytes_received",
+	"uncompressed_bytes_received",
+	"bytes_sent",
+	"uncompressed_bytes_sent",
+	"msgs_sent",
+	"rssl_msgs_enqueued",
+	"rssl_msgs_sent",
+	"rssl_msgs_received",
+	"rssl_msgs_decoded",
+	"rssl_msgs_malformed",
+	"rssl_msgs_validated",
+	"connection_received",
+	"connection_rejected",
+	"connection_accepted",
+	"connection_exception",
+	"rwf_version_unsupported",
+	"rssl_ping_sent",
+	"rssl_pong_received",
+	"rssl_pong_timeout",
+	"rssl_protocol_downgrade",
+	"rssl_flush",
+	"omm_active_client_session_received",
+	"omm_active_client_session_exception",
+	"client_session_rejected",
+	"client_session_accepted",
+	"rssl_reconnect",
+	"rssl_congestion_detected",
+	"rssl_slow_reader",
+	"rssl_packet_gap_detected",
+	"rssl_read_failure",
+	"client_init_exception",
+	"directory_map_exception",
+	"rssl_ping_exception",
+	"rssl_ping_flush_failed",
+	"rssl_ping_no_buffers",
+	"rssl_write_exception",
+	"rssl_write_flush_failed",
+	"rssl_write_no_buffers",
+	"rssl_output_buffers_grown",
+};
+
+COMPILE_ASSERT(arraysize (kProviderCounterNames) == kigoron::PROVIDER_PC_MAX, provider_counter_names_mismatch);
+
+const char* kClientCounterNames[] = {
+	"bytes_received",
+	"uncompressed_bytes_received",
+	"bytes_sent",
+	"uncompressed_bytes_sent",
+	"rssl_msgs_sent",
+	"rssl_msgs_received",
+	"rssl_msgs_rejected",
+	"request_msgs_received",
+	"request_msgs_rejected",
+	"close_msgs_received",
+	"close_msgs_discarded",
+	"mmt_login_received",
+	"mmt_login_malformed",
+	"mmt_login_rejected",
+	"mmt_login_accepted",
+	"mmt_login_response_validated",
+	"mmt_login_response_malformed",
+	"mmt_login_exception",
+	"mmt_login_close_received",
+	"mmt_directory_request_received",
+	"mmt_directory_validated",
+	"mmt_directory_malformed",
+	"mmt_directory_sent",
+	"mmt_directory_exception",
+	"mmt_directory_close_received",
+	"mmt_dictionary_request_received",
+	"mmt_dictionary_request_rejected",
+	"mmt_dictionary_fragment_sent",
+	"mmt_dictionary_sent",
+	"mmt_dictionary_close_received",
+	"item_request_received",
+	"item_request_malformed",
+	"item_request_before_login",
+	"item_streaming_request_received",
+	"item_reissue_request_received",
+	"item_snapshot_request_received",
+	"item_duplicate_snapshot",
+	"item_request_rejected",
+	"item_validated",
+	"item_malformed",
+	"item_not_found",
+	"item_sent",
+	"item_closed",
+	"item_exception",
+	"item_close_received",
+	"item_close_malformed",
+	"item_close_validated",
+	"omm_inactive_client_session_received",
+	"omm_inactive_client_session_exception",
+};
+
+COMPILE_ASSERT(arraysize (kClientCounterNames) == kigoron::CLIENT_PC_MAX, client_counter_names_mismatch);
+
+const double kLatencyQuantiles[] = { 0.5, 0.9, 0.99, 0.999, 0.9999 };
+
+}  // namespace anon
+
+/* Text exposition format 0.0.4, appended to a caller owned buffer.  All
+ * formatting is direct to the buffer and the histogram snapshot is reused,
+ * such that a buffer with sufficient capacity incurs no allocation.  Client
+ * counters and gauges are as of the published snapshot.
+ */
+void
+kigoron::provider_t::WriteMetrics (
+	std::string* buffer
+	)
+{
+	using chromium::StringAppendF;
+	const auto snapshot = this->snapshot();
+
+/* Provider counters */
+	for (unsigned i = 0; i < PROVIDER_PC_MAX; ++i) {
+		StringAppendF (buffer, "# TYPE kigoron_provider_%s_total counter\n", kProviderCounterNames[i]);
+		StringAppendF (buffer, "kigoron_provider_%s_total %" PRIu64 "\n", kProviderCounterNames[i], cumulative_stats_.value (i));
+	}
+
+/* Gauges */
+	StringAppendF (buffer, "# TYPE kigoron_symbols gauge\nkigoron_symbols %" PRIuS "\n", symbol_count_.load (boost::memory_order_relaxed));
+	StringAppendF (buffer, "# TYPE kigoron_connections gauge\nkigoron_connections %" PRIuS "\n", snapshot->connection_count);
+	if (snapshot->has_server_info) {
+		StringAppendF (buffer, "# TYPE kigoron_rssl_server_buffer_usage gauge\nkigoron_rssl_server_buffer_usage %u\n", snapshot->server_info.currentBufferUsage);
+		StringAppendF (buffer, "# TYPE kigoron_rssl_server_peak_buffer_usage gauge\nkigoron_rssl_server_peak_buffer_usage %u\n", snapshot->server_info.peakBufferUsage);
+	}
+
+/* Latency summaries, cumulative since startup. */
+	buffer->append ("# TYPE kigoron_latency_nanoseconds summary\n");
+	for (unsigned stage = 0; stage < LATENCY_STAGE_MAX; ++stage) {
+		const char* stage_name = latency_stage_string (static_cast<latency_stage_e> (stage));
+		latency_[stage].Snapshot (&metrics_snapshot_);
+		for (size_t i = 0; i < arraysize (kLatencyQuantiles); ++i) {
+			StringAppendF (buffer, "kigoron_latency_nanoseconds{stage=\"%s\",quantile=\"%g\"} %" PRIu64 "\n",
+				stage_name, kLatencyQuantiles[i], metrics_snapshot_.ValueAtPercentile (kLatencyQuantiles[i] * 100.0));
+		}
+		StringAppendF (buffer, "kigoron_latency_nanoseconds_sum{stage=\"%s\"} %" PRIu64 "\n", stage_name, metrics_snapshot_.total_sum());
+		StringAppendF (buffer, "kigoron_latency_nanoseconds_count{stage=\"%s\"} %" PRIu64 "\n", stage_name, metrics_snapshot_.total_count());
+	}
+	buffer->append ("# TYPE kigoron_domain_latency_nanoseconds summary\n");
+	for (unsigned domain = 0; domain < LATENCY_DOMAIN_MAX; ++domain) {
+		for (unsigned stage = 0; stage < LATENCY_STAGE_MAX; ++stage) {
+			const char* stage_name = latency_stage_string (static_cast<latency_stage_e> (stage));
+			domain_latency_[domain][stage].Snapshot (&metrics_snapshot_);
+			for (size_t i = 0; i < arraysize (kLatencyQuantiles); ++i) {
+				StringAppendF (buffer, "kigoron_domain_latency_nanoseconds{domain=\"%s\",stage=\"%s\",quantile=\"%g\"} %" PRIu64 "\n",
+					kLatencyDomainNames[domain], stage_name, kLatencyQuantiles[i], metrics_snapshot_.ValueAtPercentile (kLatencyQuantiles[i] * 100.0));
+			}
+			StringAppendF (buffer, "kigoron_domain_latency_nanoseconds_sum{domain=\"%s\",stage=\"%s\"} %" PRIu64 "\n", kLatencyDomainNames[domain], stage_name, metrics_snapshot_.total_sum());
+			StringAppendF (buffer, "kigoron_domain_latency_nanoseconds_count{domain=\"%s\",stage=\"%s\"} %" PRIu64 "\n", kLatencyDomainNames[domain], stage_name, metrics_snapshot_.total_count());
+		}
+	}
+
+/* Client counters, labelled by address and session as addresses may repeat.
+ * Series are unbounded with session churn so only exported on request.
+ */
+	if (!config_.metrics_per_client)
+		return;
+	for (unsigned i = 0; i < CLIENT_PC_MAX; ++i) {
+		StringAppendF (buffer, "# TYPE kigoron_client_%s_total counter\n", kClientCounterNames[i]);
+		for (auto it = snapshot->clients.begin(); it != snapshot->clients.end(); ++it) {
+			const client_snapshot_t& client = **it;
+			StringAppendF (buffer, "kigoron_client_%s_total{address=\"%s\",session=\"%" PRIu64 "\"} %" PRIu64 "\n",
+				kClientCounterNames[i], client.address->c_str(), client.id, client.stats[i]);
+		}
+	}
+}
+
+/* One topic of the WebSocket telemetry frame.  Counter deltas and rates
+ * cover the most recent snapshot interval, latency covers the period since
+ * the previous frame.
+ */
+void
+kigoron::provider_t::CreateTelemetry (
+	telemetry_topic_e topic,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	switch (topic) {
+	case TELEMETRY_TOPIC_COUNTERS: {
+		const auto snapshot = this->snapshot();
+		const auto& snap_stats = snapshot->stats;
+		const auto& previous_snap_stats = snapshot->previous_stats;
+		const double interval = previous_snap_stats.time().is_not_a_date_time() ? 0.0 :
+			(snap_stats.time() - previous_snap_stats.time()).total_microseconds() / 1000000.0;
+		writer->BeginObject();
+		writer->Key ("interval");
+		writer->Double (interval);
+		for (unsigned i = 0; i < PROVIDER_PC_MAX; ++i) {
+			writer->Key (kProviderCounterNames[i]);
+			writer->BeginObject();
+			writer->Key ("total");
+			writer->Uint64 (snap_stats[i]);
+			writer->Key ("delta");
+			writer->Uint64 (snap_stats.Delta (i, previous_snap_stats));
+			writer->Key ("rate");
+			writer->Double (snap_stats.Rate (i, previous_snap_stats));
+			writer->EndObject();
+		}
+		writer->EndObject();
+		break;
+	}
+	case TELEMETRY_TOPIC_LATENCY:
+		WriteLatencyStages (latency_, telemetry_latency_previous_, false, writer);
+		break;
+	default:
+		NOTREACHED();
+		writer->Null();
+		break;
+	}
+}
+
+/* Session table pages are keyed by id so each request visits at most
+ * |limit| sessions regardless of the session count.
+ */
+void
+kigoron::provider_t::CreateClients (
+	uint64_t after_id,
+	unsigned limit,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	const auto snapshot = this->snapshot();
+	const auto& clients = snapshot->clients;
+	writer->BeginObject();
+	writer->Key ("count");
+	writer->Uint64 (clients.size());
+	writer->Key ("clients");
+	writer->BeginArray();
+	auto it = std::upper_bound (clients.begin(), clients.end(), after_id,
+		[](uint64_t id, const std::shared_ptr<const client_snapshot_t>& client) { return id < client->id; });
+	uint64_t last_id = after_id;
+	for (unsigned i = 0; i < limit && clients.end() != it; ++i, ++it) {
+		WriteClient (**it, writer);
+		last_id = (*it)->id;
+	}
+	writer->EndArray();
+/* Cursor for the next page, absent on the last page. */
+	if (clients.end() != it && last_id != after_id) {
+		writer->Key ("next");
+		writer->Uint64 (last_id);
+	}
+	writer->EndObject();
+}
+
+bool
+kigoron::provider_t::CreateClient (
+	uint64_t id,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	const auto snapshot = this->snapshot();
+	const auto& clients = snapshot->clients;
+	auto it = std::lower_bound (clients.begin(), clients.end(), id,
+		[](const std::shared_ptr<const client_snapshot_t>& client, uint64_t id) { return client->id < id; });
+	if (clients.end() == it || (*it)->id != id)
+		return false;
+	WriteClient (**it, writer);
+	return true;
+}
+
+void
+kigoron::provider_t::WriteClient (
+	const client_snapshot_t& client,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	writer->BeginObject();
+	writer->Key ("id");
+	writer->Uint64 (client.id);
+	writer->Key ("address");
+	writer->String (*client.address);
+	writer->Key ("name");
+	writer->String (*client.name);
+	writer->Key ("created");
+	writer->String (boost::posix_time::to_iso_extended_string (client.creation_time));
+	writer->Key ("logged_in");
+	writer->Bool (client.is_logged_in);
+	writer->Key ("rwf_major_version");
+	writer->Int (client.rwf_major_version);
+	writer->Key ("rwf_minor_version");
+	writer->Int (client.rwf_minor_version);
+	writer->Key ("tokens");
+	writer->Uint64 (client.token_count);
+	writer->Key ("pending");
+	writer->Uint64 (client.pending_count);
+
+/* RSSL keepalive state */
+	writer->Key ("ping");
+	writer->BeginObject();
+	writer->Key ("interval");
+	writer->Uint64 (client.ping_interval);
+	writer->Key ("next_ping");
+	writer->String (boost::posix_time::to_iso_extended_string (client.next_ping));
+	writer->Key ("next_pong");
+	writer->String (boost::posix_time::to_iso_extended_string (client.next_pong));
+	writer->EndObject();
+
+	writer->Key ("counters");
+	writer->BeginObject();
+	for (unsigned i = 0; i < CLIENT_PC_MAX; ++i) {
+		writer->Key (kClientCounterNames[i]);
+		writer->Uint64 (client.stats[i]);
+	}
+	writer->EndObject();
+
+	if (client.has_channel_info) {
+		const RsslChannelInfo& info = client.channel_info;
+		writer->Key ("channel");
+		writer->BeginObject();
+		if (client.buffer_usage >= 0) {
+			writer->Key ("buffer_usage");
+			writer->Int (client.buffer_usage);
+		}
+		writer->Key ("guaranteed_output_buffers");
+		writer->Int (info.guaranteedOutputBuffers);
+		writer->Key ("max_output_buffers");
+		writer->Int (info.maxOutputBuffers);
+		writer->Key ("num_input_buffers");
+		writer->Int (info.numInputBuffers);
+		writer->Key ("max_fragment_size");
+		writer->Int (info.maxFragmentSize);
+		writer->Key ("compression_type");
+		writer->String (internal::compression_type_string (info.compressionType));
+		writer->Key ("compression_threshold");
+		writer->Int (info.compressionThreshold);
+		writer->Key ("receive_compression_ratio");
+		writer->Double (client_t::compression_ratio (client.stats[CLIENT_PC_UNCOMPRESSED_BYTES_RECEIVED], client.stats[CLIENT_PC_BYTES_RECEIVED]));
+		writer->Key ("send_compression_ratio");
+		writer->Double (client_t::compression_ratio (client.stats[CLIENT_PC_UNCOMPRESSED_BYTES_SENT], client.stats[CLIENT_PC_BYTES_SENT]));
+		writer->Key ("ping_timeout");
+		writer->Int (info.pingTimeout);
+		writer->Key ("sys_send_buf_size");
+		writer->Int (info.sysSendBufSize);
+		writer->Key ("sys_recv_buf_size");
+		writer->Int (info.sysRecvBufSize);
+		writer->EndObject();
+	}
+	writer->EndObject();
+}
+
+void
+kigoron::provider_t::CreateFlightRecorder (
+	size_t limit,
+	chromium::JSONStreamWriter* writer
+	)
+{
+	flight_recorder_.WriteJson (limit, writer);
+}
+
 bool
 kigoron::provider_t::SendReply (
 	RsslChannel*const handle,
@@ -387,11 +1071,23 @@ kigoron::provider_t::SendReply (
 		return false;
 }
 
-void
-kigoron::provider_t::CreateInfo (
-	kigoron::ProviderInfo* info
+kigoron::provider_t*
+kigoron::provider_t::FromHandle (
+	uintptr_t handle
 	)
 {
+	auto c = reinterpret_cast<RsslChannel*> (handle);
+	DCHECK(nullptr != c->userSpecPtr);
+	return reinterpret_cast<client_t*> (c->userSpecPtr)->provider_.get();
+}
+
+/* Process identity is fixed for the process lifetime, queried once with
+ * the JSON members pre-serialized for splicing into each info response.
+ */
+void
+kigoron::provider_t::CreateIdentity()
+{
+	ProviderIdentity* info = &identity_;
 	char http_hostname[NI_MAXHOST];
 	char http_username[LOGIN_NAME_MAX + 1];
 	int rc;
@@ -446,11 +1142,34 @@ kigoron::provider_t::CreateInfo (
 /* pid */
 	info->pid = getpid();
 
+/* members without enclosing braces */
+	std::string json;
+	chromium::JSONStreamWriter writer (&json);
+	writer.BeginObject();
+	writer.Key ("hostname");
+	writer.String (info->hostname);
+	writer.Key ("username");
+	writer.String (info->username);
+	writer.Key ("pid");
+	writer.Int (info->pid);
+	writer.Key ("listener");
+	writer.String (listener_.name);
+	writer.EndObject();
+	info->json.assign (json, 1, json.size() - 2);
+}
+
+void
+kigoron::provider_t::CreateInfo (
+	kigoron::ProviderInfo* info
+	)
+{
+	const auto snapshot = this->snapshot();
 /* clients */
-	info->client_count = connections_.size();
+	info->client_count = static_cast<unsigned> (snapshot->connection_count);
 
 /* app level request count */
-	info->msgs_received = cumulative_stats_[PROVIDER_PC_RSSL_MSGS_RECEIVED];
+	info->msgs_received = cumulative_stats_.value (PROVIDER_PC_RSSL_MSGS_RECEIVED);
+	info->msgs_received_rate = snapshot->stats.Rate (PROVIDER_PC_RSSL_MSGS_RECEIVED, snapshot->previous_stats);
 }
 
 void
@@ -465,17 +1184,6 @@ kigoron::provider_t::Run()
 	in_tv_.tv_sec = 0;
 	in_tv_.tv_usec = 1000 * 100;	// 100ms timeout
 
-/* reset any Chromium sockets that are lost from selector */
-	for (auto it = watch_list_.begin();
-		it != watch_list_.end();
-		++it)
-	{
-		if (auto sp = it->lock()) {
-			net::SocketDescriptor fd = sp->event_->first;
-			FD_SET (fd, &in_rfds_);
-		}
-	}
-
 	for (;;) {
 		bool did_work = DoWork();
 
@@ -505,6 +1213,25 @@ kigoron::provider_t::DoWork()
 
 	last_activity_ = boost::posix_time::second_clock::universal_time();
 
+	if (is_flight_dump_requested_.exchange (false))
+		DumpFlightRecorder();
+
+/* Roll performance counter snapshots and publish provider state, then
+ * have the HTTP thread push telemetry for the interval and sweep idle
+ * connections on the same tick.
+ */
+	if (last_activity_ >= next_snapshot_) {
+		SnapshotStats();
+		if ((bool)http_thread_ && (bool)server_) {
+			PublishSnapshot();
+			KigoronHttpServer* server = server_.get();
+			http_thread_->PostTask ([server]() {
+				server->PublishTelemetry();
+				server->CloseIdleConnections();
+			});
+		}
+	}
+
 /* Only check keepalives on timeout */
 	if (out_nfds_ <= 0)
 	{
@@ -531,8 +1258,10 @@ kigoron::provider_t::DoWork()
 				{
 					boost::lock_guard<boost::shared_mutex> lock (clients_lock_);
 					auto kt = clients_.find (c);
-					if (clients_.end() != kt)
+					if (clients_.end() != kt) {
+						clients_by_id_.erase (kt->second->id());
 						clients_.erase (kt);
+					}
 				}
 /* Remove RSSL socket from further event notification */
 				FD_CLR (c->socketId, &in_rfds_);
@@ -593,8 +1322,10 @@ kigoron::provider_t::DoWork()
 			{
 				boost::lock_guard<boost::shared_mutex> lock (clients_lock_);
 				auto kt = clients_.find (c);
-				if (clients_.end() != kt)
+				if (clients_.end() != kt) {
+					clients_by_id_.erase (kt->second->id());
 					clients_.erase (kt);
+				}
 			}
 /* Remove RSSL socket from further event notification */
 			FD_CLR (c->socketId, &in_rfds_);
@@ -608,143 +1339,111 @@ kigoron::provider_t::DoWork()
 		}
 	}
 
-/* Chromium sockets, exceptions are ignored. */
-	for (auto it = watch_list_.begin();
-		it != watch_list_.end();)
-	{
-		if (auto sp = it->lock()) {
-			FileDescriptorWatcher* controller = sp.get();
-			net::SocketDescriptor fd = controller->event_->first;
-			if (FD_ISSET (fd, &out_rfds_)) {
-				FD_CLR (fd, &out_rfds_);
-				controller->OnFileCanReadWithoutBlocking (fd, this);
-				did_work = true;
-			}
-			if (FD_ISSET (fd, &out_wfds_)) {
-				FD_CLR (fd, &out_wfds_);
-				controller->OnFileCanWriteWithoutBlocking (fd, this);
-				did_work = true;
-			}
-			++it;
-		} else {
-			auto jt = it++;
-			watch_list_.erase (jt);
-		}
-	}
-
 	return did_work;
 }
 
-/* Add a Chromium socket to the message loop monitoring pool */
-bool
-kigoron::provider_t::WatchFileDescriptor (
-	net::SocketDescriptor fd,
-	bool persistent,
-	kigoron::provider_t::Mode mode,
-	kigoron::provider_t::FileDescriptorWatcher* controller,
-	kigoron::provider_t::Watcher* delegate
-	)
+/* Snapshot the provider and all client counters for interval rates. */
+void
+kigoron::provider_t::SnapshotStats()
 {
-	DCHECK_GE(fd, 0);
-	DCHECK(controller);
-	DCHECK(delegate);
-	DCHECK(mode == WATCH_READ || mode == WATCH_WRITE || mode == WATCH_READ_WRITE);
-
-	if (mode & WATCH_READ) {
-		FD_SET (fd, &in_rfds_);
-	}
-	if (mode & WATCH_WRITE) {
-		FD_SET (fd, &in_wfds_);
-	}
-
-	std::unique_ptr<FileDescriptorWatcher::event> evt (controller->ReleaseEvent());
-	if (!(bool)evt) {
-		evt.reset (new FileDescriptorWatcher::event (fd, mode));
-	} else {
-		evt->first = fd;
-		evt->second = mode;
+	previous_snap_stats_ = snap_stats_;
+	cumulative_stats_.Snapshot (&snap_stats_);
+	for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+		RsslChannel* c = *it;
+		if (nullptr != c->userSpecPtr) {
+			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+			client->previous_snap_stats_ = client->snap_stats_;
+			client->cumulative_stats_.Snapshot (&client->snap_stats_);
+		}
 	}
-
-// Add this socket to the list of monitored sockets.
-	watch_list_.emplace_front (std::weak_ptr<FileDescriptorWatcher> (controller->weak_factory_));
-
-// Transfer ownership of evt to controller.
-	controller->Init(evt.release());
-
-	controller->set_watcher (delegate);
-	controller->set_pump (this);
-
-	return true;
+	next_snapshot_ = last_activity_ + boost::posix_time::seconds (kSnapshotInterval);
 }
 
-struct NullDeleter {template<typename T> void operator()(T*) {} };
-
-kigoron::provider_t::FileDescriptorWatcher::FileDescriptorWatcher()
-	: event_ (nullptr)
-	, pump_ (nullptr)
-	, watcher_ (nullptr)
-	, weak_factory_ (this, NullDeleter())
-{
-}
-
-kigoron::provider_t::FileDescriptorWatcher::~FileDescriptorWatcher()
+/* Copy of provider and client session state for the HTTP thread, taken
+ * after the counter snapshot such that rates and totals agree.  A session
+ * view is only rebuilt when the session has changed since it was last
+ * published, idle sessions cost a comparison and a reference.
+ */
+void
+kigoron::provider_t::PublishSnapshot()
 {
-	if (nullptr != event_) {
-		StopWatchingFileDescriptor();
+	auto snapshot = std::make_shared<provider_snapshot_t>();
+	RsslError rssl_err;
+	snapshot->stats = snap_stats_;
+	snapshot->previous_stats = previous_snap_stats_;
+	snapshot->connection_count = connections_.size();
+	snapshot->has_server_info = (nullptr != rssl_sock_ &&
+		RSSL_RET_SUCCESS == rsslGetServerInfo (rssl_sock_, &snapshot->server_info, &rssl_err));
+	snapshot->clients.reserve (clients_by_id_.size());
+	for (auto it = clients_by_id_.begin(); it != clients_by_id_.end(); ++it) {
+		client_t& client = *it->second;
+		if (IsViewCurrent (client)) {
+			snapshot->clients.push_back (client.view_);
+			continue;
+		}
+		auto view_ptr = std::make_shared<client_snapshot_t>();
+		client_snapshot_t& view = *view_ptr;
+		view.id = client.id_;
+		view.address = client.address_;
+		view.name = client.name_;
+		view.creation_time = client.creation_time_;
+		view.is_logged_in = client.is_logged_in_;
+		view.rwf_major_version = client.rwf_major_version();
+		view.rwf_minor_version = client.rwf_minor_version();
+		view.token_count = client.tokens_.size();
+		view.pending_count = client.pending_count_;
+		view.ping_interval = client.ping_interval_;
+		view.next_ping = client.next_ping_;
+		view.next_pong = client.next_pong_;
+		view.stats = client.snap_stats_;
+		view.has_channel_info = client.has_channel_info_;
+		view.channel_info = client.channel_info_;
+/* Output buffers are only held by messages awaiting flush. */
+		view.buffer_usage = (0 == client.pending_count_) ? 0 : rsslBufferUsage (client.handle_, &rssl_err);
+		view.latency = client.latency_;
+		client.view_ = view_ptr;
+		snapshot->clients.push_back (std::move (view_ptr));
+	}
+/* Previous snapshot is released outside of the lock. */
+	{
+		boost::lock_guard<boost::mutex> lock (snapshot_lock_);
+		snapshot_.swap (snapshot);
 	}
 }
 
+/* Whether the last published view still matches the session.  Channel
+ * state changes drop the view, buffer usage is only stable with no output
+ * pending.
+ */
 bool
-kigoron::provider_t::FileDescriptorWatcher::StopWatchingFileDescriptor()
-{
-	event* e = ReleaseEvent();
-	if (nullptr == e) {
-		return true;
-	}
-
-	FD_CLR (e->first, &pump_->in_rfds_);
-	delete e;
-	pump_ = nullptr;
-	watcher_ = nullptr;
-	return true;
-}
-
-void
-kigoron::provider_t::FileDescriptorWatcher::Init (kigoron::provider_t::FileDescriptorWatcher::event *e)
-{
-	DCHECK(e);
-	DCHECK(!event_);
-
-	event_ = e;
-}
-
-kigoron::provider_t::FileDescriptorWatcher::event*
-kigoron::provider_t::FileDescriptorWatcher::ReleaseEvent()
+kigoron::provider_t::IsViewCurrent (
+	const client_t& client
+	) const
 {
-	FileDescriptorWatcher::event *e = event_;
-	event_ = nullptr;
-	return e;
-}
-
-void
-kigoron::provider_t::FileDescriptorWatcher::OnFileCanReadWithoutBlocking (
-	net::SocketDescriptor fd,
-	kigoron::provider_t* pump
-	)
-{
-	if (!watcher_)
-		return;
-	watcher_->OnFileCanReadWithoutBlocking (fd);
+	const client_snapshot_t* view = client.view_.get();
+	return nullptr != view
+		&& 0 == client.pending_count_
+		&& view->pending_count == client.pending_count_
+		&& view->is_logged_in == client.is_logged_in_
+		&& view->rwf_major_version == client.rwf_major_version()
+		&& view->rwf_minor_version == client.rwf_minor_version()
+		&& view->token_count == client.tokens_.size()
+		&& view->ping_interval == client.ping_interval_
+		&& view->next_ping == client.next_ping_
+		&& view->next_pong == client.next_pong_
+		&& view->stats.Equals (client.snap_stats_);
 }
 
+/* First listener at the configured path, others with the listener name
+ * appended.
+ */
 void
-kigoron::provider_t::FileDescriptorWatcher::OnFileCanWriteWithoutBlocking (
-	net::SocketDescriptor fd,
-	kigoron::provider_t* pump
-	)
+kigoron::provider_t::DumpFlightRecorder()
 {
-	DCHECK(watcher_);
-	watcher_->OnFileCanWriteWithoutBlocking (fd);
+	std::string path (config_.flight_recorder_path);
+	if (listener_.name != config_.listeners.front().name)
+		path.append (".").append (listener_.name);
+	flight_recorder_.DumpToFile (path);
 }
 
 void
@@ -763,7 +1462,7 @@ kigoron::provider_t::OnConnection (
 {
 	DCHECK (nullptr != rssl_sock);
 	cumulative_stats_[PROVIDER_PC_CONNECTION_RECEIVED]++;
-	if (!is_accepting_connections_ || connections_.size() == config_.session_capacity)
+	if (!is_accepting_connections_ || connections_.size() == listener_.session_capacity)
 		RejectConnection (rssl_sock);
 	else
 		AcceptConnection (rssl_sock);
@@ -815,6 +1514,11 @@ kigoron::provider_t::AcceptConnection (
 	VLOG(2) << "Accepting new connection request.";
 
 	addr.nakMount = RSSL_FALSE;
+/* Applied before the handshake, replacing per channel ioctls afterwards. */
+	if (0 != listener_.send_buffer_size)
+		addr.sysSendBufSize = listener_.send_buffer_size;
+	if (0 != listener_.recv_buffer_size)
+		addr.sysRecvBufSize = listener_.recv_buffer_size;
 	RsslChannel* c = rsslAccept (rssl_sock, &addr, &rssl_err);
 	if (nullptr == c) {
 		LOG(ERROR) << "rsslAccept: { "
@@ -822,6 +1526,8 @@ kigoron::provider_t::AcceptConnection (
 			", \"sysError\": " << rssl_err.sysError << ""
 			", \"text\": \"" << rssl_err.text << "\""
 			", \"nakMount\": " << (addr.nakMount ? "true" : "false") << ""
+			", \"sysSendBufSize\": " << addr.sysSendBufSize << ""
+			", \"sysRecvBufSize\": " << addr.sysRecvBufSize << ""
 			" }";
 	} else {
 /* Add to directory of all client connections */
@@ -947,13 +1653,21 @@ kigoron::provider_t::OnCanWriteWithoutBlocking (
 	rc = rsslFlush (c, &rssl_err);
 	if (RSSL_RET_SUCCESS == rc) {
 		cumulative_stats_[PROVIDER_PC_RSSL_FLUSH]++;
+		flight_recorder_.Record (FLIGHT_EVENT_FLUSH, c->socketId, 0);
 		FD_CLR (c->socketId, &in_wfds_);
 /* Sent data equivalent to a ping. */
 		if (nullptr != c->userSpecPtr) {
 			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+/* Every pending response now on the wire. */
+			for (auto it = client->pending_receipts_.begin(); it != client->pending_receipts_.end(); ++it)
+				RecordLatency (client, it->second, it->first, LATENCY_STAGE_FLUSH);
+			client->pending_receipts_.clear();
 			cumulative_stats_[PROVIDER_PC_RSSL_MSGS_SENT] += client->GetPendingCount();
 			client->ClearPendingCount();
 			client->SetNextPing (last_activity_ + boost::posix_time::seconds (client->ping_interval_));
+/* Resume any multi-part responses blocked on output. */
+			if (!client->OnFlush())
+				Abort (c);
 		}
 	} else if (rc > 0) {
 		DVLOG(1) << static_cast<signed> (rc) << " bytes pending.";
@@ -986,6 +1700,7 @@ kigoron::provider_t::Close (
 
 	DCHECK (nullptr != c);
 
+	flight_recorder_.Record (FLIGHT_EVENT_CLOSE, c->socketId, 0);
 	LOG(INFO) << "Closing RSSL connection.";
 	if (RSSL_RET_SUCCESS != rsslCloseChannel (c, &rssl_err)) {
 		LOG(WARNING) << "rsslCloseChannel: { "
@@ -1014,7 +1729,7 @@ kigoron::provider_t::OnActiveClientSession (
 		boost::shared_lock<boost::shared_mutex> lock (clients_lock_);
 		const auto connection_count = clients_.size();
 		lock.unlock();
-		if (!is_accepting_connections_ || connection_count == config_.session_capacity)
+		if (!is_accepting_connections_ || connection_count == listener_.session_capacity)
 			RejectClientSession (handle, address);
 		else if (!AcceptClientSession (handle, address))
 			RejectClientSession (handle, address);
@@ -1041,9 +1756,10 @@ kigoron::provider_t::OnActiveState (
 	DCHECK (nullptr != c);
 
 	rsslClearReadInArgs (&in_args);
+/* Byte counters are read on every call. */
+	rsslClearReadOutArgs (&out_args);
 
 	if (logging::DEBUG_MODE) {
-		rsslClearReadOutArgs (&out_args);
 /* In place of absent API: rsslClearError (&rssl_err); */
 		rssl_err.rsslErrorId = 0;
 		rssl_err.sysError = 0;
@@ -1070,6 +1786,11 @@ kigoron::provider_t::OnActiveState (
 
 	cumulative_stats_[PROVIDER_PC_BYTES_RECEIVED] += out_args.bytesRead;
 	cumulative_stats_[PROVIDER_PC_UNCOMPRESSED_BYTES_RECEIVED] += out_args.uncompressedBytesRead;
+	if (nullptr != c->userSpecPtr) {
+		auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+		client->cumulative_stats_[CLIENT_PC_BYTES_RECEIVED] += out_args.bytesRead;
+		client->cumulative_stats_[CLIENT_PC_UNCOMPRESSED_BYTES_RECEIVED] += out_args.uncompressedBytesRead;
+	}
 
 	switch (rc) {
 /* Reliable multicast events with hard-fail override. */
@@ -1099,6 +1820,7 @@ check_closed_state:
 		break;
 	case RSSL_RET_READ_PING:
 		cumulative_stats_[PROVIDER_PC_RSSL_PONG_RECEIVED]++;
+		flight_recorder_.Record (FLIGHT_EVENT_PONG, c->socketId, 0);
 		if (nullptr != c->userSpecPtr) {
 			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
 			client->SetNextPong (last_activity_ + boost::posix_time::seconds (c->pingTimeout));
@@ -1123,7 +1845,13 @@ check_closed_state:
 	default: 
 		if (nullptr != buf) {
 			cumulative_stats_[PROVIDER_PC_RSSL_MSGS_RECEIVED]++;
+/* Latency is measured from receipt of the complete message. */
+			receipt_time_ = latency::Now();
 			OnMsg (c, buf);
+			receipt_time_ = 0;
+			receipt_client_ = nullptr;
+			receipt_domain_ = LATENCY_DOMAIN_OTHER;
+			receipt_stream_id_ = 0;
 /* Received data equivalent to a heartbeat pong. */
 			if (nullptr != c->userSpecPtr) {
 				auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
@@ -1199,6 +1927,11 @@ kigoron::provider_t::OnMsg (
 		return;
 	} else {
 		cumulative_stats_[PROVIDER_PC_RSSL_MSGS_DECODED]++;
+		receipt_domain_ = latency_domain (msg.msgBase.domainType);
+		receipt_client_ = reinterpret_cast<client_t*> (handle->userSpecPtr);
+		receipt_stream_id_ = msg.msgBase.streamId;
+		RecordLatency (LATENCY_STAGE_DECODE);
+		flight_recorder_.Record ((RSSL_MC_CLOSE == msg.msgBase.msgClass) ? FLIGHT_EVENT_CLOSE : FLIGHT_EVENT_RECEIVE, handle->socketId, msg.msgBase.streamId);
 		if (logging::DEBUG_MODE) {
 /* Pass through RSSL validation and report exceptions */
 			if (!rsslValidateMsg (&msg)) {
@@ -1250,27 +1983,17 @@ kigoron::provider_t::AcceptClientSession (
 /* Associate RSSL socket with smart pointer. */
 	handle->userSpecPtr = client.get();
 
-/* Determine lowest common Reuters Wire Format (RWF) version */
+/* Reuters Wire Format (RWF) version is per channel, encoded caches are per version. */
 	const uint16_t client_rwf_version = client->rwf_version();
-	if (0 == min_rwf_version_)
-	{
-		LOG(INFO) << "Setting RWF: { "
-				  "\"MajorVersion\": " << static_cast<unsigned> (rwf_major_version (client_rwf_version)) <<
-				", \"MinorVersion\": " << static_cast<unsigned> (rwf_minor_version (client_rwf_version)) <<
-				" }";
-		min_rwf_version_.store (client_rwf_version);
-	}
-	else if (min_rwf_version_ > client_rwf_version)
-	{
-		LOG(INFO) << "Degrading RWF: { "
-				  "\"MajorVersion\": " << static_cast<unsigned> (rwf_major_version (client_rwf_version)) <<
-				", \"MinorVersion\": " << static_cast<unsigned> (rwf_minor_version (client_rwf_version)) <<
-				" }";
-		min_rwf_version_.store (client_rwf_version);
-	}
+	VLOG(2) << "Client RWF: { "
+			  "\"MajorVersion\": " << static_cast<unsigned> (rwf_major_version (client_rwf_version)) <<
+			", \"MinorVersion\": " << static_cast<unsigned> (rwf_minor_version (client_rwf_version)) <<
+			" }";
 
 	boost::lock_guard<boost::shared_mutex> lock (clients_lock_);
+	client->id_ = ++next_client_id_;
 	clients_.emplace (std::make_pair (handle, client));
+	clients_by_id_.emplace (std::make_pair (client->id_, client));
 	cumulative_stats_[PROVIDER_PC_CLIENT_SESSION_ACCEPTED]++;
 	return true;
 }
@@ -1680,6 +2403,39 @@ kigoron::provider_t::GetServiceInformation (
 		return false;
 	}
 
+/* DictionariesProvided<Array of AsciiString>
+ * List of Dictionary names that this service provides, only when both
+ * dictionaries have been loaded from file.
+ */
+	if ((bool)dictionary_ && dictionary_->is_loaded()) {
+		element.name	   = RSSL_ENAME_DICTIONARYS_PROVIDED;
+		element.dataType   = RSSL_DT_ARRAY;
+		rc = rsslEncodeElementEntryInit (it, &element, 0 /* size */);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslEncodeElementEntry: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				", \"name\": \"RSSL_ENAME_DICTIONARYS_PROVIDED\""
+				", \"dataType\": \"" << rsslDataTypeToString (element.dataType) << "\""
+				" }";
+			return false;
+		}
+		if (!GetServiceDictionaries (it)) {
+			LOG(ERROR) << "GetServiceDictionaries failed.";
+			return false;
+		}
+		rc = rsslEncodeElementEntryComplete (it, RSSL_TRUE /* commit */);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslEncodeElementEntryComplete: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				" }";
+			return false;
+		}
+	}
+
 /* QoS wrt. timeliness.  Provided for defect workaround with rsslConsumer demo & ADH fan-out.
  */
 	element.name	   = RSSL_ENAME_QOS;
@@ -1809,6 +2565,21 @@ kigoron::provider_t::GetServiceCapabilities (
 		return false;
 	}
 
+/* 2: Dictionary = 5, iff loaded */
+	if ((bool)dictionary_ && dictionary_->is_loaded()) {
+		static const uint64_t dictionary_domain = RSSL_DMT_DICTIONARY;
+		rc = rsslEncodeArrayEntry (it, nullptr /* no pre-encoded data */, &dictionary_domain);
+		if (RSSL_RET_SUCCESS != rc) {
+			LOG(ERROR) << "rsslEncodeArrayEntry: { "
+				  "\"returnCode\": " << static_cast<signed> (rc) << ""
+				", \"enumeration\": \"" << rsslRetCodeToString (rc) << "\""
+				", \"text\": \"" << rsslRetCodeInfo (rc) << "\""
+				", \"domainType\": \"" << rsslDomainTypeToString (dictionary_domain) << "\""
+				" }";
+			return false;
+		}
+	}
+
 	rc = rsslEncodeArrayComplete (it, RSSL_TRUE /* commit */);
 	if (RSSL_RET_SUCCESS != rc) {
 		LOG(ERROR) << "rsslEncodeArrayComplete: { "
@@ -1854,7 +2625,7 @@ kigoron::provider_t::GetServiceDictionaries (
 	}
 
 /* 1: RDM Field Dictionary */
-	data_buffer.data   = const_cast<char*> (kRdmFieldDictionaryName.c_str());
+	data_buffer.data   = const_cast<char*> (kRdmFieldDictionaryName.data());
 	data_buffer.length = static_cast<uint32_t> (kRdmFieldDictionaryName.size());
 	rc = rsslEncodeArrayEntry (it, nullptr /* no pre-encoded data */, &data_buffer);
 	if (RSSL_RET_SUCCESS != rc) {
@@ -1871,7 +2642,7 @@ kigoron::provider_t::GetServiceDictionaries (
 	}
 
 /* 2: Enumerated Type Dictionary */
-	data_buffer.data   = const_cast<char*> (kEnumTypeDictionaryName.c_str());
+	data_buffer.data   = const_cast<char*> (kEnumTypeDictionaryName.data());
 	data_buffer.length = static_cast<uint32_t> (kEnumTypeDictionaryName.size());
 	rc = rsslEncodeArrayEntry (it, nullptr /* no pre-encoded data */, &data_buffer);
 	if (RSSL_RET_SUCCESS != rc) {
@@ -2115,10 +2886,16 @@ kigoron::provider_t::GetServiceLoad (
 	return true;
 }
 
+/* Returns 1 when sent, -1 when enqueued behind pending output, and 0 on
+ * failure with the buffer still owned by the caller.  |is_exhausted| is set
+ * when the failure is an output pool that could not grow, the caller may
+ * retry once pending output is flushed.
+ */
 int
 kigoron::provider_t::Submit (
 	RsslChannel* c,
-	RsslBuffer* buf
+	RsslBuffer* buf,
+	bool* is_exhausted
 	)
 {
 	RsslWriteInArgs in_args;
@@ -2136,8 +2913,8 @@ kigoron::provider_t::Submit (
 	in_args.writeInFlags = should_write_direct ? RSSL_WRITE_DIRECT_SOCKET_WRITE : 0;
 
 try_again:
+	rsslClearWriteOutArgs (&out_args);
 	if (logging::DEBUG_MODE) {
-		rsslClearWriteOutArgs (&out_args);
 /* rsslClearError (&rssl_err); */
 		rssl_err.rsslErrorId = 0;
 		rssl_err.sysError = 0;
@@ -2161,6 +2938,13 @@ try_again:
 			", \"text\": \"" << rssl_err.text << "\""
 			" }";
 	}
+	cumulative_stats_[PROVIDER_PC_BYTES_SENT] += out_args.bytesWritten;
+	cumulative_stats_[PROVIDER_PC_UNCOMPRESSED_BYTES_SENT] += out_args.uncompressedBytesWritten;
+	if (nullptr != c->userSpecPtr) {
+		auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+		client->cumulative_stats_[CLIENT_PC_BYTES_SENT] += out_args.bytesWritten;
+		client->cumulative_stats_[CLIENT_PC_UNCOMPRESSED_BYTES_SENT] += out_args.uncompressedBytesWritten;
+	}
 	if (rc > 0) {
 		if (nullptr != c->userSpecPtr) {
 			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
@@ -2177,11 +2961,39 @@ try_again:
 		goto pending;
 	case RSSL_RET_BUFFER_NO_BUFFERS:		/* empty buffer pool: spin wait until buffer is available. */
 		cumulative_stats_[PROVIDER_PC_RSSL_WRITE_NO_BUFFERS]++;
+/* Write again with the same buffer once the pool has room for the fragments. */
+		if (GrowOutputBuffers (c))
+			goto try_again;
+/* Not written, the caller releases the buffer.  Watch for the pending output
+ * holding the pool to drain.
+ */
+		FD_SET (c->socketId, &in_wfds_);
+		if (nullptr != is_exhausted)
+			*is_exhausted = true;
+		LOG(WARNING) << "rsslWriteEx: { "
+			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+			", \"sysError\": " << rssl_err.sysError << ""
+			", \"text\": \"" << rssl_err.text << "\""
+			", \"socketId\": " << c->socketId << ""
+			" }";
+		return 0;
 pending:
+/* Write latency once per message, not per fragment or retry. */
+		RecordLatency (LATENCY_STAGE_WRITE);
+		flight_recorder_.Record (FLIGHT_EVENT_WRITE, c->socketId, receipt_stream_id_);
 		FD_SET (c->socketId, &in_wfds_);	/* pending output */
+/* Flush latency is recorded per response when the queue drains. */
+		if (nullptr != c->userSpecPtr && 0 != receipt_time_) {
+			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+			client->pending_receipts_.emplace_back (receipt_time_, receipt_domain_);
+		}
 		return -1;
 	case RSSL_RET_SUCCESS:				/* sent, no flush required. */
 		cumulative_stats_[PROVIDER_PC_RSSL_MSGS_SENT]++;
+		RecordLatency (LATENCY_STAGE_WRITE);
+		flight_recorder_.Record (FLIGHT_EVENT_WRITE, c->socketId, receipt_stream_id_);
+		RecordLatency (LATENCY_STAGE_FLUSH);
+		flight_recorder_.Record (FLIGHT_EVENT_FLUSH, c->socketId, receipt_stream_id_);
 /* Sent data equivalent to a ping. */
 		if (nullptr != c->userSpecPtr) {
 			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
@@ -2252,6 +3064,7 @@ pending:
 		return -1;
 	case RSSL_RET_SUCCESS:				/* sent, no flush required. */
 		cumulative_stats_[PROVIDER_PC_RSSL_PING_SENT]++;
+		flight_recorder_.Record (FLIGHT_EVENT_PING, c->socketId, 0);
 /* Advance ping expiration only on success. */
 		if (nullptr != c->userSpecPtr) {
 			auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
@@ -2269,4 +3082,60 @@ pending:
 	}
 }
 
+/* Adaptive sizing: double the output buffer pool of an exhausted channel up
+ * to the listener limit, such that a burst of replies is enqueued instead of
+ * dropped.  Returns false when disabled or already at the limit.
+ */
+bool
+kigoron::provider_t::GrowOutputBuffers (
+	RsslChannel* c
+	)
+{
+	RsslChannelInfo info;
+	RsslError rssl_err;
+	RsslRet rc;
+
+	DCHECK(nullptr != c);
+	if (0 == listener_.output_buffer_limit)
+		return false;
+	rc = rsslGetChannelInfo (c, &info, &rssl_err);
+	if (RSSL_RET_SUCCESS != rc) {
+		LOG(WARNING) << "rsslGetChannelInfo: { "
+			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+			", \"sysError\": " << rssl_err.sysError << ""
+			", \"text\": \"" << rssl_err.text << "\""
+			" }";
+		return false;
+	}
+	if (info.maxOutputBuffers >= listener_.output_buffer_limit)
+		return false;
+	const uint32_t max_output_buffers = std::min<uint32_t> (info.maxOutputBuffers * 2, listener_.output_buffer_limit);
+	rc = rsslIoctl (c, RSSL_MAX_NUM_BUFFERS, const_cast<uint32_t*> (&max_output_buffers), &rssl_err);
+	if (rc < RSSL_RET_SUCCESS) {
+		LOG(WARNING) << "rssIoctl: { "
+			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
+			", \"sysError\": " << rssl_err.sysError << ""
+			", \"text\": \"" << rssl_err.text << "\""
+			", \"ioctlCode\": \"RSSL_MAX_NUM_BUFFERS\""
+			", \"value\": " << max_output_buffers << ""
+			" }";
+		return false;
+	}
+	cumulative_stats_[PROVIDER_PC_RSSL_OUTPUT_BUFFERS_GROWN]++;
+	if (nullptr != c->userSpecPtr) {
+		auto client = reinterpret_cast<client_t*> (c->userSpecPtr);
+		client->channel_info_ = info;
+		client->channel_info_.maxOutputBuffers = max_output_buffers;
+		client->has_channel_info_ = true;
+		client->view_.reset();
+	}
+	LOG(INFO) << "Output buffer pool grown: { "
+		  "\"listener\": \"" << listener_.name << "\""
+		", \"socketId\": " << c->socketId << ""
+		", \"maxOutputBuffers\": " << max_output_buffers << ""
+		", \"limit\": " << listener_.output_buffer_limit << ""
+		" }";
+	return true;
+}
+
 /* eof */
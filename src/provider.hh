@@ -7,7 +7,10 @@
 #include <winsock2.h>
 
 #include <cstdint>
+#include <map>
+#include <functional>
 #include <memory>
+#include <vector>
 #include <boost/unordered_map.hpp>
 #include <unordered_set>
 #include <utility>
@@ -31,8 +34,12 @@
 #include "config.hh"
 #include "deleter.hh"
 #include "client.hh"
+#include "counters.hh"
+#include "dictionary.hh"
+#include "flight_recorder.hh"
+#include "histogram.hh"
+#include "io_thread.hh"
 #include "kigoron_http_server.hh"
-#include "message_loop.hh"
 
 namespace kigoron
 {
@@ -40,6 +47,8 @@ namespace kigoron
 	enum {
 		PROVIDER_PC_BYTES_RECEIVED,
 		PROVIDER_PC_UNCOMPRESSED_BYTES_RECEIVED,
+		PROVIDER_PC_BYTES_SENT,
+		PROVIDER_PC_UNCOMPRESSED_BYTES_SENT,
 		PROVIDER_PC_MSGS_SENT,
 		PROVIDER_PC_RSSL_MSGS_ENQUEUED,
 		PROVIDER_PC_RSSL_MSGS_SENT,
@@ -74,19 +83,63 @@ namespace kigoron
 		PROVIDER_PC_RSSL_WRITE_EXCEPTION,
 		PROVIDER_PC_RSSL_WRITE_FLUSH_FAILED,
 		PROVIDER_PC_RSSL_WRITE_NO_BUFFERS,
+		PROVIDER_PC_RSSL_OUTPUT_BUFFERS_GROWN,
 /* marker */
 		PROVIDER_PC_MAX
 	};
 
+/* Latency histogram domains. */
+	enum {
+		LATENCY_DOMAIN_LOGIN,
+		LATENCY_DOMAIN_SOURCE,
+		LATENCY_DOMAIN_DICTIONARY,
+		LATENCY_DOMAIN_MARKET_PRICE,
+		LATENCY_DOMAIN_OTHER,
+/* marker */
+		LATENCY_DOMAIN_MAX
+	};
+
+/* Client session state copied by the reactor for the HTTP thread. */
+	struct client_snapshot_t {
+		uint64_t id;
+		std::shared_ptr<const std::string> address;
+		std::shared_ptr<const std::string> name;
+		boost::posix_time::ptime creation_time;
+		bool is_logged_in;
+		uint8_t rwf_major_version, rwf_minor_version;
+		size_t token_count;
+		unsigned pending_count;
+		unsigned ping_interval;
+		boost::posix_time::ptime next_ping, next_pong;
+		counters_snapshot_t<CLIENT_PC_MAX> stats;
+/* Channel state cached on the client, buffer usage is only sampled with
+ * output pending.
+ */
+		bool has_channel_info;
+		RsslChannelInfo channel_info;
+		RsslInt32 buffer_usage;
+		std::shared_ptr<const client_latency_t> latency;
+	};
+
+/* Provider state published on each counter snapshot, immutable once
+ * published.  Client views are shared between snapshots until the session
+ * changes.
+ */
+	struct provider_snapshot_t {
+		counters_snapshot_t<PROVIDER_PC_MAX> stats, previous_stats;
+		size_t connection_count;
+		bool has_server_info;
+		RsslServerInfo server_info;
+/* Ascending session id. */
+		std::vector<std::shared_ptr<const client_snapshot_t>> clients;
+	};
+
 	class provider_t
 		: public std::enable_shared_from_this<provider_t>
-		, public chromium::MessageLoopForIO
 		, public KigoronHttpServer::Delegate
 	{
 	public:
-		virtual bool WatchFileDescriptor (net::SocketDescriptor fd, bool persistent, Mode mode, FileDescriptorWatcher* controller, Watcher* delegate) override;
-
-		explicit provider_t (const config_t& config, std::shared_ptr<upa_t> upa, client_t::Delegate* request_delegate);
+		explicit provider_t (const config_t& config, const listener_config_t& listener, std::shared_ptr<upa_t> upa, std::shared_ptr<dictionary_t> dictionary, client_t::Delegate* request_delegate);
 		~provider_t();
 
 		bool Initialize();
@@ -97,14 +150,61 @@ namespace kigoron
 		void Close();
 
 		static bool WriteRawClose (uint16_t rwf_version, int32_t token, uint16_t service_id, uint8_t model_type, const chromium::StringPiece& item_name, bool use_attribinfo_in_updates, uint8_t stream_state, uint8_t status_code, const chromium::StringPiece& status_text, void* data, size_t* length);
+		static bool ReplaceStreamId (uint16_t rwf_version, int32_t token, uint8_t stream_state, void* data, size_t length);
 		bool SendReply (RsslChannel*const handle, int32_t token, const void* buf, size_t length);
+/* Provider of the client session on |handle|, that provider's reactor thread only. */
+		static provider_t* FromHandle (uintptr_t handle);
+
+/* Pre-encoded messages with a zero stream id, keyed by content including the
+ * RWF version of the encoding.  Entries are never evicted so keys must only
+ * be built from server controlled values.
+ */
+		const std::string* GetEncodedMessage (uint64_t key);
+		const std::string* SetEncodedMessage (uint64_t key, const void* data, size_t length);
+/* Item refresh images with a zero stream id keyed by item and an encoding
+ * key of the caller's choosing.  Reactor thread only, size bounded.
+ */
+		const std::string* GetRefreshImage (const void* item, uint64_t key) const;
+		void SetRefreshImage (const void* item, uint64_t key, const void* data, size_t length);
 
+		virtual const ProviderIdentity& identity() const override {
+			return identity_;
+		}
 		virtual void CreateInfo(ProviderInfo* info) override;
+		virtual void CreateLatency(bool is_cumulative, chromium::JSONStreamWriter* writer) override;
+		virtual void WriteMetrics(std::string* buffer) override;
+		virtual void CreateTelemetry(telemetry_topic_e topic, chromium::JSONStreamWriter* writer) override;
+		virtual void CreateClients(uint64_t after_id, unsigned limit, chromium::JSONStreamWriter* writer) override;
+		virtual bool CreateClient(uint64_t id, chromium::JSONStreamWriter* writer) override;
+		virtual void CreateFlightRecorder(size_t limit, chromium::JSONStreamWriter* writer) override;
+		virtual void RequestFlightRecorderDump() override {
+			is_flight_dump_requested_ = true;
+		}
+		virtual bool CreateSymbol(const std::string& key, chromium::JSONStreamWriter* writer) override {
+			return request_delegate_->WriteSymbol (key, writer);
+		}
+		virtual bool CreateSymbols(symbol_format_e format, size_t* cursor, size_t max_size, std::string* output) override {
+			if (SYMBOL_FORMAT_CSV == format)
+				return request_delegate_->WriteSymbolsCsv (cursor, max_size, output);
+			return request_delegate_->WriteSymbols (cursor, max_size, output);
+		}
+
+/* Reactor thread only. */
+		void RecordFlightEvent (flight_event_e type, uintptr_t handle, int32_t stream_id) {
+			flight_recorder_.Record (type, reinterpret_cast<const RsslChannel*> (handle)->socketId, stream_id);
+		}
+
+		void set_symbol_count (size_t count) {
+			symbol_count_.store (count, boost::memory_order_relaxed);
+		}
+
+/* Record elapsed time since receipt of the message currently being processed. */
+		void RecordLatency (latency_stage_e stage);
 
 		static uint8_t rwf_major_version (uint16_t rwf_version) { return rwf_version / 256; }
 		static uint8_t rwf_minor_version (uint16_t rwf_version) { return rwf_version % 256; }
-		uint16_t rwf_version() const {
-			return min_rwf_version_.load();
+		bool is_accepting_requests() const {
+			return is_accepting_requests_;
 		}
 		const std::string& service_name() const {
 			return config_.service_name;
@@ -115,15 +215,18 @@ namespace kigoron
 		const std::string& application_name() const {
 			return config_.application_name;
 		}
-		const std::string& send_buffer_size() const {
-			return config_.send_buffer_size;
+		const std::string& listener_name() const {
+			return listener_.name;
 		}
-		const std::string& recv_buffer_size() const {
-			return config_.recv_buffer_size;
+		unsigned compression_threshold() const {
+			return config_.compression_threshold;
 		}
 		const size_t open_window() const {
 			return config_.open_window;
 		}
+		dictionary_t* dictionary() const {
+			return dictionary_.get();
+		}
 
 	private:
 		bool DoWork();
@@ -155,22 +258,45 @@ namespace kigoron
 		bool GetServiceState (RsslEncodeIterator*const it);
 		bool GetServiceLoad (RsslEncodeIterator*const it);
 
-		int Submit (RsslChannel* c, RsslBuffer* buf);
+		void CreateIdentity();
+		void SnapshotStats();
+/* Reactor side, replaces the snapshot read by the HTTP thread. */
+		void PublishSnapshot();
+		void DumpFlightRecorder();
+		bool IsViewCurrent (const client_t& client) const;
+		std::shared_ptr<const provider_snapshot_t> snapshot() const {
+			boost::lock_guard<boost::mutex> lock (snapshot_lock_);
+			return snapshot_;
+		}
+		void WriteClient (const client_snapshot_t& client, chromium::JSONStreamWriter* writer);
+		void RecordLatency (client_t* client, unsigned domain, uint64_t receipt_time, latency_stage_e stage);
+		static unsigned latency_domain (uint8_t domain_type);
+
+		int Submit (RsslChannel* c, RsslBuffer* buf, bool* is_exhausted = nullptr);
 		int Ping (RsslChannel* c);
+		bool GrowOutputBuffers (RsslChannel* c);
 
 		void SetServiceId (uint16_t service_id) {
 			service_id_.store (service_id);
 		}
 
 		const config_t& config_;
+		const listener_config_t& listener_;
 
 /* UPA context. */
 		std::shared_ptr<upa_t> upa_;
+/* RDM dictionaries served on MMT_DICTIONARY. */
+		std::shared_ptr<dictionary_t> dictionary_;
 /* Server socket for new connections */
 		RsslServer* rssl_sock_;
-/* Built in HTTP server. */
+/* Built in HTTP server, on its own thread apart from the reactor. */
+		std::unique_ptr<io_thread_t> http_thread_;
 		std::shared_ptr<KigoronHttpServer> server_;
-		std::list<std::weak_ptr<FileDescriptorWatcher>> watch_list_;
+/* Host and process identity, set before the HTTP server starts. */
+		ProviderIdentity identity_;
+/* Latest published state, the lock only covers the pointer. */
+		std::shared_ptr<const provider_snapshot_t> snapshot_;
+		mutable boost::mutex snapshot_lock_;
 /* This flag is set to false when Run should return. */
 		boost::atomic_bool keep_running_;
 
@@ -184,15 +310,20 @@ namespace kigoron
 
 /* UPA Client Session directory */
 		boost::unordered_map<RsslChannel*const, std::shared_ptr<client_t>> clients_;
+/* Ordered by session id for published snapshots. */
+		std::map<uint64_t, std::shared_ptr<client_t>> clients_by_id_;
+		uint64_t next_client_id_;
 		boost::shared_mutex clients_lock_;
 
 		client_t::Delegate* request_delegate_;
 		friend client_t;
-		friend chromium::MessageLoopForIO::FileDescriptorWatcher;
 		friend KigoronHttpServer;
 
-/* Reuters Wire Format versions. */
-		boost::atomic_uint16_t min_rwf_version_;
+/* Login and directory refreshes per negotiated RWF version. */
+		boost::unordered_map<uint64_t, std::string> encoded_messages_;
+		boost::mutex encoded_messages_lock_;
+/* Item refresh images, as above without a lock. */
+		boost::unordered_map<std::pair<const void*, uint64_t>, std::string> refresh_images_;
 
 /* Directory mapped ServiceID */
 		boost::atomic_uint16_t service_id_;
@@ -202,8 +333,37 @@ namespace kigoron
 
 /** Performance Counters **/
 		boost::posix_time::ptime creation_time_, last_activity_;
-		uint32_t cumulative_stats_[PROVIDER_PC_MAX];
-		uint32_t snap_stats_[PROVIDER_PC_MAX];
+		counters_t<PROVIDER_PC_MAX> cumulative_stats_;
+/* Interval snapshots rolled by the reactor, readers compute rates between them. */
+		counters_snapshot_t<PROVIDER_PC_MAX> snap_stats_, previous_snap_stats_;
+		boost::posix_time::ptime next_snapshot_;
+
+/** Latency histograms, global and per domain **/
+/* Message in process, zero receipt time when idle. */
+		uint64_t receipt_time_;
+		unsigned receipt_domain_;
+		client_t* receipt_client_;
+		int32_t receipt_stream_id_;
+		histogram_t latency_[LATENCY_STAGE_MAX];
+		histogram_t domain_latency_[LATENCY_DOMAIN_MAX][LATENCY_STAGE_MAX];
+/* Last interval snapshot, HTTP thread only. */
+		histogram_snapshot_t latency_previous_[LATENCY_STAGE_MAX];
+		histogram_snapshot_t domain_latency_previous_[LATENCY_DOMAIN_MAX][LATENCY_STAGE_MAX];
+		std::map<uint64_t, std::vector<histogram_snapshot_t>> client_latency_previous_;
+		boost::posix_time::ptime latency_previous_time_;
+/* Last telemetry interval snapshot. */
+		histogram_snapshot_t telemetry_latency_previous_[LATENCY_STAGE_MAX];
+/* Scratch snapshot for metrics rendering. */
+		histogram_snapshot_t metrics_snapshot_;
+
+/* Recent request processing events, dumped by the reactor such that no
+ * event is overwritten whilst being written out.
+ */
+		flight_recorder_t flight_recorder_;
+		boost::atomic_bool is_flight_dump_requested_;
+
+/* Size of the application symbol map. */
+		boost::atomic<size_t> symbol_count_;
 
 		chromium::debug::LeakTracker<provider_t> leak_tracker_;
 	};
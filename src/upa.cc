@@ -29,9 +29,11 @@ kigoron::upa_t::Initialize()
 
 /* UPA library state.  As of rssl1.5 rsslInitialize implements reference
  * counting so each call should be matched with a call to rsslUninitialize.
+ * Each listener reactor owns its channels, only global state is shared.
  */
 	VLOG(2) << "Initializing UPA.";
-	if (RSSL_RET_SUCCESS != rsslInitialize (RSSL_LOCK_NONE, &rssl_err)) {
+	const RsslLockingTypes locking = (config_.listeners.size() > 1) ? RSSL_LOCK_GLOBAL : RSSL_LOCK_NONE;
+	if (RSSL_RET_SUCCESS != rsslInitialize (locking, &rssl_err)) {
 		LOG(ERROR) << "rsslInitialize: { "
 			  "\"rsslErrorId\": " << rssl_err.rsslErrorId << ""
 			", \"sysError\": " << rssl_err.sysError << ""
@@ -0,0 +1,77 @@
+/* Background task runner.
+ */
+
+#include "worker_thread.hh"
+
+#include "chromium/logging.hh"
+
+kigoron::worker_thread_t::worker_thread_t()
+	: keep_running_ (false)
+{
+}
+
+kigoron::worker_thread_t::~worker_thread_t()
+{
+	Stop();
+}
+
+bool
+kigoron::worker_thread_t::Start()
+{
+	if ((bool)thread_)
+		return true;
+	keep_running_ = true;
+	thread_.reset (new boost::thread ([this]() { Run(); }));
+	return true;
+}
+
+void
+kigoron::worker_thread_t::Stop()
+{
+	if (!(bool)thread_)
+		return;
+	{
+		boost::lock_guard<boost::mutex> lock (tasks_lock_);
+		keep_running_ = false;
+		tasks_cond_.notify_one();
+	}
+	thread_->join();
+	thread_.reset();
+/* Released outside of the lock as tasks may own arbitrary state. */
+	std::deque<std::function<void()>> discarded;
+	{
+		boost::lock_guard<boost::mutex> lock (tasks_lock_);
+		discarded.swap (tasks_);
+	}
+}
+
+void
+kigoron::worker_thread_t::PostTask (
+	std::function<void()> task
+	)
+{
+	boost::lock_guard<boost::mutex> lock (tasks_lock_);
+	DCHECK(keep_running_);
+	tasks_.emplace_back (std::move (task));
+	tasks_cond_.notify_one();
+}
+
+void
+kigoron::worker_thread_t::Run()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			boost::unique_lock<boost::mutex> lock (tasks_lock_);
+			while (keep_running_ && tasks_.empty())
+				tasks_cond_.wait (lock);
+			if (!keep_running_)
+				break;
+			task.swap (tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+	}
+}
+
+/* eof */
@@ -0,0 +1,47 @@
+/* Background task runner.
+ *
+ * A single thread running posted tasks in order, for work that must stay
+ * off a reactor thread.  Results are returned by posting a task back to the
+ * reactor message loop.
+ */
+
+#ifndef WORKER_THREAD_HH_
+#define WORKER_THREAD_HH_
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+/* Boost threading. */
+#include <boost/thread.hpp>
+
+namespace kigoron
+{
+	class worker_thread_t
+	{
+	public:
+		explicit worker_thread_t();
+		~worker_thread_t();
+
+		bool Start();
+/* Joins the thread, tasks not yet started are discarded. */
+		void Stop();
+
+/* Safe from any thread. */
+		void PostTask (std::function<void()> task);
+
+	private:
+		void Run();
+
+		std::deque<std::function<void()>> tasks_;
+		boost::mutex tasks_lock_;
+		boost::condition_variable tasks_cond_;
+		bool keep_running_;
+		std::unique_ptr<boost::thread> thread_;
+	};
+
+} /* namespace kigoron */
+
+#endif /* WORKER_THREAD_HH_ */
+
+/* eof */